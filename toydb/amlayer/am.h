@@ -24,7 +24,8 @@ extern int AM_LeftPageNum; /* The page Number of the leftmost leaf */
 extern int AM_Errno; /* last error in AM layer */
 extern int AM_BulkLoadFromSortedPairs(
     char *fileName, int indexNo, char attrType,
-    int attrLength, char **keys, int *recIds, int nKeys);
+    int attrLength, char **keys, int *recIds, int nKeys,
+    int leafFill, int intFill);
 
 extern int AM_BuildIndexFromExistingFile(
     char *dataFileName, int dataFd, char attrType, int attrLength,
@@ -90,3 +91,56 @@ extern void AM_SplitIntNode(char *pageBuf, char *pbuf1, char *pbuf2,
 # define AME_INVALIDATTRTYPE -9
 # define AME_FD -10
 # define AME_INVALIDVALUE -11
+# define AME_RECIDLISTFULL -12
+
+typedef struct am_bulkload
+	{
+		int fileDesc;
+		char attrType;
+		int attrLength;
+		int nKeys; /* pairs added so far */
+		char lastKey[AM_MAXATTRLENGTH];
+		int nLeaves; /* leaves so far; leaf i is on page i+1 */
+		int maxLeaves;
+		char *firstKeys; /* first key of each leaf, attrLength apiece */
+		char *leaf; /* the last leaf, being filled in private memory */
+		AM_LEAFHEADER leafHdr; /* and its header */
+		int runEnd; /* its last key's recid nodes: recIdPtr..runEnd */
+		char *rootBuf; /* page 0, fixed until the root is known */
+		int leafSpace; /* bytes a leaf may use: its fill factor */
+		int intKeys; /* keys an internal node gets: its fill factor */
+	} AM_BULKLOAD; /* A bulk load in progress: see AM_BulkBegin() */
+
+# define AM_FILL_FULL 100 /* bulk load fill factor (percent): pack pages */
+
+extern int AM_BulkBegin(char *fileName, int indexNo, char attrType,
+    int attrLength, int leafFill, int intFill, AM_BULKLOAD *bl);
+extern int AM_BulkAdd(AM_BULKLOAD *bl, char *key, int recId);
+extern int AM_BulkEnd(AM_BULKLOAD *bl);
+
+typedef struct am_pair
+	{
+		int key;
+		int recId;
+	} AM_PAIR; /* A (key, recid) pair of an int index, for the amsort.c sorts */
+
+extern int AM_SortPairs(AM_PAIR *pairs, int n, int nThreads);
+extern int AM_RadixSortPairs(AM_PAIR *pairs, int n);
+
+typedef struct am_blink
+	{
+		int fileDesc;
+		char attrType;
+		int attrLength;
+	} AM_BLINK; /* An open B-link index, shared by threads: see amblink.c */
+
+extern int AM_BLinkCreate(char *fileName, int indexNo);
+extern int AM_BLinkOpen(char *fileName, int indexNo, char attrType,
+    int attrLength, AM_BLINK *bi);
+extern int AM_BLinkInsert(AM_BLINK *bi, char *key, int recId);
+extern int AM_BLinkLookup(AM_BLINK *bi, char *key, int *recIds, int maxIds);
+extern int AM_BLinkClose(AM_BLINK *bi);
+
+extern int AM_BulkLoadFromFileSorted(
+    char *dataFileName, int dataFd, char attrType, int attrLength,
+    char *indexFileName, int indexNo, int leafFill, int intFill);
@@ -5,32 +5,672 @@
  *   - incremental build (AM_BuildIndexIncremental)
  *   - sorted insert build (AM_BuildIndexFromExistingFile)
  *   - bulk load build (AM_BulkLoadFromFileSorted)
+ * checking that each index holds the same entries, and that EQUAL scans
+ * of the bulk-loaded one find every recid of each key, times inserts into
+ * the bulk-loaded index at 70, 85 and 100% fill, times inserts and
+ * lookups on a B-link index (AM_BLinkInsert) from 1 to 8 threads, times
+ * the parallel sort of (key, recid) pairs with 1 to 8 threads against the
+ * radix sort, and then a roll-number range query through an index on an RM heap
+ * file of the same rows, before and after RM_ClusterFile() orders the
+ * heap by roll number, with heap fetches by RM_GetRecord() and by
+ * RM_FetchRIDs().
  *
  * Make sure amlayer is compiled with -I../pflayer and link with pflayer objects.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "am.h"
 #include "../pflayer/pf.h"
+#include "../pflayer/rm.h"
 #include "amstats.h"
 
-/* declare functions from ambuild/ambulk */
-int AM_BuildIndexIncremental(char *, int, char, int, char *, int);
-int AM_BuildIndexFromExistingFile(char *, int, char, int, char *, int);
-int AM_BulkLoadFromFileSorted(char *, char *, int, char, int);
+#define HEAP_FILE  "student.rm"   /* its roll-number index is student.rm.0 */
+#define ROLL_LEN   8
+#define MAX_ROWS   20000
+
+/* roll-number ranges queried: a year, and a block of departments in it */
+static char *rangeLo[] = { "95000000", "95300000" };
+static char *rangeHi[] = { "95999999", "95399999" };
+#define NUM_RANGES 2
+
+/* RIDs are kept in the index as ints */
+#define RID_TO_INT(rid)  ((rid).page * PF_PAGE_SIZE + (rid).slot)
+#define INT_TO_RID(i, rid) ((rid)->page = (i) / PF_PAGE_SIZE, (rid)->slot = (i) % PF_PAGE_SIZE)
+
+/* probe for the index check: the rolls from this year on */
+#define CHECK_ROLL 95000000
 
 static long timeval_diff_ms(struct timeval *a, struct timeval *b)
 {
     return (a->tv_sec - b->tv_sec) * 1000 + (a->tv_usec - b->tv_usec) / 1000;
 }
 
+/* entries of an int index, their recid sum, and entries from CHECK_ROLL on */
+static void check_index(char *indexFile, int indexNo)
+{
+    char fname[AM_MAX_FNAME_LENGTH];
+    int fd, sd, recId, n = 0, from = 0, roll = CHECK_ROLL;
+    long sum = 0;
+
+    sprintf(fname, "%s.%d", indexFile, indexNo);
+    if ((fd = PF_OpenFile(fname, PF_REPLACE_LRU)) < 0)
+        return;
+    if ((sd = AM_OpenIndexScan(fd, INT_TYPE, sizeof(int), ALL, NULL)) >= 0) {
+        while ((recId = AM_FindNextEntry(sd)) >= 0) {
+            n++;
+            sum += recId;
+        }
+        AM_CloseIndexScan(sd);
+    }
+    if ((sd = AM_OpenIndexScan(fd, INT_TYPE, sizeof(int), GREATER_THAN_EQUAL,
+                               (char *) &roll)) >= 0) {
+        while (AM_FindNextEntry(sd) >= 0)
+            from++;
+        AM_CloseIndexScan(sd);
+    } else
+        from = sd;
+    PF_CloseFile(fd);
+    printf("Index entries: %d, recid sum: %ld, rolls >= %d: ", n, sum, CHECK_ROLL);
+    if (from < 0)
+        printf("scan failed: %d\n", from);
+    else
+        printf("%d\n", from);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    int x = *(const int *) a, y = *(const int *) b;
+    return (x < y) ? -1 : (x > y);
+}
+
+/* recids an EQUAL scan of an int index finds for key */
+static int count_equal(int fd, int key)
+{
+    int sd, n = 0;
+
+    if ((sd = AM_OpenIndexScan(fd, INT_TYPE, sizeof(int), EQUAL, (char *) &key)) < 0)
+        return sd;
+    while (AM_FindNextEntry(sd) >= 0)
+        n++;
+    AM_CloseIndexScan(sd);
+    return n;
+}
+
+/* EQUAL scans for every roll number of the data file, against index refNo
+   built by AM_InsertEntry(): each key must find all its recids, which a
+   key's recid list split across two leaves would not */
+static void check_equal(char *dataFile, char *indexFile, int indexNo, int refNo)
+{
+    FILE *f;
+    char line[2048], fname[AM_MAX_FNAME_LENGTH], *p;
+    int *rolls, n = 0, keys = 0, bad = 0, i, fd, refFd;
+
+    if ((rolls = (int *) malloc(MAX_ROWS * sizeof(int))) == NULL)
+        return;
+    if ((f = fopen(dataFile, "r")) == NULL) {
+        free(rolls);
+        return;
+    }
+    while (n < MAX_ROWS && fgets(line, sizeof(line), f) != NULL) {
+        if ((p = strchr(line, ';')) == NULL || p[1] == ';')
+            continue;
+        rolls[n++] = atoi(p + 1);
+    }
+    fclose(f);
+    qsort(rolls, n, sizeof(int), cmp_int);
+
+    sprintf(fname, "%s.%d", indexFile, indexNo);
+    if ((fd = PF_OpenFile(fname, PF_REPLACE_LRU)) < 0) {
+        free(rolls);
+        return;
+    }
+    sprintf(fname, "%s.%d", indexFile, refNo);
+    if ((refFd = PF_OpenFile(fname, PF_REPLACE_LRU)) < 0) {
+        PF_CloseFile(fd);
+        free(rolls);
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        if (i > 0 && rolls[i] == rolls[i - 1])
+            continue;
+        keys++;
+        bad += count_equal(fd, rolls[i]) != count_equal(refFd, rolls[i]);
+    }
+    PF_CloseFile(refFd);
+    PF_CloseFile(fd);
+    free(rolls);
+    printf("EQUAL scans against index %d: %d keys, %d differ\n", refNo, keys, bad);
+}
+
+/* copies of the student pairs sorted by pair_sort_bench(), and threads */
+#define SORT_COPIES 64
+static int sortThreads[] = { 1, 2, 4, 8 };
+#define NUM_SORT_THREADS 4
+
+/* time AM_SortPairs() on n pairs with 1..8 threads, then
+   AM_RadixSortPairs(), checking the order; the pairs are in recid order */
+static void pair_sort_row(AM_PAIR *pairs, int n, AM_PAIR *work)
+{
+    struct timeval t1, t2;
+    double ms, ms1 = 0.0;
+    int i, k, bad;
+
+    for (k = 0; k <= NUM_SORT_THREADS; k++) {
+        memcpy(work, pairs, n * sizeof(AM_PAIR));
+        gettimeofday(&t1, NULL);
+        if (k < NUM_SORT_THREADS)
+            AM_SortPairs(work, n, sortThreads[k]);
+        else
+            AM_RadixSortPairs(work, n);
+        gettimeofday(&t2, NULL);
+        ms = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+        if (k == 0)
+            ms1 = ms;
+        for (i = 1, bad = 0; i < n; i++)
+            bad += work[i - 1].key > work[i].key ||
+                   (work[i - 1].key == work[i].key && work[i - 1].recId > work[i].recId);
+        if (k < NUM_SORT_THREADS)
+            printf("pairs: %8d, threads: %d, sort (ms): %8.2f, speedup: %5.2f, order: %s\n",
+                   n, sortThreads[k], ms, ms > 0.0 ? ms1 / ms : 0.0, bad ? "WRONG" : "ok");
+        else
+            printf("pairs: %8d, radix:     sort (ms): %8.2f, speedup: %5.2f, order: %s\n",
+                   n, ms, ms > 0.0 ? ms1 / ms : 0.0, bad ? "WRONG" : "ok");
+    }
+}
+
+/* the roll-number pairs of the data file, and SORT_COPIES copies of them */
+static void pair_sort_bench(char *dataFile)
+{
+    FILE *f;
+    char line[2048], *p;
+    AM_PAIR *pairs, *work;
+    int n = 0, max = MAX_ROWS, i;
+
+    printf("\n=== In-memory pair sort (AM_SortPairs, AM_RadixSortPairs), %ld processors ===\n",
+           (long) sysconf(_SC_NPROCESSORS_ONLN));
+    if ((f = fopen(dataFile, "r")) == NULL)
+        return;
+    pairs = (AM_PAIR *) malloc((long) max * SORT_COPIES * sizeof(AM_PAIR));
+    work = (AM_PAIR *) malloc((long) max * SORT_COPIES * sizeof(AM_PAIR));
+    if (pairs == NULL || work == NULL) {
+        printf("out of memory\n");
+        fclose(f);
+        free(pairs);
+        free(work);
+        return;
+    }
+    while (n < max && fgets(line, sizeof(line), f) != NULL) {
+        if ((p = strchr(line, ';')) == NULL || p[1] == ';')
+            continue;
+        pairs[n].key = atoi(p + 1);
+        pairs[n].recId = n;
+        n++;
+    }
+    fclose(f);
+
+    pair_sort_row(pairs, n, work);
+    for (i = n; i < n * SORT_COPIES; i++) {
+        pairs[i].key = pairs[i % n].key;
+        pairs[i].recId = i;
+    }
+    pair_sort_row(pairs, n * SORT_COPIES, work);
+    free(pairs);
+    free(work);
+}
+
+/* fill factors of the bulk loads in fill_bench(), and inserts after each */
+static int fillFactors[] = { 70, 85, 100 };
+#define NUM_FILLS    3
+#define FILL_INSERTS 5000
+
+/* bulk load the int index at each fill factor (leaves and internal nodes
+   alike), then time FILL_INSERTS inserts of random roll numbers between
+   the smallest and largest: into a packed index nearly every one splits */
+static void fill_bench(char *dataFile, char *indexFile)
+{
+    FILE *f;
+    char line[2048], fname[AM_MAX_FNAME_LENGTH], *p;
+    int lo = 0, hi = 0, n = 0, k, i, roll, fd, pages, status, fails;
+    struct timeval t1, t2;
+    double ms;
+
+    printf("\n=== Inserts after bulk load, by fill factor ===\n");
+    if ((f = fopen(dataFile, "r")) == NULL)
+        return;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if ((p = strchr(line, ';')) == NULL || p[1] == ';')
+            continue;
+        roll = atoi(p + 1);
+        if (n == 0 || roll < lo) lo = roll;
+        if (n == 0 || roll > hi) hi = roll;
+        n++;
+    }
+    fclose(f);
+    sprintf(fname, "%s.%d", indexFile, 4);
+
+    for (k = 0; k < NUM_FILLS; k++) {
+        AM_DestroyIndex(indexFile, 4);
+        status = AM_BulkLoadFromFileSorted(dataFile, 0, INT_TYPE, sizeof(int), indexFile, 4,
+                                           fillFactors[k], fillFactors[k]);
+        if (status == AME_OK)
+            check_equal(dataFile, indexFile, 4, 1);
+        if (status != AME_OK || (fd = PF_OpenFile(fname, PF_REPLACE_LRU)) < 0) {
+            printf("fill %3d%%: bulk load failed: %d\n", fillFactors[k], status);
+            continue;
+        }
+        pages = PF_GetNumPages(fd);
+
+        srand(1);
+        fails = 0;
+        PFbufStatsInit();
+        gettimeofday(&t1, NULL);
+        for (i = 0; i < FILL_INSERTS; i++) {
+            roll = lo + (int) ((double) rand() / ((double) RAND_MAX + 1) * (hi - lo + 1));
+            if (AM_InsertEntry(fd, INT_TYPE, sizeof(int), (char *) &roll, n + i) != AME_OK)
+                fails++;
+        }
+        gettimeofday(&t2, NULL);
+        ms = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+
+        printf("fill %3d%%: pages %4d -> %4d, inserts: %d (%d failed), time (ms): %7.2f, "
+               "inserts/ms: %6.1f, logical reads: %ld, logical writes: %ld\n",
+               fillFactors[k], pages, PF_GetNumPages(fd), FILL_INSERTS, fails, ms,
+               ms > 0.0 ? FILL_INSERTS / ms : 0.0,
+               (long) PF_logicalReads, (long) PF_logicalWrites);
+        PF_CloseFile(fd);
+        check_index(indexFile, 4);
+    }
+    AM_DestroyIndex(indexFile, 4);
+}
+
+/* threads of blink_bench(), and one thread's share of a phase */
+static int blinkThreads[] = { 1, 2, 4, 8 };
+#define NUM_BLINK_THREADS 4
+#define MAX_BLINK_THREADS 8
+#define BLINK_INDEX  5      /* the B-link index is student.5 */
+#define BLINK_MAXIDS 512     /* a roll number repeats up to 171 times */
+
+struct blink_work {
+    AM_BLINK *bi;
+    AM_PAIR *pairs;
+    int n;
+    int id;             /* pairs id, id + nThreads, ... */
+    int nThreads;
+    int insert;         /* insert the pairs, with recid + offset */
+    int offset;
+    int lookup;         /* look the pairs up, checking their recids */
+    int errors;
+    pthread_t thread;
+    int started;
+};
+
+/* one thread's share of a blink_bench() phase */
+static void *blink_run(void *arg)
+{
+    struct blink_work *w = (struct blink_work *) arg;
+    int ids[BLINK_MAXIDS], i, k, c;
+
+    for (i = w->id; i < w->n; i += w->nThreads) {
+        if (w->insert &&
+            AM_BLinkInsert(w->bi, (char *) &w->pairs[i].key,
+                           w->pairs[i].recId + w->offset) != AME_OK)
+            w->errors++;
+        if (w->lookup) {
+            c = AM_BLinkLookup(w->bi, (char *) &w->pairs[i].key, ids, BLINK_MAXIDS);
+            for (k = 0; k < c && k < BLINK_MAXIDS && ids[k] != w->pairs[i].recId; k++)
+                ;
+            if (k == c || k == BLINK_MAXIDS)
+                w->errors++;
+        }
+    }
+    return NULL;
+}
+
+/* run a phase in "nThreads" threads; returns its time (ms), adding the
+   failed inserts and lookups to *errors */
+static double blink_phase(AM_BLINK *bi, AM_PAIR *pairs, int n, int nThreads,
+                          int insert, int offset, int lookup, int *errors)
+{
+    struct blink_work w[MAX_BLINK_THREADS];
+    struct timeval t1, t2;
+    int t;
+
+    gettimeofday(&t1, NULL);
+    for (t = 0; t < nThreads; t++) {
+        w[t].bi = bi;
+        w[t].pairs = pairs;
+        w[t].n = n;
+        w[t].id = t;
+        w[t].nThreads = nThreads;
+        w[t].insert = insert;
+        w[t].offset = offset;
+        w[t].lookup = lookup;
+        w[t].errors = 0;
+        w[t].started = (pthread_create(&w[t].thread, NULL, blink_run, (void *) &w[t]) == 0);
+        if (!w[t].started)
+            blink_run((void *) &w[t]);
+    }
+    for (t = 0; t < nThreads; t++)
+        if (w[t].started)
+            pthread_join(w[t].thread, NULL);
+    gettimeofday(&t2, NULL);
+    for (t = 0; t < nThreads; t++)
+        *errors += w[t].errors;
+    return (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+}
+
+/* the roll numbers into a B-link index from 1 to 8 threads: inserts, then
+   lookups, then inserts of second copies (recid + n) mixed with lookups
+   of the first; then every roll number must have both recids */
+static void blink_bench(char *dataFile, char *indexFile)
+{
+    FILE *f;
+    char line[2048], *p;
+    AM_PAIR *pairs;
+    AM_BLINK bi;
+    int ids[BLINK_MAXIDS];
+    int n = 0, k, i, j, c, errors, bad, pages;
+    double ins, look, mixed;
+
+    printf("\n=== Concurrent B-link index (AM_BLinkInsert, AM_BLinkLookup), %ld processors ===\n",
+           (long) sysconf(_SC_NPROCESSORS_ONLN));
+    if ((f = fopen(dataFile, "r")) == NULL)
+        return;
+    if ((pairs = (AM_PAIR *) malloc(MAX_ROWS * sizeof(AM_PAIR))) == NULL) {
+        fclose(f);
+        return;
+    }
+    while (n < MAX_ROWS && fgets(line, sizeof(line), f) != NULL) {
+        if ((p = strchr(line, ';')) == NULL || p[1] == ';')
+            continue;
+        pairs[n].key = atoi(p + 1);
+        pairs[n].recId = n;
+        n++;
+    }
+    fclose(f);
+
+    for (k = 0; k < NUM_BLINK_THREADS; k++) {
+        AM_DestroyIndex(indexFile, BLINK_INDEX);
+        if (AM_BLinkCreate(indexFile, BLINK_INDEX) != AME_OK ||
+            AM_BLinkOpen(indexFile, BLINK_INDEX, INT_TYPE, sizeof(int), &bi) != AME_OK) {
+            printf("B-link index: create failed\n");
+            break;
+        }
+        errors = 0;
+        ins = blink_phase(&bi, pairs, n, blinkThreads[k], TRUE, 0, FALSE, &errors);
+        look = blink_phase(&bi, pairs, n, blinkThreads[k], FALSE, 0, TRUE, &errors);
+        mixed = blink_phase(&bi, pairs, n, blinkThreads[k], TRUE, n, TRUE, &errors);
+
+        for (i = 0, bad = 0; i < n; i++) {
+            c = AM_BLinkLookup(&bi, (char *) &pairs[i].key, ids, BLINK_MAXIDS);
+            for (j = 0; j < c && j < BLINK_MAXIDS && ids[j] != pairs[i].recId + n; j++)
+                ;
+            bad += (c < 2 || c % 2 != 0 || j == c || j == BLINK_MAXIDS);
+        }
+        pages = PF_GetNumPages(bi.fileDesc);
+        AM_BLinkClose(&bi);
+
+        printf("threads: %d, inserts/ms: %6.1f, lookups/ms: %6.1f, mixed ops/ms: %6.1f, "
+               "pages: %d, errors: %d, check: %s\n",
+               blinkThreads[k], ins > 0.0 ? n / ins : 0.0, look > 0.0 ? n / look : 0.0,
+               mixed > 0.0 ? 2 * n / mixed : 0.0, pages, errors, bad ? "WRONG" : "ok");
+    }
+    AM_DestroyIndex(indexFile, BLINK_INDEX);
+    free(pairs);
+}
+
+/* roll number (second field) of a student record, padded with '\0' */
+static void roll_key(char *data, int len, char *key)
+{
+    char *f, *end;
+
+    memset(key, 0, ROLL_LEN);
+    f = memchr(data, ';', len);
+    if (f == NULL)
+        return;
+    f++;
+    end = memchr(f, ';', (data + len) - f);
+    if (end == NULL)
+        end = data + len;
+    memcpy(key, f, (end - f) < ROLL_LEN ? (end - f) : ROLL_LEN);
+}
+
+/* load the student rows into a fresh heap file, in file order */
+static int load_heap(char *dataFile)
+{
+    RM_FileHandle fh;
+    RM_Record rec;
+    RID rid;
+    FILE *f;
+    char line[2048];
+    int n = 0, error;
+
+    RM_DestroyFile(HEAP_FILE);
+    if ((error = RM_CreateFile(HEAP_FILE)) != PFE_OK)
+        return error;
+    if ((error = RM_OpenFile(HEAP_FILE, &fh)) != PFE_OK)
+        return error;
+    if ((f = fopen(dataFile, "r")) == NULL) {
+        RM_CloseFile(&fh);
+        return PFE_UNIX;
+    }
+    fgets(line, sizeof(line), f);       /* title line */
+    while (error == PFE_OK && fgets(line, sizeof(line), f) != NULL) {
+        rec.data = line;
+        rec.length = strcspn(line, "\r\n");
+        if (rec.length == 0)
+            continue;
+        error = RM_InsertRecord(&fh, &rec, &rid);
+        n++;
+    }
+    fclose(f);
+    RM_CloseFile(&fh);
+    return (error == PFE_OK) ? n : error;
+}
+
+/* index every heap record under its roll number, in heap order */
+static int build_roll_index(void)
+{
+    RM_FileHandle fh;
+    RM_ScanHandle scan;
+    RM_Record rec;
+    RID rid;
+    char key[ROLL_LEN], fname[AM_MAX_FNAME_LENGTH];
+    int fd, error;
+
+    AM_DestroyIndex(HEAP_FILE, 0);
+    if ((error = AM_CreateIndex(HEAP_FILE, 0, STRING_TYPE, ROLL_LEN)) != AME_OK)
+        return error;
+    sprintf(fname, "%s.0", HEAP_FILE);
+    if ((fd = PF_OpenFile(fname, PF_REPLACE_LRU)) < 0)
+        return AME_PF;
+    if ((error = RM_OpenFile(HEAP_FILE, &fh)) != PFE_OK) {
+        PF_CloseFile(fd);
+        return AME_PF;
+    }
+    RM_ScanOpen(&fh, &scan);
+    while (RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK) {
+        roll_key(rec.data, rec.length, key);
+        if ((error = AM_InsertEntry(fd, STRING_TYPE, ROLL_LEN, key, RID_TO_INT(rid))) != AME_OK)
+            break;
+    }
+    RM_ScanClose(&scan);
+    RM_CloseFile(&fh);
+    PF_CloseFile(fd);
+    return (error == AME_OK || error == PFE_OK) ? AME_OK : error;
+}
+
+#define FETCH_CHUNK 64  /* RIDs taken from the index at a time */
+#define FETCH_STOP  1   /* range_row(): past the end of the range */
+
+/* a range query in progress */
+struct range_state {
+    char *hi;
+    int *rids;          /* RIDs of the rows, up to max of them */
+    int max;
+    int n;
+    int lastPage;
+    int pageChanges;
+};
+
+/* take the next row of the range, in index order; stop past its end */
+static int range_row(int i, RID *rid, RM_Record *rec, char *arg)
+{
+    struct range_state *st = (struct range_state *) arg;
+    char key[ROLL_LEN];
+
+    roll_key(rec->data, rec->length, key);
+    if (strncmp(key, st->hi, ROLL_LEN) > 0)
+        return FETCH_STOP;
+    if (rid->page != st->lastPage)
+        st->pageChanges++;
+    st->lastPage = rid->page;
+    if (st->n < st->max)
+        st->rids[st->n] = RID_TO_INT(*rid);
+    st->n++;
+    return PFE_OK;
+}
+
+/* Rows with lo <= roll <= hi, found through the index FETCH_CHUNK RIDs
+   at a time and fetched from the heap one by one with RM_GetRecord()
+   or, if "batched", per chunk with RM_FetchRIDs(). Files are opened
+   cold. The RIDs of the rows go to rids[] (up to max). Prints the PF
+   counters of the query, the heap fetches apart from the index scan. */
+static int range_query(char *label, char *lo, char *hi, int batched,
+                       int *rids, int max)
+{
+    RM_FileHandle fh;
+    RM_Record rec;
+    RID chunk[FETCH_CHUNK];
+    struct range_state st;
+    struct timeval t1, t2;
+    char fname[AM_MAX_FNAME_LENGTH];
+    int fd, sd, recId, i, k, more, error = PFE_OK;
+    long heapLogical = 0, heapPhysical = 0, logical0, physical0;
+
+    sprintf(fname, "%s.0", HEAP_FILE);
+    if ((fd = PF_OpenFile(fname, PF_REPLACE_LRU)) < 0)
+        return AME_PF;
+    if (RM_OpenFile(HEAP_FILE, &fh) != PFE_OK) {
+        PF_CloseFile(fd);
+        return AME_PF;
+    }
+    st.hi = hi;
+    st.rids = rids;
+    st.max = max;
+    st.n = 0;
+    st.lastPage = -1;
+    st.pageChanges = 0;
+
+    PFbufStatsInit();
+    gettimeofday(&t1, NULL);
+    sd = AM_OpenIndexScan(fd, STRING_TYPE, ROLL_LEN, GREATER_THAN_EQUAL, lo);
+    for (more = (sd >= 0); more && error == PFE_OK; ) {
+        for (k = 0; k < FETCH_CHUNK && (recId = AM_FindNextEntry(sd)) >= 0; k++)
+            INT_TO_RID(recId, &chunk[k]);
+        more = (k == FETCH_CHUNK);
+        logical0 = PF_logicalReads;
+        physical0 = PF_physicalReads;
+        if (batched)
+            error = RM_FetchRIDs(&fh, chunk, k, TRUE, range_row, (char *) &st);
+        for (i = 0; !batched && i < k && error == PFE_OK; i++) {
+            if ((error = RM_GetRecord(&fh, &chunk[i], &rec)) != PFE_OK)
+                break;
+            error = range_row(i, &chunk[i], &rec, (char *) &st);
+            free(rec.data);
+        }
+        heapLogical += PF_logicalReads - logical0;
+        heapPhysical += PF_physicalReads - physical0;
+    }
+    if (sd >= 0)
+        AM_CloseIndexScan(sd);
+    gettimeofday(&t2, NULL);
+    if (error != PFE_OK && error != FETCH_STOP)
+        printf("heap fetch failed: %d\n", error);
+
+    printf("%s..%s %-9s %-5s rows: %4d, heap page switches: %3d, ",
+           lo, hi, label, batched ? "batch" : "get", st.n, st.pageChanges);
+    printf("heap reads: %4ld logical, %3ld physical, index reads: %4ld logical, "
+           "%3ld physical, time (ms): %.2f\n",
+           heapLogical, heapPhysical, PF_logicalReads - heapLogical,
+           PF_physicalReads - heapPhysical,
+           (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0);
+    RM_CloseFile(&fh);
+    PF_CloseFile(fd);
+    return st.n;
+}
+
+/* range queries on the heap in file order, then clustered by roll number */
+static void cluster_bench(char *dataFile)
+{
+    RM_Predicate key;
+    RM_RidMap map;
+    RID oldRid, newRid;
+    int *before[NUM_RANGES], *after;
+    int nb[NUM_RANGES], na, i, r, bad = 0, error;
+
+    printf("\n=== Roll-number range query: index scan + heap fetch ===\n");
+    if ((error = load_heap(dataFile)) < 0 || (error = build_roll_index()) != AME_OK) {
+        printf("heap/index build failed: %d\n", error);
+        return;
+    }
+    after = (int *) malloc(MAX_ROWS * sizeof(int));
+    for (r = 0; r < NUM_RANGES; r++) {
+        before[r] = (int *) malloc(MAX_ROWS * sizeof(int));
+        if (before[r] == NULL || after == NULL) {
+            printf("out of memory\n");
+            return;
+        }
+        nb[r] = range_query("unordered", rangeLo[r], rangeHi[r], FALSE, before[r], MAX_ROWS);
+        if (range_query("unordered", rangeLo[r], rangeHi[r], TRUE, after, MAX_ROWS) != nb[r])
+            bad++;
+    }
+
+    memset((char *) &key, 0, sizeof(key));
+    key.delim = ';';
+    key.field = 1;
+    PFbufStatsInit();
+    if ((error = RM_ClusterFile(HEAP_FILE, &key, &map)) != PFE_OK
+        || (error = build_roll_index()) != AME_OK) {
+        printf("cluster failed: %d\n", error);
+        return;
+    }
+    printf("RM_ClusterFile: %d records remapped\n", map.n);
+
+    for (r = 0; r < NUM_RANGES; r++) {
+        na = range_query("clustered", rangeLo[r], rangeHi[r], FALSE, after, MAX_ROWS);
+        bad += (range_query("clustered", rangeLo[r], rangeHi[r], TRUE, after, MAX_ROWS) != na);
+
+        /* the remapped RIDs of the first answer must be the second one */
+        for (i = 0; i < nb[r] && i < MAX_ROWS; i++) {
+            INT_TO_RID(before[r][i], &oldRid);
+            if (!RM_RidMapLookup(&map, &oldRid, &newRid))
+                bad++;
+            before[r][i] = RID_TO_INT(newRid);
+        }
+        qsort(before[r], nb[r] < MAX_ROWS ? nb[r] : MAX_ROWS, sizeof(int), cmp_int);
+        qsort(after, na < MAX_ROWS ? na : MAX_ROWS, sizeof(int), cmp_int);
+        for (i = 0; i < nb[r] && i < na && i < MAX_ROWS; i++)
+            bad += (before[r][i] != after[i]);
+        bad += (nb[r] != na);
+        free(before[r]);
+    }
+    printf("answers and remapped RIDs: %s\n", bad == 0 ? "match" : "MISMATCH");
+
+    RM_RidMapFree(&map);
+    free(after);
+}
+
 int main()
 {
     char *dataFile  = "../../data/student.txt";
-    char *indexFile = "student";   // IMPORTANT
+    char *indexFile = "student";
     int dataFd      = 0;
     char attrType   = INT_TYPE;
     int attrLen     = sizeof(int);
@@ -41,6 +681,11 @@ int main()
     /* Initialize PF buffer pool */
     PF_Init(50);
 
+    /* indexes left by an earlier run */
+    AM_DestroyIndex(indexFile, 1);
+    AM_DestroyIndex(indexFile, 2);
+    AM_DestroyIndex(indexFile, 3);
+
     /* Method 1: incremental */
     printf("\n=== Method: Incremental Insert ===\n");
     PFbufStatsInit();
@@ -48,6 +693,7 @@ int main()
     if (status != AME_OK) printf("Incremental failed: %d\n", status);
     PFbufStatsPrint();
     printf("Time (ms): %.2f\n", AMstats.time_ms);
+    check_index(indexFile, 1);
 
     /* Method 2: sorted-then-insert */
     printf("\n=== Method: Sorted Insert ===\n");
@@ -55,16 +701,31 @@ int main()
     status = AM_BuildIndexFromExistingFile(dataFile, dataFd, attrType, attrLen, indexFile, 2);
     if (status != AME_OK) printf("Sorted insert failed: %d\n", status);
     PFbufStatsPrint();
-    printf("Time (ms): %.2f\n", AMstats.time_ms);
+    printf("Time (ms): %.2f (insert), sort (ms): %.2f\n", AMstats.time_ms, AMstats.sort_ms);
+    check_index(indexFile, 2);
 
-    /* Method 3: bulk load (only if implemented) */
-    printf("\n=== Method: Bulk Load from sorted pairs ===\n");
+    /* Method 3: sort (radix sort, for int keys), then bottom-up bulk load */
+    printf("\n=== Method: Bulk Load ===\n");
     PFbufStatsInit();
-    status = AM_BulkLoadFromFileSorted(dataFile, indexFile, 3, attrType, attrLen);
+    status = AM_BulkLoadFromFileSorted(dataFile, dataFd, attrType, attrLen, indexFile, 3,
+                                       AM_FILL_FULL, AM_FILL_FULL);
     if (status != AME_OK) printf("Bulk load failed: %d\n", status);
     PFbufStatsPrint();
-    printf("Time (ms): %.2f\n", AMstats.time_ms);
+    if (AMstats.read_ms >= 0.0)
+        printf("Time (ms): %.2f (read %.2f, sort %.2f, build %.2f), ",
+               AMstats.time_ms, AMstats.read_ms, AMstats.sort_ms,
+               AMstats.time_ms - AMstats.read_ms - AMstats.sort_ms);
+    else
+        printf("Time (ms): %.2f (read + sort %.2f, build %.2f), ",
+               AMstats.time_ms, AMstats.sort_ms, AMstats.time_ms - AMstats.sort_ms);
+    printf("sorted runs: %d, run pages: %ld\n", AMstats.sortRuns, AMstats.sortPages);
+    check_index(indexFile, 3);
+    check_equal(dataFile, indexFile, 3, 1);
 
+    fill_bench(dataFile, indexFile);
+    blink_bench(dataFile, indexFile);
+    pair_sort_bench(dataFile);
+    cluster_bench(dataFile);
     return 0;
 
 }
@@ -0,0 +1,506 @@
+/* amblink.c
+ *
+ * A B+ tree that many threads may search and insert into at once, after
+ * Lehman and Yao's B-link tree. The other AM routines keep the search
+ * path in AM_Stack and the root in AM_RootPageNum, so they are for one
+ * thread; these keep all of their state on the caller's stack.
+ *
+ * Every node has a link to its right sibling and a high key, the
+ * smallest entry that belongs to the right of it (none at the right end
+ * of a level). A split moves the upper half of a node to a new page,
+ * linked in to the right, and only then adds a separator to the parent;
+ * a search that reaches a node after the split but before the parent
+ * knows of it sees a target at or above the high key and moves right.
+ *
+ * A page fixed in the PF buffer cannot be fixed again until it is
+ * unfixed, so a fix is a short exclusive latch: a thread that finds its
+ * page fixed by another yields and retries. Searches hold one latch at a
+ * time; inserts hold one, plus the new pages of a split, which nobody
+ * else can reach yet. Latches are never held while waiting for another,
+ * so there is no deadlock. The root stays on page 0: it splits in place
+ * into two new pages, as in AM_FillRootPage().
+ *
+ * Entries are (key, recid) pairs, kept unique and sorted by key, then
+ * recid, so equal keys need no recid lists. These routines return AME_*
+ * codes but leave the shared AM_Errno alone.
+ *
+ * Exports:
+ *   AM_BLinkCreate(fileName, indexNo)
+ *   AM_BLinkOpen(fileName, indexNo, attrType, attrLength, bi)
+ *   AM_BLinkInsert(bi, key, recId)
+ *   AM_BLinkLookup(bi, key, recIds, maxIds)
+ *   AM_BLinkClose(bi)
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sched.h>
+
+#include "am.h"
+#include "pf.h"
+
+#define AM_BL_MAXDEPTH 32   /* levels remembered on the way down */
+
+/* page header of a B-link node */
+struct am_BLHeader {
+    char pageType;      /* 'l' for a leaf, 'i' for an internal node */
+    short level;        /* 0 for leaves */
+    short numKeys;
+    short hasHigh;      /* FALSE at the right end of a level */
+    int rightPage;      /* right sibling, or AM_NULL_PAGE */
+};
+
+/* the header is followed by the high key (key, recid), then by the
+   entries: (key, recid) in a leaf; a first child, then (key, recid,
+   child) in an internal node, the child holding entries from its
+   separator up to the next one */
+#define AM_BL_HDR           sizeof(struct am_BLHeader)
+#define AM_BL_HIGH(bi)      AM_BL_HDR
+#define AM_BL_ENTSIZE(bi, level) \
+    ((bi)->attrLength + AM_si + ((level) > 0 ? AM_si : 0))
+#define AM_BL_ENT0(bi, level) \
+    (AM_BL_HDR + (bi)->attrLength + AM_si + ((level) > 0 ? AM_si : 0))
+#define AM_BL_ENT(bi, level, i) \
+    (AM_BL_ENT0(bi, level) + (i) * AM_BL_ENTSIZE(bi, level))
+#define AM_BL_MAXENTS(bi, level) \
+    ((PF_PAGE_SIZE - AM_BL_ENT0(bi, level)) / AM_BL_ENTSIZE(bi, level))
+
+/* fix page "pageNum", waiting while another thread has it fixed */
+static int am_BLFix(bi, pageNum, buf)
+AM_BLINK *bi;
+int pageNum;
+char **buf;
+{
+    int errVal;
+
+    while ((errVal = PF_GetThisPage(bi->fileDesc, pageNum, buf)) == PFE_PAGEFIXED)
+        sched_yield();
+    return (errVal == PFE_OK) ? AME_OK : AME_PF;
+}
+
+/* compare (key, recId) with the pair at "entry": <0, 0 or >0 */
+static int am_BLCompare(bi, key, recId, entry)
+AM_BLINK *bi;
+char *key;
+int recId;
+char *entry;
+{
+    int c, r;
+
+    c = AM_Compare(entry, bi->attrType, bi->attrLength, key);
+    if (c != 0)
+        return c;
+    bcopy(entry + bi->attrLength, (char *) &r, AM_si);
+    return (recId < r) ? -1 : (recId > r);
+}
+
+/* number of entries of the page in "buf" below (key, recId) */
+static int am_BLLowerBound(bi, buf, key, recId)
+AM_BLINK *bi;
+char *buf;
+char *key;
+int recId;
+{
+    struct am_BLHeader h;
+    int lo = 0, hi, mid;
+
+    bcopy(buf, (char *) &h, AM_BL_HDR);
+    hi = h.numKeys;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (am_BLCompare(bi, key, recId, buf + AM_BL_ENT(bi, h.level, mid)) > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* child of internal page "buf" that holds (key, recId) */
+static int am_BLChild(bi, buf, key, recId)
+AM_BLINK *bi;
+char *buf;
+char *key;
+int recId;
+{
+    struct am_BLHeader h;
+    int lo = 0, hi, mid, child;
+
+    /* the last separator at or below the target */
+    bcopy(buf, (char *) &h, AM_BL_HDR);
+    hi = h.numKeys;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (am_BLCompare(bi, key, recId, buf + AM_BL_ENT(bi, h.level, mid)) >= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        bcopy(buf + AM_BL_HDR + bi->attrLength + AM_si, (char *) &child, AM_si);
+    else
+        bcopy(buf + AM_BL_ENT(bi, h.level, lo - 1) + bi->attrLength + AM_si,
+              (char *) &child, AM_si);
+    return child;
+}
+
+/* follow right links from the fixed page *pageNum while (key, recId)
+   lies at or above its high key; the page reached is left fixed */
+static int am_BLMoveRight(bi, pageNum, buf, key, recId)
+AM_BLINK *bi;
+int *pageNum;
+char **buf;
+char *key;
+int recId;
+{
+    struct am_BLHeader h;
+    int errVal;
+
+    for (;;) {
+        bcopy(*buf, (char *) &h, AM_BL_HDR);
+        if (!h.hasHigh || am_BLCompare(bi, key, recId, *buf + AM_BL_HIGH(bi)) < 0)
+            return AME_OK;
+        PF_UnfixPage(bi->fileDesc, *pageNum, FALSE);
+        *pageNum = h.rightPage;
+        if ((errVal = am_BLFix(bi, *pageNum, buf)) != AME_OK)
+            return errVal;
+    }
+}
+
+/* go down from the root to the node of "level" that holds (key, recId)
+   and leave it fixed; the internal pages passed are pushed on "stack" */
+static int am_BLDescend(bi, key, recId, level, stack, depth, pageNum, buf)
+AM_BLINK *bi;
+char *key;
+int recId;
+int level;
+int *stack;
+int *depth;
+int *pageNum;
+char **buf;
+{
+    struct am_BLHeader h;
+    int errVal, child;
+
+    *depth = 0;
+    *pageNum = 0;
+    if ((errVal = am_BLFix(bi, 0, buf)) != AME_OK)
+        return errVal;
+    for (;;) {
+        if ((errVal = am_BLMoveRight(bi, pageNum, buf, key, recId)) != AME_OK)
+            return errVal;
+        bcopy(*buf, (char *) &h, AM_BL_HDR);
+        if (h.level <= level)
+            return AME_OK;
+        child = am_BLChild(bi, *buf, key, recId);
+        if (*depth < AM_BL_MAXDEPTH)
+            stack[(*depth)++] = *pageNum;
+        PF_UnfixPage(bi->fileDesc, *pageNum, FALSE);
+        *pageNum = child;
+        if ((errVal = am_BLFix(bi, *pageNum, buf)) != AME_OK)
+            return errVal;
+    }
+}
+
+/* lay out node "buf" of "level": first child (internal nodes), "n"
+   entries from "ents", high key and right link */
+static void am_BLFill(bi, buf, level, child0, ents, n, high, rightPage)
+AM_BLINK *bi;
+char *buf;
+int level;
+int child0;
+char *ents;
+int n;
+char *high;     /* NULL: none */
+int rightPage;
+{
+    struct am_BLHeader h;
+
+    h.pageType = (level > 0) ? 'i' : 'l';
+    h.level = level;
+    h.numKeys = n;
+    h.hasHigh = (high != NULL);
+    h.rightPage = rightPage;
+    bcopy((char *) &h, buf, AM_BL_HDR);
+    if (high != NULL)
+        bcopy(high, buf + AM_BL_HIGH(bi), bi->attrLength + AM_si);
+    if (level > 0)
+        bcopy((char *) &child0, buf + AM_BL_HDR + bi->attrLength + AM_si, AM_si);
+    bcopy(ents, buf + AM_BL_ENT0(bi, level), n * AM_BL_ENTSIZE(bi, level));
+}
+
+/* add entry "ent" (key, recid[, child]) at "level", starting from the
+   path in "stack"; splits carry separators up until one fits */
+static int am_BLInsertAt(bi, level, ent, stack, depth)
+AM_BLINK *bi;
+int level;
+char *ent;
+int *stack;
+int depth;
+{
+    struct am_BLHeader h;
+    char *buf, *rbuf, *lbuf, *work;
+    char sep[AM_MAXATTRLENGTH + 2 * sizeof(int)];
+    char up[AM_MAXATTRLENGTH + 2 * sizeof(int)];
+    char high[AM_MAXATTRLENGTH + sizeof(int)];
+    int pageNum, rightNum, leftNum, recId, pos, esz, n, m, child0, errVal;
+
+    work = malloc(PF_PAGE_SIZE);
+    if (work == NULL)
+        return AME_INTERROR;
+
+    for (;;) {
+        bcopy(ent + bi->attrLength, (char *) &recId, AM_si);
+        esz = AM_BL_ENTSIZE(bi, level);
+
+        /* the node of "level" for the entry: the parent passed on the way
+           down, unless the root has grown above it since */
+        errVal = AME_OK;
+        pageNum = -1;
+        if (depth > 0) {
+            pageNum = stack[--depth];
+            errVal = am_BLFix(bi, pageNum, &buf);
+            if (errVal == AME_OK) {
+                bcopy(buf, (char *) &h, AM_BL_HDR);
+                if (h.level != level) {
+                    PF_UnfixPage(bi->fileDesc, pageNum, FALSE);
+                    pageNum = -1;
+                }
+            }
+        }
+        if (errVal == AME_OK && pageNum < 0)
+            errVal = am_BLDescend(bi, ent, recId, level, stack, &depth, &pageNum, &buf);
+        if (errVal == AME_OK)
+            errVal = am_BLMoveRight(bi, &pageNum, &buf, ent, recId);
+        if (errVal != AME_OK)
+            break;
+        bcopy(buf, (char *) &h, AM_BL_HDR);
+        pos = am_BLLowerBound(bi, buf, ent, recId);
+
+        /* room: shift the entries above up and put it in */
+        if (h.numKeys < AM_BL_MAXENTS(bi, level)) {
+            memmove(buf + AM_BL_ENT(bi, level, pos + 1), buf + AM_BL_ENT(bi, level, pos),
+                    (h.numKeys - pos) * esz);
+            bcopy(ent, buf + AM_BL_ENT(bi, level, pos), esz);
+            h.numKeys++;
+            bcopy((char *) &h, buf, AM_BL_HDR);
+            errVal = (PF_UnfixPage(bi->fileDesc, pageNum, TRUE) == PFE_OK) ? AME_OK : AME_PF;
+            break;
+        }
+
+        /* full: the entries with the new one in "work" (there is room:
+           a page holds its header and high key too), then split them */
+        n = h.numKeys;
+        bcopy(buf + AM_BL_ENT0(bi, level), work, pos * esz);
+        bcopy(ent, work + pos * esz, esz);
+        bcopy(buf + AM_BL_ENT(bi, level, pos), work + (pos + 1) * esz, (n - pos) * esz);
+        n++;
+        m = n / 2;
+        child0 = 0;
+        if (level > 0)
+            bcopy(buf + AM_BL_HDR + bi->attrLength + AM_si, (char *) &child0, AM_si);
+        if (h.hasHigh)
+            bcopy(buf + AM_BL_HIGH(bi), high, bi->attrLength + AM_si);
+
+        /* entry m separates the halves; an internal node moves it up
+           and gives its child to the right half as first child */
+        bcopy(work + m * esz, sep, bi->attrLength + AM_si);
+
+        errVal = AME_PF;
+        if (PF_AllocPage(bi->fileDesc, &rightNum, &rbuf) != PFE_OK) {
+            PF_UnfixPage(bi->fileDesc, pageNum, FALSE);
+            break;
+        }
+        if (level > 0) {
+            int rchild;
+
+            bcopy(work + m * esz + bi->attrLength + AM_si, (char *) &rchild, AM_si);
+            am_BLFill(bi, rbuf, level, rchild, work + (m + 1) * esz, n - m - 1,
+                      h.hasHigh ? high : NULL, h.rightPage);
+        } else
+            am_BLFill(bi, rbuf, level, 0, work + m * esz, n - m,
+                      h.hasHigh ? high : NULL, h.rightPage);
+
+        if (pageNum == 0) {
+            /* the root: both halves move to new pages, and it becomes
+               their parent, a level up */
+            if (PF_AllocPage(bi->fileDesc, &leftNum, &lbuf) != PFE_OK) {
+                PF_UnfixPage(bi->fileDesc, rightNum, TRUE);
+                PF_UnfixPage(bi->fileDesc, pageNum, FALSE);
+                break;
+            }
+            am_BLFill(bi, lbuf, level, child0, work, m, sep, rightNum);
+            bcopy((char *) &rightNum, sep + bi->attrLength + AM_si, AM_si);
+            am_BLFill(bi, buf, level + 1, leftNum, sep, 1, (char *) NULL, AM_NULL_PAGE);
+            if (PF_UnfixPage(bi->fileDesc, leftNum, TRUE) == PFE_OK &&
+                PF_UnfixPage(bi->fileDesc, rightNum, TRUE) == PFE_OK &&
+                PF_UnfixPage(bi->fileDesc, pageNum, TRUE) == PFE_OK)
+                errVal = AME_OK;
+            break;
+        }
+
+        /* the right half is written before the left half links to it */
+        am_BLFill(bi, buf, level, child0, work, m, sep, rightNum);
+        if (PF_UnfixPage(bi->fileDesc, rightNum, TRUE) != PFE_OK) {
+            PF_UnfixPage(bi->fileDesc, pageNum, TRUE);
+            break;
+        }
+        if (PF_UnfixPage(bi->fileDesc, pageNum, TRUE) != PFE_OK)
+            break;
+
+        /* then the parent gets (separator, right half) */
+        bcopy((char *) &rightNum, sep + bi->attrLength + AM_si, AM_si);
+        bcopy(sep, up, bi->attrLength + 2 * AM_si);
+        ent = up;
+        level++;
+    }
+    free(work);
+    return errVal;
+}
+
+/* create an empty B-link index "<fileName>.<indexNo>"
+ *
+ * Returns AME_OK, or AME_PF on failure.
+ */
+int AM_BLinkCreate(fileName, indexNo)
+char *fileName;
+int indexNo;
+{
+    char indexfName[AM_MAX_FNAME_LENGTH];
+    char *buf;
+    int fd, pageNum, errVal;
+
+    sprintf(indexfName, "%s.%d", fileName, indexNo);
+    if (PF_CreateFile(indexfName) != PFE_OK)
+        return AME_PF;
+    if ((fd = PF_OpenFile(indexfName, PF_REPLACE_LRU)) < 0)
+        return AME_PF;
+
+    /* the root: an empty leaf */
+    errVal = PF_AllocPage(fd, &pageNum, &buf);
+    if (errVal == PFE_OK) {
+        memset(buf, 0, PF_PAGE_SIZE);
+        ((struct am_BLHeader *) buf)->pageType = 'l';
+        ((struct am_BLHeader *) buf)->rightPage = AM_NULL_PAGE;
+        errVal = PF_UnfixPage(fd, pageNum, TRUE);
+    }
+    if (PF_CloseFile(fd) != PFE_OK || errVal != PFE_OK)
+        return AME_PF;
+    return AME_OK;
+}
+
+/* open B-link index "<fileName>.<indexNo>" of keys "attrType" and
+ * "attrLength" into "bi"; one handle serves all threads
+ *
+ * Returns AME_OK, AME_INVALIDATTRTYPE, AME_INVALIDATTRLENGTH or AME_PF.
+ */
+int AM_BLinkOpen(fileName, indexNo, attrType, attrLength, bi)
+char *fileName;
+int indexNo;
+char attrType;
+int attrLength;
+AM_BLINK *bi;
+{
+    char indexfName[AM_MAX_FNAME_LENGTH];
+
+    if ((attrType != 'c') && (attrType != 'f') && (attrType != 'i'))
+        return AME_INVALIDATTRTYPE;
+    if ((attrLength < 1) || (attrLength > 255) ||
+        (attrType != 'c' && attrLength != 4))
+        return AME_INVALIDATTRLENGTH;
+
+    sprintf(indexfName, "%s.%d", fileName, indexNo);
+    if ((bi->fileDesc = PF_OpenFile(indexfName, PF_REPLACE_LRU)) < 0)
+        return AME_PF;
+    bi->attrType = attrType;
+    bi->attrLength = attrLength;
+    return AME_OK;
+}
+
+/* insert (key, recId); safe to call from many threads at once
+ *
+ * Returns AME_OK, or AME_PF or AME_INTERROR on failure.
+ */
+int AM_BLinkInsert(bi, key, recId)
+AM_BLINK *bi;
+char *key;
+int recId;
+{
+    char ent[AM_MAXATTRLENGTH + sizeof(int)];
+    int stack[AM_BL_MAXDEPTH];
+    int depth, pageNum, errVal;
+    char *buf;
+
+    bcopy(key, ent, bi->attrLength);
+    bcopy((char *) &recId, ent + bi->attrLength, AM_si);
+
+    /* find the path down to the leaf, then insert from the leaf up */
+    errVal = am_BLDescend(bi, ent, recId, 0, stack, &depth, &pageNum, &buf);
+    if (errVal != AME_OK)
+        return errVal;
+    PF_UnfixPage(bi->fileDesc, pageNum, FALSE);
+    if (depth < AM_BL_MAXDEPTH)
+        stack[depth++] = pageNum;
+    return am_BLInsertAt(bi, 0, ent, stack, depth);
+}
+
+/* find the entries of "key": up to "maxIds" of their recids go into
+ * "recIds", in increasing order; safe to call from many threads at once
+ *
+ * Returns the number of entries found, or AME_PF on failure.
+ */
+int AM_BLinkLookup(bi, key, recIds, maxIds)
+AM_BLINK *bi;
+char *key;
+int *recIds;
+int maxIds;
+{
+    struct am_BLHeader h;
+    int stack[AM_BL_MAXDEPTH];
+    int depth, pageNum, errVal, i, found = 0, next;
+    char *buf, *e;
+
+    errVal = am_BLDescend(bi, key, INT_MIN, 0, stack, &depth, &pageNum, &buf);
+    if (errVal != AME_OK)
+        return errVal;
+    for (;;) {
+        bcopy(buf, (char *) &h, AM_BL_HDR);
+        for (i = am_BLLowerBound(bi, buf, key, INT_MIN); i < h.numKeys; i++) {
+            e = buf + AM_BL_ENT(bi, 0, i);
+            if (AM_Compare(e, bi->attrType, bi->attrLength, key) != 0)
+                break;
+            if (found < maxIds)
+                bcopy(e + bi->attrLength, (char *) &recIds[found], AM_si);
+            found++;
+        }
+
+        /* the key may go on in the right sibling if its high key is equal */
+        next = (i == h.numKeys && h.hasHigh &&
+                AM_Compare(buf + AM_BL_HIGH(bi), bi->attrType, bi->attrLength, key) == 0)
+               ? h.rightPage : AM_NULL_PAGE;
+        PF_UnfixPage(bi->fileDesc, pageNum, FALSE);
+        if (next == AM_NULL_PAGE)
+            return found;
+        pageNum = next;
+        if ((errVal = am_BLFix(bi, pageNum, &buf)) != AME_OK)
+            return errVal;
+    }
+}
+
+/* close a B-link index; no thread may be using it
+ *
+ * Returns AME_OK, or AME_PF on failure.
+ */
+int AM_BLinkClose(bi)
+AM_BLINK *bi;
+{
+    int errVal;
+
+    errVal = PF_CloseFile(bi->fileDesc);
+    bi->fileDesc = -1;
+    return (errVal == PFE_OK) ? AME_OK : AME_PF;
+}
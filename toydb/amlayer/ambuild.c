@@ -1,8 +1,12 @@
 /* ambuild.c
  *
- * Two index-construction helpers:
+ * Three index-construction helpers:
  *  - AM_BuildIndexIncremental : scan data file and AM_InsertEntry for each record
- *  - AM_BuildIndexFromExistingFile : read all keys, sort, then insert in sorted order
+ *  - AM_BuildIndexFromExistingFile : read all keys, sort them (radix sort
+ *    for int keys, else in parallel; amsort.c), then insert in sorted order
+ *  - AM_BulkLoadFromFileSorted : sort (key, recid) pairs, then bulk load the
+ *    tree bottom-up (ambulk.c); int keys are radix sorted in memory, other
+ *    keys (or too many int keys) go through the external sort (rmsort.c)
  *
  * Data file: semicolon-separated fields, key = 2nd field (roll number)
  */
@@ -15,13 +19,19 @@
 #include "am.h"
 #include "../pflayer/pftypes.h"
 #include "../pflayer/pf.h"
+#include "../pflayer/rm.h"
 #include "amstats.h"
 
 /* ---------------------------------------------------------
-   GLOBALS
+   CONSTANTS
    --------------------------------------------------------- */
 
-static int *g_keys = NULL;   /* used by qsort comparator */
+/* memory for (key, recid) pairs during the bulk load sort */
+#define AM_SORT_MEMORY (64 * 1024)
+
+/* int keys of a bulk load are radix sorted in memory up to this many
+   pairs; past it they are handed to the external sort */
+#define AM_RADIX_MAXPAIRS (1024 * 1024)
 
 
 /* ---------------------------------------------------------
@@ -35,8 +45,9 @@ static int parse_roll_from_line(const char *line, int *out_roll)
     char buf[256];
     int field = 0;
     int bi = 0;
+    int i;
 
-    for (int i = 0; line[i] != '\0'; i++)
+    for (i = 0; line[i] != '\0'; i++)
     {
         if (line[i] == ';')
         {
@@ -64,6 +75,35 @@ static int parse_roll_from_line(const char *line, int *out_roll)
 }
 
 
+/* Extract the key of attrType from the second field into key[attrLength] */
+static int parse_key_from_line(const char *line, char attrType, int attrLength, char *key)
+{
+    const char *f;
+    int n;
+
+    if (attrType == 'i') {
+        int roll;
+        if (parse_roll_from_line(line, &roll) != 0) return -1;
+        bcopy((char *)&roll, key, sizeof(int));
+        return 0;
+    }
+
+    f = strchr(line, ';');
+    if (f == NULL) return -1;
+    f++;
+    n = strcspn(f, ";\r\n");
+    if (n == 0) return -1;
+
+    if (attrType == 'f') {
+        float val = (float) atof(f);
+        bcopy((char *)&val, key, sizeof(float));
+    } else {
+        memset(key, 0, attrLength);
+        memcpy(key, f, n < attrLength ? n : attrLength);
+    }
+    return 0;
+}
+
 /* timeval difference in milliseconds */
 static double timediff_ms(struct timeval *a, struct timeval *b)
 {
@@ -71,15 +111,23 @@ static double timediff_ms(struct timeval *a, struct timeval *b)
            (double)(a->tv_usec - b->tv_usec) / 1000.0;
 }
 
-/* qsort comparator: compares keys[ order[i] ] */
-static int cmp_order(const void *pa, const void *pb)
-{
-    int ia = *(const int *)pa;
-    int ib = *(const int *)pb;
+/* key type of the (key, recid) pairs being sorted, for cmp_pair */
+struct pair_type {
+    char attrType;
+    int attrLength;
+};
 
-    if (g_keys[ia] < g_keys[ib]) return -1;
-    if (g_keys[ia] > g_keys[ib]) return 1;
-    return 0;
+/* RM_Sort comparator: (key, recid) pairs by key, then recid */
+static int cmp_pair(char *pa, int alen, char *pb, int blen, char *arg)
+{
+    struct pair_type *pt = (struct pair_type *) arg;
+    int c, ra, rb;
+
+    c = AM_Compare(pb, pt->attrType, pt->attrLength, pa);
+    if (c != 0) return c;
+    bcopy(pa + pt->attrLength, (char *)&ra, sizeof(int));
+    bcopy(pb + pt->attrLength, (char *)&rb, sizeof(int));
+    return (ra < rb) ? -1 : (ra > rb);
 }
 
 /* ---------------------------------------------------------
@@ -109,7 +157,7 @@ int indexNo;
     {
         char idxfname[256];
         sprintf(idxfname, "%s.%d", indexFileName, indexNo);
-        fdIndex = PF_OpenFile(idxfname);
+        fdIndex = PF_OpenFile(idxfname, PF_REPLACE_LRU);
         if (fdIndex < 0) {
             return AME_PF;
         }
@@ -139,6 +187,7 @@ int indexNo;
 
     gettimeofday(&t2, NULL);
     fclose(f);
+    PF_CloseFile(fdIndex);
 
     /* 5. record stats */
     AMstats.time_ms = timediff_ms(&t2, &t1);
@@ -168,13 +217,11 @@ int indexNo;
     char line[2048];
     int err;
     int fdIndex = -1;
-    int *keys = NULL;
-    int *recids = NULL;
-    int *order = NULL;
+    AM_PAIR *pairs = NULL;
     int count = 0;
     int capacity = 4096;
     int recid = 0;
-    struct timeval t1, t2;
+    struct timeval t0, t1, t2;
     int i;
 
     /* 1. Create index file */
@@ -185,28 +232,26 @@ int indexNo;
     {
         char idxfname[256];
         sprintf(idxfname, "%s.%d", indexFileName, indexNo);
-        fdIndex = PF_OpenFile(idxfname);
+        fdIndex = PF_OpenFile(idxfname, PF_REPLACE_LRU);
         if (fdIndex < 0) return AME_PF;
     }
 
-    /* allocate arrays */
-    keys   = (int *) malloc(sizeof(int) * capacity);
-    recids = (int *) malloc(sizeof(int) * capacity);
-    if (!keys || !recids) {
-        if (keys) free(keys);
-        if (recids) free(recids);
+    /* allocate (key, recid) pairs, kept side by side */
+    pairs = (AM_PAIR *) malloc(sizeof(AM_PAIR) * capacity);
+    if (!pairs) {
+        PF_CloseFile(fdIndex);
         return AME_PF;
     }
 
     /* 3. Open data file */
     f = fopen(dataFileName, "r");
     if (!f) {
-        free(keys);
-        free(recids);
+        free(pairs);
+        PF_CloseFile(fdIndex);
         return AME_PF;
     }
 
-    /* 4. Read + collect keys */
+    /* 4. Read + collect pairs */
     while (fgets(line, sizeof(line), f) != NULL) {
         int key;
 
@@ -214,53 +259,52 @@ int indexNo;
             continue;
 
         if (count >= capacity) {
+            AM_PAIR *p;
             capacity *= 2;
-            keys   = (int *) realloc(keys,   sizeof(int) * capacity);
-            recids = (int *) realloc(recids, sizeof(int) * capacity);
-            if (!keys || !recids) {
+            p = (AM_PAIR *) realloc(pairs, sizeof(AM_PAIR) * capacity);
+            if (!p) {
                 fclose(f);
-                free(keys);
-                free(recids);
+                free(pairs);
+                PF_CloseFile(fdIndex);
                 return AME_PF;
             }
+            pairs = p;
         }
 
-        keys[count] = key;
-        recids[count] = recid;
+        pairs[count].key = key;
+        pairs[count].recId = recid;
         recid++;
         count++;
     }
     fclose(f);
 
-    /* 5. create index-order array */
-    order = (int *) malloc(sizeof(int) * count);
-    if (!order) {
-        free(keys);
-        free(recids);
-        return AME_PF;
+    /* 5. sort the pairs: int keys by radix, others in parallel */
+    gettimeofday(&t0, NULL);
+    if (attrType == 'i')
+        err = AM_RadixSortPairs(pairs, count);
+    else
+        err = AM_SortPairs(pairs, count, 0);
+    if (err != AME_OK) {
+        free(pairs);
+        PF_CloseFile(fdIndex);
+        return err;
     }
 
-    for (i = 0; i < count; i++)
-        order[i] = i;
-
-    /* 6. sort order[] using global comparator */
-    g_keys = keys;
-    qsort(order, count, sizeof(int), cmp_order);
-
-    /* 7. Insert sorted keys */
+    /* 6. Insert sorted keys */
     PFbufStatsInit();
     gettimeofday(&t1, NULL);
 
     for (i = 0; i < count; i++) {
-        int idx = order[i];
         err = AM_InsertEntry(fdIndex, attrType, attrLength,
-                             (char *)&keys[idx], recids[idx]);
+                             (char *)&pairs[i].key, pairs[i].recId);
         /* ignore error, continue */
     }
 
     gettimeofday(&t2, NULL);
+    PF_CloseFile(fdIndex);
 
     /* record stats */
+    AMstats.sort_ms = timediff_ms(&t1, &t0);
     AMstats.time_ms = timediff_ms(&t2, &t1);
     AMstats.logicalReads   = PF_logicalReads;
     AMstats.logicalWrites  = PF_logicalWrites;
@@ -268,17 +312,146 @@ int indexNo;
     AMstats.physicalWrites = PF_physicalWrites;
     AMstats.pagesAccessed  = PF_physicalReads + PF_physicalWrites;
 
-    free(keys);
-    free(recids);
-    free(order);
+    free(pairs);
 
     return AME_OK;
 }
 
-int AM_BulkLoadFromFileSorted(char *dataFileName, int dataFd,
-                              char attrType, int attrLength,
-                              char *indexFileName, int indexNo)
+/* ---------------------------------------------------------
+   METHOD 3: Bulk Load (sort pairs → build bottom-up)
+   --------------------------------------------------------- */
+
+int AM_BulkLoadFromFileSorted(dataFileName, dataFd, attrType, attrLength, indexFileName, indexNo,
+                              leafFill, intFill)
+char *dataFileName;
+int dataFd;  /* ignored */
+char attrType;
+int attrLength;
+char *indexFileName;
+int indexNo;
+int leafFill;   /* fill factors (percent), as for AM_BulkBegin() */
+int intFill;
 {
-    /* Not implemented in this project, just prevent linker error */
-    return AME_OK;
-}
\ No newline at end of file
+    FILE *f;
+    char line[2048];
+    char pair[AM_MAXATTRLENGTH + sizeof(int)];
+    int err = PFE_OK;
+    AM_BULKLOAD bl;
+    RM_SortHandle sort;
+    struct pair_type pt;
+    int pairSize = attrLength + sizeof(int);
+    int recid = 0;
+    char *p;
+    int len;
+    AM_PAIR *pairs = NULL, *np;
+    int count = 0, capacity = 0, i;
+    int sorting = 0;    /* pairs go to the external sort */
+    struct timeval t1, tr, t2, t3;
+
+    if ((attrType != 'c') && (attrType != 'f') && (attrType != 'i'))
+        return AME_INVALIDATTRTYPE;
+    if ((attrLength < 1) || (attrLength > 255) ||
+        (attrType != 'c' && attrLength != sizeof(int)))
+        return AME_INVALIDATTRLENGTH;
+
+    f = fopen(dataFileName, "r");
+    if (!f) return AME_PF;
+
+    AM_ResetStats();
+    gettimeofday(&t1, NULL);
+
+    /* 1. Read the pairs: int keys into memory, the rest into the
+       external sort, which spills sorted runs as memory fills */
+    pt.attrType = attrType;
+    pt.attrLength = attrLength;
+    while (err == PFE_OK && fgets(line, sizeof(line), f) != NULL) {
+        if (parse_key_from_line(line, attrType, attrLength, pair) != 0)
+            continue;
+        bcopy((char *)&recid, pair + attrLength, sizeof(int));
+        recid++;
+
+        if (!sorting && (attrType != 'i' || count == AM_RADIX_MAXPAIRS)) {
+            /* an int pair is laid out as an AM_PAIR */
+            err = RM_SortOpen(&sort, pairSize, AM_SORT_MEMORY, cmp_pair, (char *) &pt);
+            sorting = (err == PFE_OK);
+            for (i = 0; err == PFE_OK && i < count; i++)
+                err = RM_SortPut(&sort, (char *) &pairs[i], pairSize);
+            free(pairs);
+            pairs = NULL;
+            count = 0;
+        }
+        if (sorting) {
+            if (err == PFE_OK)
+                err = RM_SortPut(&sort, pair, pairSize);
+            continue;
+        }
+        if (err == PFE_OK && count == capacity) {
+            capacity = capacity ? 2 * capacity : 4096;
+            np = (AM_PAIR *) realloc(pairs, capacity * sizeof(AM_PAIR));
+            if (np == NULL)
+                err = PFE_NOMEM;
+            else
+                pairs = np;
+        }
+        if (err == PFE_OK)
+            bcopy(pair, (char *) &pairs[count++], sizeof(AM_PAIR));
+    }
+    fclose(f);
+    gettimeofday(&tr, NULL);
+
+    /* 2. Finish the sort: radix sort the pairs in memory, or the runs
+       merged down to one pass, merged as they are streamed */
+    if (err == PFE_OK && sorting)
+        err = RM_SortDone(&sort);
+    else if (err == PFE_OK && AM_RadixSortPairs(pairs, count) != AME_OK)
+        err = PFE_NOMEM;
+    gettimeofday(&t2, NULL);
+
+    /* 3. Stream the sorted pairs into the tree */
+    if (err == PFE_OK) {
+        int serr = PFE_OK;
+
+        err = AM_BulkBegin(indexFileName, indexNo, attrType, attrLength,
+                           leafFill, intFill, &bl);
+        if (sorting) {
+            while (err == AME_OK &&
+                   (serr = RM_SortNext(&sort, &p, &len)) == PFE_OK) {
+                bcopy(p + attrLength, (char *)&recid, sizeof(int));
+                err = AM_BulkAdd(&bl, p, recid);
+            }
+        } else {
+            for (i = 0; err == AME_OK && i < count; i++)
+                err = AM_BulkAdd(&bl, (char *) &pairs[i].key, pairs[i].recId);
+            serr = PFE_EOF;
+        }
+        /* AM_BulkBegin() and AM_BulkAdd() give up the load on errors */
+        if (err == AME_OK) {
+            err = AM_BulkEnd(&bl);
+            if (serr != PFE_EOF)
+                err = AME_PF;
+        }
+    } else
+        err = AME_PF;
+
+    gettimeofday(&t3, NULL);
+
+    /* 4. record stats: the whole pass, with reading and sorting apart;
+       the external sort sorts runs while the pairs are read */
+    if (sorting) {
+        AMstats.sortRuns = sort.runsWritten;
+        AMstats.sortPages = sort.pagesWritten;
+        RM_SortClose(&sort);
+    }
+    free(pairs);
+    AM_CaptureStats(timediff_ms(&t3, &t1));
+    if (sorting) {
+        AMstats.read_ms = -1.0;
+        AMstats.sort_ms = timediff_ms(&t2, &t1);
+    } else {
+        AMstats.read_ms = timediff_ms(&tr, &t1);
+        AMstats.sort_ms = timediff_ms(&t2, &tr);
+    }
+    AMstats.pagesAccessed  = PF_physicalReads + PF_physicalWrites;
+
+    return err;
+}
@@ -1,28 +1,39 @@
 /* ambulk.c
  *
- * Bulk-loading B+ tree pages from a sorted list of keys.
+ * Bulk-loading B+ tree pages from a sorted stream of keys.
  * K&R-style C to match existing project.
  *
  * Exports:
+ *   AM_BulkBegin(), AM_BulkAdd(), AM_BulkEnd()
  *   AM_BulkLoadFromSortedPairs(...)
  *
  * Notes:
- *   - The function creates an index file called "<fileName>.<indexNo>"
- *   - It reserves page 0 as the root placeholder (so PF_GetFirstPage
- *     returns the root page as required by the AM layer).
- *   - It creates leaf pages, fills keys and recid lists, then builds
- *     internal levels until a single root exists; the final root is
- *     written to reserved page 0.
+ *   - AM_BulkBegin() creates an index file called "<fileName>.<indexNo>"
+ *   - It reserves page 0 for the root (so PF_GetFirstPage returns the
+ *     root page as required by the AM layer) and keeps it fixed.
+ *   - AM_BulkAdd() appends one (key, recId) pair to the last leaf,
+ *     starting a new leaf when it is full; a key equal to the previous
+ *     one goes on the same key's recid list.
+ *   - AM_BulkEnd() builds internal levels until a single root exists;
+ *     the root is written to reserved page 0.
+ *   - Leaves and internal nodes are filled to their own fill factors,
+ *     percentages of the space a page has for entries; below 100 they
+ *     leave room for later inserts before pages split. A leaf is closed
+ *     at its fill factor only between keys.
+ *   - Pages are assembled in private memory and handed to the PF layer
+ *     once, when complete: PF_AllocPage(), copy, PF_UnfixPage(). The
+ *     file is new, so pages are allocated in order: leaf i goes on page
+ *     i+1, and its next leaf link is known before it is written.
  *
  * Assumptions:
- *   - keys[]: array of pointers to key bytes (each of length attrLength)
- *   - recIds[]: parallel array of ints (AM uses AM_si to store recid)
- *   - keys are already sorted according to AM_Compare semantics
+ *   - keys arrive sorted according to AM_Compare semantics
+ *   - only the leaves' first keys stay in memory
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include "am.h"
 #include "../pflayer/pf.h"
@@ -37,30 +48,6 @@ double now_ms()
     return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
 }
 
-static void write_leaf_page(
-    char *pageBuf, char *attrVal, int attrLength,
-    int recId, short *recListPtr, AM_LEAFHEADER *hdr)
-{
-    int recSize;
-    short tempPtr;
-    short nullptr = 0;
-
-    bcopy(hdr, pageBuf, AM_sl);
-
-    /* compute recId pointer for new rec (grow from page end) */
-    hdr->recIdPtr -= AM_si + AM_ss;
-    tempPtr = hdr->recIdPtr;
-
-    /* add recId */
-    bcopy((char *)&recId, pageBuf + tempPtr, AM_si);
-
-    /* set next pointer = whatever head was for this key */
-    bcopy((char *)&nullptr, pageBuf + tempPtr + AM_si, AM_ss);
-
-    /* store key at key slot (caller handled shifting / placement) */
-    /* ... the caller will fill key bytes at the correct offset. */
-}
-
 /* helper: fill an AM leaf header for a fresh leaf page */
 static void init_leaf_header(AM_LEAFHEADER *h, int attrLength)
 {
@@ -81,26 +68,141 @@ static void init_leaf_header(AM_LEAFHEADER *h, int attrLength)
     }
 }
 
-/* top-level bulk loader
- * keys: array of pointers to key bytes; each key length = attrLength
- * recIds: array of ints (recids); nKeys = number of keys
+/* hand a page assembled in memory to the PF layer; it must land on
+   page "pageNum", the next page of the file */
+static int am_BulkWrite(bl, pageNum, page)
+AM_BULKLOAD *bl;
+int pageNum;
+char *page;
+{
+    int pnum;
+    char *pbuf;
+
+    if (PF_AllocPage(bl->fileDesc, &pnum, &pbuf) != PFE_OK)
+        return AME_PF;
+    bcopy(page, pbuf, PF_PAGE_SIZE);
+    if (PF_UnfixPage(bl->fileDesc, pnum, TRUE) != PFE_OK || pnum != pageNum)
+        return AME_PF;
+    AMstats.pagesAccessed++;
+    return AME_OK;
+}
+
+/* write the last leaf out, linked to "nextPage" */
+static int am_BulkFlushLeaf(bl, nextPage)
+AM_BULKLOAD *bl;
+int nextPage;
+{
+    bl->leafHdr.nextLeafPage = nextPage;
+    bcopy(&bl->leafHdr, bl->leaf, AM_sl);
+    return am_BulkWrite(bl, bl->nLeaves, bl->leaf);
+}
+
+/* start a fresh leaf at the end of the chain of leaves */
+static int am_BulkNewLeaf(bl)
+AM_BULKLOAD *bl;
+{
+    if (bl->nLeaves == bl->maxLeaves) {
+        char *firstKeys;
+
+        bl->maxLeaves = (bl->maxLeaves == 0) ? 64 : 2 * bl->maxLeaves;
+        firstKeys = (char *) realloc(bl->firstKeys, bl->maxLeaves * bl->attrLength);
+        if (firstKeys == NULL) {
+            AM_Errno = AME_INTERROR;
+            return AME_INTERROR;
+        }
+        bl->firstKeys = firstKeys;
+    }
+    init_leaf_header(&bl->leafHdr, bl->attrLength);
+    bl->nLeaves++;
+    return AME_OK;
+}
+
+/* the last key's recids do not fit in the last leaf: move its slot and
+   recid nodes to a fresh leaf, the rest of the leaf being written out,
+   so that one key's recid list is never split across leaves */
+static int am_BulkMoveRun(bl)
+AM_BULKLOAD *bl;
+{
+    AM_LEAFHEADER *hdr = &bl->leafHdr;
+    int attrLength = bl->attrLength;
+    int recSize = attrLength + AM_ss;
+    int from = hdr->recIdPtr, len = bl->runEnd - hdr->recIdPtr;
+    int delta, errVal;
+    short head, next, p;
+    char key[AM_MAXATTRLENGTH];
+
+    /* a run that fills a leaf of its own cannot move anywhere */
+    if (hdr->numKeys == 1)
+        return AME_RECIDLISTFULL;
+
+    /* take the key's slot and nodes off the leaf, and write that out */
+    hdr->numKeys--;
+    hdr->keyPtr -= recSize;
+    hdr->recIdPtr = bl->runEnd;
+    bcopy(bl->leaf + hdr->keyPtr, key, attrLength);
+    bcopy(bl->leaf + hdr->keyPtr + attrLength, (char *)&head, AM_ss);
+    errVal = am_BulkFlushLeaf(bl, bl->nLeaves + 1);
+    if (errVal == AME_OK)
+        errVal = am_BulkNewLeaf(bl);
+    if (errVal != AME_OK)
+        return errVal;
+
+    /* the nodes go to the top of the new leaf; their links shift along */
+    delta = PF_PAGE_SIZE - bl->runEnd;
+    bcopy(bl->leaf + from, bl->leaf + from + delta, len);
+    for (p = from + delta; p < PF_PAGE_SIZE; p += AM_si + AM_ss) {
+        bcopy(bl->leaf + p + AM_si, (char *)&next, AM_ss);
+        if (next != 0) {
+            next += delta;
+            bcopy((char *)&next, bl->leaf + p + AM_si, AM_ss);
+        }
+    }
+    head += delta;
+    hdr->recIdPtr = from + delta;
+    bl->runEnd = PF_PAGE_SIZE;
+
+    bcopy(key, bl->firstKeys + (bl->nLeaves - 1) * attrLength, attrLength);
+    bcopy(key, bl->leaf + hdr->keyPtr, attrLength);
+    bcopy((char *)&head, bl->leaf + hdr->keyPtr + attrLength, AM_ss);
+    hdr->numKeys++;
+    hdr->keyPtr += recSize;
+    return AME_OK;
+}
+
+/* release what AM_BulkBegin() set up; close the file on failure */
+static void am_BulkFree(bl)
+AM_BULKLOAD *bl;
+{
+    free(bl->firstKeys);
+    free(bl->leaf);
+    bl->firstKeys = NULL;
+    bl->leaf = NULL;
+    bl->nLeaves = bl->maxLeaves = 0;
+    if (bl->rootBuf != NULL)
+        PF_UnfixPage(bl->fileDesc, 0, FALSE);
+    bl->rootBuf = NULL;
+    if (bl->fileDesc >= 0)
+        PF_CloseFile(bl->fileDesc);
+    bl->fileDesc = -1;
+}
+
+/* start a bulk load into a new index "<fileName>.<indexNo>"
  *
- * Returns AME_OK on success, AME_PF or other AME_* on failure.
+ * Returns AME_OK on success, AME_INVALIDVALUE for a fill factor out of
+ * range, AME_PF or other AME_* on failure.
  */
-int AM_BulkLoadFromSortedPairs(fileName, indexNo, attrType, attrLength, keys, recIds, nKeys)
+int AM_BulkBegin(fileName, indexNo, attrType, attrLength, leafFill, intFill, bl)
 char *fileName;
 int indexNo;
 char attrType;
 int attrLength;
-char **keys;
-int *recIds;
-int nKeys;
+int leafFill;   /* percent of a leaf to fill, 1..100 */
+int intFill;    /* percent of an internal node to fill, 1..100 */
+AM_BULKLOAD *bl;
 {
     char indexfName[AM_MAX_FNAME_LENGTH];
     int errVal;
-    int fileDesc;
-    int i, j, k;
-    double t0, t1;
+    int rootPageNum;
 
     /* Parameter checks */
     if ((attrType != 'c') && (attrType != 'f') && (attrType != 'i')) {
@@ -111,313 +213,260 @@ int nKeys;
         AM_Errno = AME_INVALIDATTRLENGTH;
         return AME_INVALIDATTRLENGTH;
     }
+    if (leafFill < 1 || leafFill > 100 || intFill < 1 || intFill > 100) {
+        AM_Errno = AME_INVALIDVALUE;
+        return AME_INVALIDVALUE;
+    }
 
-    /* Start measurement & reset PF stats */
-    AM_ResetStats();
-    t0 = now_ms();
+    bl->fileDesc = -1;
+    bl->attrType = attrType;
+    bl->attrLength = attrLength;
+    bl->nKeys = 0;
+    bl->nLeaves = bl->maxLeaves = 0;
+    bl->firstKeys = NULL;
+    bl->rootBuf = NULL;
+    bl->leafSpace = (int) ((long) (PF_PAGE_SIZE - AM_sl) * leafFill / 100);
+    bl->intKeys = (((PF_PAGE_SIZE - AM_sint - AM_si) / (attrLength + AM_si)) & ~1)
+                  * intFill / 100;
+    if (bl->intKeys < 1)
+        bl->intKeys = 1;
+    bl->leaf = malloc(PF_PAGE_SIZE);
+    if (bl->leaf == NULL) {
+        AM_Errno = AME_INTERROR;
+        return AME_INTERROR;
+    }
 
     /* Build index file name */
     sprintf(indexfName, "%s.%d", fileName, indexNo);
 
     /* Create PF file and open it */
     errVal = PF_CreateFile(indexfName);
-    if (errVal != PFE_OK) { AM_Errno = AME_PF; return AME_PF; }
+    if (errVal != PFE_OK) { am_BulkFree(bl); AM_Errno = AME_PF; return AME_PF; }
 
-    fileDesc = PF_OpenFile(indexfName);
-    if (fileDesc < 0) { AM_Errno = AME_PF; return AME_PF; }
+    bl->fileDesc = PF_OpenFile(indexfName, PF_REPLACE_LRU);
+    if (bl->fileDesc < 0) { am_BulkFree(bl); AM_Errno = AME_PF; return AME_PF; }
 
-    /* Reserve page 0 as root placeholder so PF_GetFirstPage returns the root page */
-    {
-        int rootPageNum;
-        char *rootBuf;
-        errVal = PF_AllocPage(fileDesc, &rootPageNum, &rootBuf);
-        if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-        /* Initialize with an empty leaf header as placeholder */
-        {
-            AM_LEAFHEADER tempH;
-            init_leaf_header(&tempH, attrLength);
-            bcopy(&tempH, rootBuf, AM_sl);
+    /* Reserve page 0 for the root, so PF_GetFirstPage returns the root page */
+    errVal = PF_AllocPage(bl->fileDesc, &rootPageNum, &bl->rootBuf);
+    if (errVal != PFE_OK) { bl->rootBuf = NULL; am_BulkFree(bl); AM_Errno = AME_PF; return AME_PF; }
+
+    /* first leaf: even an empty index has one */
+    errVal = am_BulkNewLeaf(bl);
+    if (errVal != AME_OK) { am_BulkFree(bl); return errVal; }
+    return AME_OK;
+}
+
+/* append one (key, recId) pair; keys must not decrease
+ *
+ * Returns AME_OK on success, AME_INVALIDVALUE for a key out of order,
+ * AME_RECIDLISTFULL when one key has more recids than a leaf holds,
+ * AME_PF or other AME_* on failure (the load is abandoned).
+ */
+int AM_BulkAdd(bl, key, recId)
+AM_BULKLOAD *bl;
+char *key;
+int recId;
+{
+    int errVal;
+    int attrLength = bl->attrLength;
+    int recSize = attrLength + AM_ss;
+    AM_LEAFHEADER *hdr = &bl->leafHdr;
+    char *slot;
+    short head = 0;
+    int dup, need;
+
+    if (bl->nKeys > 0 &&
+        AM_Compare(key, bl->attrType, attrLength, bl->lastKey) > 0) {
+        AM_Errno = AME_INVALIDVALUE;
+        return AME_INVALIDVALUE;
+    }
+
+    /* a repeated key adds to the recid list of the last key slot */
+    dup = hdr->numKeys > 0 &&
+          AM_Compare(key, bl->attrType, attrLength, bl->lastKey) == 0;
+    need = dup ? (AM_si + AM_ss) : (recSize + AM_si + AM_ss);
+
+    /* no room, or filled to its fill factor at a new key: write the leaf
+       out, linked to the next one, and start that; a fresh leaf takes any
+       key, and a repeated key that has no room takes its recids along */
+    if ((hdr->recIdPtr - hdr->keyPtr) < need ||
+        (!dup && hdr->numKeys > 0 && (hdr->keyPtr - AM_sl) + (PF_PAGE_SIZE - hdr->recIdPtr)
+                                     + need > bl->leafSpace)) {
+        if (dup)
+            errVal = am_BulkMoveRun(bl);
+        else {
+            errVal = am_BulkFlushLeaf(bl, bl->nLeaves + 1);
+            if (errVal == AME_OK)
+                errVal = am_BulkNewLeaf(bl);
         }
-        errVal = PF_UnfixPage(fileDesc, rootPageNum, TRUE);
-        if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
+        if (errVal == AME_OK && (hdr->recIdPtr - hdr->keyPtr) < need)
+            errVal = AME_RECIDLISTFULL;
+        if (errVal != AME_OK) { am_BulkFree(bl); AM_Errno = errVal; return errVal; }
     }
 
-    /* ---------------------------------------------------------------------
-       Create leaf pages sequentially, filling them greedily until full.
-       We'll store the page numbers and for each leaf the first key to later
-       build internal nodes.
-       --------------------------------------------------------------------- */
+    if (!dup) {
+        /* the first key of a leaf keys it in its parent */
+        if (hdr->numKeys == 0)
+            bcopy(key, bl->firstKeys + (bl->nLeaves - 1) * attrLength, attrLength);
+        /* place key at keyPtr, recid list initially empty */
+        bcopy(key, bl->leaf + hdr->keyPtr, attrLength);
+        bcopy((char *)&head, bl->leaf + hdr->keyPtr + attrLength, AM_ss);
+        hdr->numKeys++;
+        hdr->keyPtr += recSize;
+        bl->runEnd = hdr->recIdPtr;
+    }
+    slot = bl->leaf + AM_sl + (hdr->numKeys - 1) * recSize + attrLength;
 
-    /* arrays of leaf page nums and their first-key buffers */
-    {
-        int maxLeaves = (nKeys / 1) + 10; /* rough upper bound */
-        int *leafPageNums = (int *) malloc(sizeof(int) * maxLeaves);
-        char **leafFirstKeys = (char **) malloc(sizeof(char *) * maxLeaves);
-        int leafCount = 0;
-
-        /* allocate first leaf */
-        {
-            int pnum;
-            char *pbuf;
-            errVal = PF_AllocPage(fileDesc, &pnum, &pbuf);
-            if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-            /* init header */
-            {
-                AM_LEAFHEADER tmp;
-                init_leaf_header(&tmp, attrLength);
-                bcopy(&tmp, pbuf, AM_sl);
+    /* allocate recid node at recIdPtr - AM_si - AM_ss, in front of the list */
+    hdr->recIdPtr -= AM_si + AM_ss;
+    bcopy(slot, (char *)&head, AM_ss);
+    bcopy((char *)&recId, bl->leaf + hdr->recIdPtr, AM_si);
+    bcopy((char *)&head, bl->leaf + hdr->recIdPtr + AM_si, AM_ss);
+    bcopy((char *)&hdr->recIdPtr, slot, AM_ss);
+
+    bcopy(key, bl->lastKey, attrLength);
+    bl->nKeys++;
+    return AME_OK;
+}
+
+/* build the internal levels over the leaves, put the root on page 0
+ * and close the index
+ *
+ * Returns AME_OK on success, AME_PF or other AME_* on failure.
+ */
+int AM_BulkEnd(bl)
+AM_BULKLOAD *bl;
+{
+    int errVal = AME_OK;
+    int attrLength = bl->attrLength;
+    int recSize = attrLength + AM_si;
+    /* an even maxKeys, as AM_CreateIndex() sets it for AM_SplitIntNode() */
+    int maxKeys = ((PF_PAGE_SIZE - AM_sint - AM_si) / recSize) & ~1;
+    char *page = bl->leaf;
+    int levelFirst = 1;                 /* children are on pages levelFirst.. */
+    int levelCount = bl->nLeaves;
+    int nextPage = bl->nLeaves + 1;
+    int parents, j, lo, hi, c, child, off;
+    AM_INTHEADER ih;
+
+    if (levelCount == 1) {
+        /* the only leaf is the root */
+        bl->leafHdr.nextLeafPage = AM_NULL_PAGE;
+        bcopy(&bl->leafHdr, page, AM_sl);
+        bcopy(page, bl->rootBuf, PF_PAGE_SIZE);
+    } else
+        errVal = am_BulkFlushLeaf(bl, AM_NULL_PAGE);
+
+    /* build each level over the one below, spreading the children evenly,
+       at most bl->intKeys + 1 to a node; the first keys of a level are
+       packed over those of the one below */
+    while (errVal == AME_OK && levelCount > 1) {
+        parents = (levelCount + bl->intKeys) / (bl->intKeys + 1);
+        for (j = 0; errVal == AME_OK && j < parents; j++) {
+            lo = (int) ((long) levelCount * j / parents);
+            hi = (int) ((long) levelCount * (j + 1) / parents);
+
+            ih.pageType = 'i';
+            ih.numKeys = hi - lo - 1;
+            ih.attrLength = attrLength;
+            ih.maxKeys = maxKeys;
+            bcopy(&ih, page, AM_sint);
+
+            /* first child pointer, then (key, child) pairs */
+            child = levelFirst + lo;
+            bcopy((char *)&child, page + AM_sint, AM_si);
+            for (c = lo + 1; c < hi; c++) {
+                off = AM_sint + AM_si + (c - lo - 1) * recSize;
+                child = levelFirst + c;
+                bcopy(bl->firstKeys + c * attrLength, page + off, attrLength);
+                bcopy((char *)&child, page + off + attrLength, AM_si);
             }
-            /* record */
-            leafPageNums[leafCount] = pnum;
-            leafFirstKeys[leafCount] = malloc(attrLength);
-            /* set first key later when first record is written */
-            leafCount++;
-            /* unfix after init - will get and write below */
-            errVal = PF_UnfixPage(fileDesc, pnum, TRUE);
-            if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
+            bcopy(bl->firstKeys + lo * attrLength, bl->firstKeys + j * attrLength,
+                  attrLength);
+
+            /* the only node of a level is the root */
+            if (parents == 1)
+                bcopy(page, bl->rootBuf, PF_PAGE_SIZE);
+            else
+                errVal = am_BulkWrite(bl, nextPage + j, page);
         }
-
-        /* Now append keys one by one */
-        {
-            int curLeaf = 0;
-            for (i = 0; i < nKeys; i++) {
-                int pnum = leafPageNums[curLeaf];
-                char *pbuf;
-                AM_LEAFHEADER hdr;
-                int recSize = attrLength + AM_ss;
-                int indexWhereKeyPlaced;
-
-                /* get the current leaf page */
-                errVal = PF_GetThisPage(fileDesc, pnum, &pbuf);
-                if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-                /* count this AM page access */
-                AMstats.pagesAccessed++;
-
-                bcopy(pbuf, &hdr, AM_sl);
-
-                /* if this is the very first key for the leaf set the first-key buffer */
-                if (hdr.numKeys == 0) {
-                    bcopy(keys[i], leafFirstKeys[curLeaf], attrLength);
-                }
-
-                /* compute if there is room to add another key and its recid pointer and recid storage */
-                if ((hdr.recIdPtr - hdr.keyPtr) >= (recSize + AM_si + AM_ss)) {
-                    /* place key at keyPtr */
-                    indexWhereKeyPlaced = hdr.numKeys + 1;
-                    bcopy(keys[i], pbuf + AM_sl + (indexWhereKeyPlaced - 1) * recSize, attrLength);
-                    /* place recId list head (initially 0) */
-                    {
-                        short zero = 0;
-                        bcopy((char *)&zero, pbuf + AM_sl + (indexWhereKeyPlaced - 1) * recSize + attrLength, AM_ss);
-                    }
-                    /* allocate recid node at recIdPtr - AM_si - AM_ss */
-                    hdr.recIdPtr -= AM_si + AM_ss;
-                    bcopy((char *)&recIds[i], pbuf + hdr.recIdPtr, AM_si);
-                    /* next pointer after recid = 0 */
-                    {
-                        short zero = 0;
-                        bcopy((char *)&zero, pbuf + hdr.recIdPtr + AM_si, AM_ss);
-                    }
-                    /* set head pointer in key slot to this recid offset */
-                    bcopy((char *)&hdr.recIdPtr, pbuf + AM_sl + (indexWhereKeyPlaced - 1) * recSize + attrLength, AM_ss);
-
-                    hdr.numKeys++;
-                    hdr.keyPtr += recSize;
-
-                    /* write header back */
-                    bcopy(&hdr, pbuf, AM_sl);
-
-                    /* done with this page */
-                    errVal = PF_UnfixPage(fileDesc, pnum, TRUE);
-                    if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-                } else {
-                    /* no room: allocate new leaf page and append there */
-                    errVal = PF_UnfixPage(fileDesc, pnum, TRUE);
-                    if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-
-                    /* allocate a new leaf */
-                    {
-                        int newp;
-                        char *newbuf;
-                        errVal = PF_AllocPage(fileDesc, &newp, &newbuf);
-                        if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-                        AM_LEAFHEADER tmp;
-                        init_leaf_header(&tmp, attrLength);
-                        bcopy(&tmp, newbuf, AM_sl);
-                        errVal = PF_UnfixPage(fileDesc, newp, TRUE);
-                        if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-
-                        /* link previous leaf nextLeafPage to newp */
-                        {
-                            char *oldbuf;
-                            int oldp = leafPageNums[curLeaf];
-                            errVal = PF_GetThisPage(fileDesc, oldp, &oldbuf);
-                            if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-                            /* count this access */
-                            AMstats.pagesAccessed++;
-
-                            AM_LEAFHEADER oldhdr;
-                            bcopy(oldbuf, &oldhdr, AM_sl);
-                            oldhdr.nextLeafPage = newp;
-                            bcopy(&oldhdr, oldbuf, AM_sl);
-                            errVal = PF_UnfixPage(fileDesc, oldp, TRUE);
-                            if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-                        }
-
-                        leafPageNums[++curLeaf] = newp;
-                        leafFirstKeys[curLeaf] = malloc(attrLength);
-                        /* write the i-th key into this new leaf in next iteration
-                           (decrement i so outer loop retries this key on the new leaf) */
-                        i--; /* reprocess same key with new leaf */
-                    }
-                }
-            } /* for each key */
-            leafCount = curLeaf + 1;
+        if (parents > 1) {
+            levelFirst = nextPage;
+            nextPage += parents;
         }
+        levelCount = parents;
+    }
+    if (errVal != AME_OK) {
+        am_BulkFree(bl);
+        AM_Errno = errVal;
+        return errVal;
+    }
 
-        /* Build internal levels (unchanged logical behavior) */
-        {
-            int levelChildCount = leafCount;
-            int *childPageNums = (int *) malloc(sizeof(int) * levelChildCount);
-            char **childFirstKeys = (char **) malloc(sizeof(char *) * levelChildCount);
-            int curLevel = 0;
-            for (i = 0; i < levelChildCount; i++) {
-                childPageNums[i] = leafPageNums[i];
-                childFirstKeys[i] = leafFirstKeys[i];
-            }
+    /* write the root out with page 0 */
+    errVal = PF_UnfixPage(bl->fileDesc, 0, TRUE);
+    bl->rootBuf = NULL;
+    AMstats.pagesAccessed++;
 
-            /* iteratively build parents until only one remains */
-            while (levelChildCount > 1) {
-                int parentCountEstimate = (levelChildCount / (PF_PAGE_SIZE / (attrLength + AM_si))) + 10;
-                int *parentPageNums = (int *) malloc(sizeof(int) * parentCountEstimate);
-                char **parentFirstKeys = (char **) malloc(sizeof(char *) * parentCountEstimate);
-                int parentCount = 0;
-
-                i = 0;
-                while (i < levelChildCount) {
-                    /* allocate internal node page */
-                    int ipnum;
-                    char *ibuf;
-                    errVal = PF_AllocPage(fileDesc, &ipnum, &ibuf);
-                    if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-
-                    /* prepare header for internal node */
-                    {
-                        AM_INTHEADER ihead;
-                        ihead.pageType = 'i';
-                        ihead.numKeys = 0; /* set later */
-                        ihead.attrLength = attrLength;
-                        ihead.maxKeys = (PF_PAGE_SIZE - AM_sint - AM_si)/(AM_si + attrLength);
-                        bcopy(&ihead, ibuf, AM_sint);
-                    }
-
-                    /* fill child pointers and keys into page */
-                    {
-                        AM_INTHEADER ih;
-                        bcopy(ibuf, &ih, AM_sint);
-                        int recSize = ih.attrLength + AM_si;
-                        int offset = AM_sint;
-                        int childIdx = 0;
-                        /* put first child pointer (page number) */
-                        bcopy((char *)&childPageNums[i], ibuf + AM_sint + 0, AM_si);
-                        childIdx++;
-
-                        /* now add as many child keys as can fit */
-                        while ((i < levelChildCount) && ((AM_sint + (ih.numKeys + 1) * recSize + AM_si) <= PF_PAGE_SIZE)) {
-                            if (ih.numKeys == 0) {
-                                if ((i+1) < levelChildCount) {
-                                    bcopy(childFirstKeys[i+1],
-                                          ibuf + AM_sint + AM_si + ih.numKeys * recSize,
-                                          attrLength);
-                                    bcopy((char *)&childPageNums[i+1],
-                                          ibuf + AM_sint + AM_si + ih.numKeys * recSize + attrLength,
-                                          AM_si);
-                                    ih.numKeys++;
-                                    i++;
-                                } else {
-                                    break;
-                                }
-                            } else {
-                                if ((i+1) < levelChildCount) {
-                                    bcopy(childFirstKeys[i+1],
-                                          ibuf + AM_sint + AM_si + ih.numKeys * recSize,
-                                          attrLength);
-                                    bcopy((char *)&childPageNums[i+1],
-                                          ibuf + AM_sint + AM_si + ih.numKeys * recSize + attrLength,
-                                          AM_si);
-                                    ih.numKeys++;
-                                    i++;
-                                } else break;
-                            }
-                        } /* while fit */
-                        /* write header back */
-                        bcopy(&ih, ibuf, AM_sint);
-                    }
-
-                    /* done with this internal page */
-                    errVal = PF_UnfixPage(fileDesc, ipnum, TRUE);
-                    if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-
-                    /* add to parent array */
-                    parentPageNums[parentCount] = ipnum;
-                    parentFirstKeys[parentCount] = (char *) malloc(attrLength);
-                    /* copy the first key for this internal node (which is the first key of its first child) */
-                    bcopy(childFirstKeys[0], parentFirstKeys[parentCount], attrLength);
-                    parentCount++;
-                } /* while i < levelChildCount */
-
-                /* move up one level */
-                free(childPageNums);
-                free(childFirstKeys);
-
-                childPageNums = parentPageNums;
-                childFirstKeys = parentFirstKeys;
-                levelChildCount = parentCount;
-            } /* while levelChildCount > 1 */
-
-            /* Copy final root into reserved page 0 */
-            {
-                int builtRootPage = childPageNums[0];
-                char *builtBuf;
-                char *rootBuf;
-                int reservedRoot = 0; /* reserved earlier as page 0 */
-
-                errVal = PF_GetThisPage(fileDesc, builtRootPage, &builtBuf);
-                if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-                AMstats.pagesAccessed++;
-
-                errVal = PF_GetThisPage(fileDesc, reservedRoot, &rootBuf);
-                if (errVal != PFE_OK) { PF_UnfixPage(fileDesc, builtRootPage, FALSE); PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-                AMstats.pagesAccessed++;
-
-                /* copy content */
-                bcopy(builtBuf, rootBuf, PF_PAGE_SIZE);
-
-                /* mark root dirty and unfix both pages */
-                errVal = PF_UnfixPage(fileDesc, reservedRoot, TRUE);
-                if (errVal != PFE_OK) { PF_UnfixPage(fileDesc, builtRootPage, FALSE); PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-                errVal = PF_UnfixPage(fileDesc, builtRootPage, FALSE);
-                if (errVal != PFE_OK) { PF_CloseFile(fileDesc); AM_Errno = AME_PF; return AME_PF; }
-            }
+    /* later inserts split the root at page 0 */
+    AM_RootPageNum = 0;
 
-            /* free child arrays containers */
-            free(childPageNums);
-            free(childFirstKeys);
-        }
+    /* Close the index file */
+    if (errVal == PFE_OK)
+        errVal = PF_CloseFile(bl->fileDesc);
+    else
+        PF_CloseFile(bl->fileDesc);
+    bl->fileDesc = -1;
+    am_BulkFree(bl);
+    if (errVal != PFE_OK) { AM_Errno = AME_PF; return AME_PF; }
 
-        /* free leaf arrays */
-        for (i = 0; i < leafCount; i++) free(leafFirstKeys[i]);
-        free(leafFirstKeys);
-        free(leafPageNums);
-    }
+    AM_Errno = AME_OK;
+    return AME_OK;
+}
 
-    /* Close the index file */
-    PF_CloseFile(fileDesc);
+/* top-level bulk loader
+ * keys: array of pointers to key bytes; each key length = attrLength
+ * recIds: array of ints (recids); nKeys = number of keys
+ * leafFill, intFill: fill factors of leaves and internal nodes, as for
+ * AM_BulkBegin()
+ *
+ * Returns AME_OK on success, AME_PF or other AME_* on failure.
+ */
+int AM_BulkLoadFromSortedPairs(fileName, indexNo, attrType, attrLength, keys, recIds, nKeys,
+                               leafFill, intFill)
+char *fileName;
+int indexNo;
+char attrType;
+int attrLength;
+char **keys;
+int *recIds;
+int nKeys;
+int leafFill;
+int intFill;
+{
+    AM_BULKLOAD bl;
+    int errVal;
+    int i;
+    double t0, t1;
+
+    /* Start measurement & reset PF stats */
+    AM_ResetStats();
+    t0 = now_ms();
+
+    errVal = AM_BulkBegin(fileName, indexNo, attrType, attrLength, leafFill, intFill, &bl);
+    if (errVal != AME_OK)
+        return errVal;
+    for (i = 0; i < nKeys; i++) {
+        errVal = AM_BulkAdd(&bl, keys[i], recIds[i]);
+        if (errVal != AME_OK)
+            return errVal;
+    }
+    errVal = AM_BulkEnd(&bl);
+    if (errVal != AME_OK)
+        return errVal;
 
     /* Stop measurement & capture stats */
     t1 = now_ms();
     AM_CaptureStats(t1 - t0);
 
-    AM_Errno = AME_OK;
     return AME_OK;
 }
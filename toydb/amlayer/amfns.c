@@ -50,7 +50,7 @@ int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
 	AM_Check;
 
 	/* open the new file */
-	fileDesc = PF_OpenFile(indexfName);
+	fileDesc = PF_OpenFile(indexfName, PF_REPLACE_LRU);
 	if (fileDesc < 0) 
 	  {
 	   AM_Errno = AME_PF;
@@ -366,7 +366,8 @@ static char *AMerrormsg[] = {
 "Scan Table is full",
 "Invalid Attribute Type",
 "Invalid file Descriptor",
-"Invalid value to Delete or Insert Entry"
+"Invalid value to Delete or Insert Entry",
+"Too many recids of one key for a leaf"
 };
 
 
@@ -95,6 +95,8 @@ if (value == NULL)
   
 /* search for the pagenumber and index of value */
 status = AM_Search(fileDesc,attrType,attrLength,value,&pageNum,&pageBuf,&index);
+/* the path AM_Search() stacked is only wanted by inserts and deletes */
+AM_EmptyStack();
 searchpageNum = pageNum;
 /* check for errors */
 if (status < 0) 
@@ -113,12 +115,12 @@ key */
 if (index > header->numKeys) 
   if (header->nextLeafPage != AM_NULL_PAGE)
   {
-  errVal = PF_GetThisPage(fileDesc,header->nextLeafPage,&pageBuf);
+  pageNum = header->nextLeafPage;
+  errVal = PF_GetThisPage(fileDesc,pageNum,&pageBuf);
   AM_Check;
   bcopy(pageBuf,header,AM_sl);
-  errVal = PF_UnfixPage(fileDesc,header->nextLeafPage,FALSE);
+  errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
   AM_Check;
-  pageNum = header->nextLeafPage;
   index = 1;
   }
   else 
@@ -494,10 +496,19 @@ int errVal;
 
 errVal = PF_GetFirstPage(fileDesc,&pageNum,&pageBuf);
 AM_Check;
-if (*pageBuf == 'l')
-  AM_LeftPageNum = pageNum;
-else
-  AM_LeftPageNum = 2;
+/* follow the first child pointers down to the leftmost leaf; a tree
+   grown by splits has it on page 2, a bulk-loaded one elsewhere */
+while (*pageBuf != 'l')
+  {
+  int child;
+  bcopy(pageBuf + AM_sint,(char *)&child,AM_si);
+  errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
+  AM_Check;
+  pageNum = child;
+  errVal = PF_GetThisPage(fileDesc,pageNum,&pageBuf);
+  AM_Check;
+  }
+AM_LeftPageNum = pageNum;
 errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
 AM_Check;
 return(AM_LeftPageNum);
@@ -0,0 +1,391 @@
+/* amsort.c
+ *
+ * In-memory sort of the (key, recid) pairs of an int index, in parallel
+ * by regular sampling:
+ *   1. the array is cut into one part per thread and each thread sorts
+ *      its part (merge sort, comparisons inlined);
+ *   2. pairs sampled at even intervals from the sorted parts give
+ *      splitters that cut every part into one piece per thread;
+ *   3. thread j merges the j-th pieces of all parts into its slice of
+ *      the output, which it copies back.
+ * Threads are started per phase and joined at its end, like the chunk
+ * parsers of loadtable. Pairs sort by key, then recid.
+ *
+ * Int keys need no comparisons at all: AM_RadixSortPairs() sorts by key
+ * alone, least significant byte first.
+ *
+ * Exports:
+ *   AM_SortPairs(pairs, n, nThreads)
+ *   AM_RadixSortPairs(pairs, n)
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "am.h"
+
+#define AM_SORT_MAXTHREADS 64
+#define AM_SORT_MINPART    4096  /* fewer pairs per thread: not worth one */
+#define AM_SORT_RUN        16    /* sorted by insertion before merging */
+
+#define AM_RADIX_BITS    8
+#define AM_RADIX_BUCKETS (1 << AM_RADIX_BITS)
+#define AM_RADIX_PASSES  (32 / AM_RADIX_BITS)
+#define AM_RADIX_WC      8     /* pairs buffered per bucket: one 64-byte line */
+
+/* digit "pass" of key k; flipping the sign bit orders negative keys first */
+#define AM_RADIX_DIGIT(k, pass) \
+    ((((unsigned int) (k) ^ 0x80000000u) >> ((pass) * AM_RADIX_BITS)) & \
+     (AM_RADIX_BUCKETS - 1))
+
+#define AM_PAIR_LT(a, b) ((a).key < (b).key || \
+                          ((a).key == (b).key && (a).recId < (b).recId))
+
+/* state of a sort shared by its threads */
+struct am_SortShared {
+    AM_PAIR *pairs;
+    AM_PAIR *tmp;       /* as many pairs, for merging */
+    int nParts;
+    int bound[AM_SORT_MAXTHREADS + 1];  /* part i is [bound[i], bound[i+1]) */
+    int *cut;           /* piece j of part i starts at cut[i * (nParts+1) + j] */
+    int out[AM_SORT_MAXTHREADS + 1];    /* slice j of the output */
+};
+
+/* one thread of a phase */
+struct am_SortThread {
+    struct am_SortShared *sh;
+    int id;
+    pthread_t thread;
+    int started;
+};
+
+/* merge a[0..na) and b[0..nb) into out */
+static void am_Merge(a, na, b, nb, out)
+AM_PAIR *a;
+int na;
+AM_PAIR *b;
+int nb;
+AM_PAIR *out;
+{
+    int i = 0, j = 0, k = 0;
+
+    while (i < na && j < nb) {
+        if (AM_PAIR_LT(b[j], a[i]))
+            out[k++] = b[j++];
+        else
+            out[k++] = a[i++];
+    }
+    while (i < na)
+        out[k++] = a[i++];
+    while (j < nb)
+        out[k++] = b[j++];
+}
+
+/* sort p[0..n) in place, with tmp[0..n) as scratch */
+static void am_MergeSort(p, tmp, n)
+AM_PAIR *p;
+AM_PAIR *tmp;
+int n;
+{
+    AM_PAIR *a = p, *b = tmp, *t, x;
+    int lo, hi, mid, w, i, j;
+
+    /* short runs by insertion */
+    for (lo = 0; lo < n; lo += AM_SORT_RUN) {
+        hi = (lo + AM_SORT_RUN < n) ? lo + AM_SORT_RUN : n;
+        for (i = lo + 1; i < hi; i++) {
+            x = p[i];
+            for (j = i; j > lo && AM_PAIR_LT(x, p[j - 1]); j--)
+                p[j] = p[j - 1];
+            p[j] = x;
+        }
+    }
+
+    /* then merge passes between p and tmp */
+    for (w = AM_SORT_RUN; w < n; w *= 2) {
+        for (lo = 0; lo < n; lo += 2 * w) {
+            mid = (lo + w < n) ? lo + w : n;
+            hi = (lo + 2 * w < n) ? lo + 2 * w : n;
+            am_Merge(a + lo, mid - lo, a + mid, hi - mid, b + lo);
+        }
+        t = a;
+        a = b;
+        b = t;
+    }
+    if (a != p)
+        memcpy(p, a, n * sizeof(AM_PAIR));
+}
+
+/* first position of p[lo..hi) not below x */
+static int am_LowerBound(p, lo, hi, x)
+AM_PAIR *p;
+int lo;
+int hi;
+AM_PAIR x;
+{
+    int mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (AM_PAIR_LT(p[mid], x))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* phase 1: sort part "id" */
+static void *am_SortPart(arg)
+void *arg;
+{
+    struct am_SortThread *t = (struct am_SortThread *) arg;
+    struct am_SortShared *sh = t->sh;
+    int lo = sh->bound[t->id], hi = sh->bound[t->id + 1];
+
+    am_MergeSort(sh->pairs + lo, sh->tmp + lo, hi - lo);
+    return NULL;
+}
+
+/* phase 2: merge piece "id" of every part into slice "id" of tmp, by
+   a heap of the pieces' next pairs, then copy the slice back */
+static void *am_SortSlice(arg)
+void *arg;
+{
+    struct am_SortThread *t = (struct am_SortThread *) arg;
+    struct am_SortShared *sh = t->sh;
+    int P = sh->nParts, stride = sh->nParts + 1;
+    int pos[AM_SORT_MAXTHREADS], end[AM_SORT_MAXTHREADS];
+    int heap[AM_SORT_MAXTHREADS];
+    AM_PAIR *p = sh->pairs, *out = sh->tmp + sh->out[t->id];
+    int i, k, n = 0, c, x;
+
+    for (i = 0; i < P; i++) {
+        pos[i] = sh->cut[i * stride + t->id];
+        end[i] = sh->cut[i * stride + t->id + 1];
+        if (pos[i] < end[i])
+            heap[n++] = i;
+    }
+    /* heapify */
+    for (k = n / 2 - 1; k >= 0; k--) {
+        x = heap[k];
+        for (i = k; (c = 2 * i + 1) < n; i = c) {
+            if (c + 1 < n && AM_PAIR_LT(p[pos[heap[c + 1]]], p[pos[heap[c]]]))
+                c++;
+            if (!AM_PAIR_LT(p[pos[heap[c]]], p[pos[x]]))
+                break;
+            heap[i] = heap[c];
+        }
+        heap[i] = x;
+    }
+    while (n > 0) {
+        x = heap[0];
+        *out++ = p[pos[x]++];
+        if (pos[x] == end[x])
+            x = heap[--n];
+        for (i = 0; (c = 2 * i + 1) < n; i = c) {
+            if (c + 1 < n && AM_PAIR_LT(p[pos[heap[c + 1]]], p[pos[heap[c]]]))
+                c++;
+            if (!AM_PAIR_LT(p[pos[heap[c]]], p[pos[x]]))
+                break;
+            heap[i] = heap[c];
+        }
+        if (n > 0)
+            heap[i] = x;
+    }
+    return NULL;
+}
+
+/* phase 3: copy slice "id" back */
+static void *am_SortCopy(arg)
+void *arg;
+{
+    struct am_SortThread *t = (struct am_SortThread *) arg;
+    struct am_SortShared *sh = t->sh;
+    int lo = sh->out[t->id], hi = sh->out[t->id + 1];
+
+    memcpy(sh->pairs + lo, sh->tmp + lo, (hi - lo) * sizeof(AM_PAIR));
+    return NULL;
+}
+
+/* run "fcn" once per thread; a thread that cannot be started runs
+   inline, and all are joined before returning */
+static void am_SortPhase(t, n, fcn)
+struct am_SortThread *t;
+int n;
+void *(*fcn)();
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        t[i].started = (n > 1 && pthread_create(&t[i].thread, NULL, fcn,
+                                                (void *) &t[i]) == 0);
+        if (!t[i].started)
+            (*fcn)((void *) &t[i]);
+    }
+    for (i = 0; i < n; i++)
+        if (t[i].started)
+            pthread_join(t[i].thread, NULL);
+}
+
+/* Sort pairs[0..n) by key, then recid, with up to nThreads threads
+ * (<= 0: one per online processor).
+ *
+ * Returns AME_OK, or AME_INTERROR when out of memory.
+ */
+int AM_SortPairs(pairs, n, nThreads)
+AM_PAIR *pairs;
+int n;
+int nThreads;
+{
+    struct am_SortShared sh;
+    struct am_SortThread t[AM_SORT_MAXTHREADS];
+    AM_PAIR *sample;
+    int P, i, j, len, stride;
+
+    if (nThreads <= 0)
+        nThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nThreads > AM_SORT_MAXTHREADS)
+        nThreads = AM_SORT_MAXTHREADS;
+    if (nThreads > n / AM_SORT_MINPART)
+        nThreads = n / AM_SORT_MINPART;
+    P = (nThreads < 1) ? 1 : nThreads;
+
+    if ((sh.tmp = (AM_PAIR *) malloc((n > 0 ? n : 1) * sizeof(AM_PAIR))) == NULL) {
+        AM_Errno = AME_INTERROR;
+        return AME_INTERROR;
+    }
+    sh.pairs = pairs;
+    if (P == 1) {
+        am_MergeSort(pairs, sh.tmp, n);
+        free(sh.tmp);
+        return AME_OK;
+    }
+
+    stride = P + 1;
+    sh.nParts = P;
+    sh.cut = (int *) malloc(P * stride * sizeof(int));
+    sample = (AM_PAIR *) malloc(P * P * sizeof(AM_PAIR));
+    if (sh.cut == NULL || sample == NULL) {
+        free(sh.cut);
+        free(sample);
+        free(sh.tmp);
+        AM_Errno = AME_INTERROR;
+        return AME_INTERROR;
+    }
+    for (i = 0; i <= P; i++)
+        sh.bound[i] = (int) ((double) n * i / P);
+    for (i = 0; i < P; i++) {
+        t[i].sh = &sh;
+        t[i].id = i;
+    }
+
+    /* 1. sort the parts */
+    am_SortPhase(t, P, am_SortPart);
+
+    /* 2. P regular samples of each part; every P-th sample splits */
+    for (i = 0; i < P; i++) {
+        len = sh.bound[i + 1] - sh.bound[i];
+        for (j = 0; j < P; j++)
+            sample[i * P + j] = pairs[sh.bound[i] + (int) ((double) len * j / P)];
+    }
+    am_MergeSort(sample, sh.tmp, P * P);
+    for (i = 0; i < P; i++) {
+        sh.cut[i * stride] = sh.bound[i];
+        for (j = 1; j < P; j++)
+            sh.cut[i * stride + j] = am_LowerBound(pairs, sh.cut[i * stride + j - 1],
+                                                   sh.bound[i + 1], sample[j * P + P / 2]);
+        sh.cut[i * stride + P] = sh.bound[i + 1];
+    }
+    sh.out[0] = 0;
+    for (j = 0; j < P; j++) {
+        sh.out[j + 1] = sh.out[j];
+        for (i = 0; i < P; i++)
+            sh.out[j + 1] += sh.cut[i * stride + j + 1] - sh.cut[i * stride + j];
+    }
+
+    /* 3. merge the pieces of each slice, then copy the slices back */
+    am_SortPhase(t, P, am_SortSlice);
+    am_SortPhase(t, P, am_SortCopy);
+
+    free(sample);
+    free(sh.cut);
+    free(sh.tmp);
+    return AME_OK;
+}
+
+/* Sort pairs[0..n) by key with an LSD radix sort: one pass over the keys
+ * counts the digits of every pass, passes whose digit is the same for all
+ * keys are skipped, and each remaining pass scatters through a cache line
+ * of buffer per bucket, written out whole (software write-combining).
+ * The sort is stable: pairs with equal keys keep their input order, so
+ * pairs collected in recid order come out by key, then recid.
+ *
+ * Returns AME_OK, or AME_INTERROR when out of memory.
+ */
+int AM_RadixSortPairs(pairs, n)
+AM_PAIR *pairs;
+int n;
+{
+    int count[AM_RADIX_PASSES][AM_RADIX_BUCKETS];
+    int pos[AM_RADIX_BUCKETS], fill[AM_RADIX_BUCKETS];
+    AM_PAIR *tmp, *wc, *src, *dst, *t;
+    int pass, i, d, sum;
+
+    if (n < 2)
+        return AME_OK;
+    tmp = (AM_PAIR *) malloc(n * sizeof(AM_PAIR));
+    wc = (AM_PAIR *) malloc(AM_RADIX_BUCKETS * AM_RADIX_WC * sizeof(AM_PAIR));
+    if (tmp == NULL || wc == NULL) {
+        free(tmp);
+        free(wc);
+        AM_Errno = AME_INTERROR;
+        return AME_INTERROR;
+    }
+
+    /* histograms of all passes, in one pass over the keys */
+    memset((char *) count, 0, sizeof(count));
+    for (i = 0; i < n; i++)
+        for (pass = 0; pass < AM_RADIX_PASSES; pass++)
+            count[pass][AM_RADIX_DIGIT(pairs[i].key, pass)]++;
+
+    src = pairs;
+    dst = tmp;
+    for (pass = 0; pass < AM_RADIX_PASSES; pass++) {
+        if (count[pass][AM_RADIX_DIGIT(src[0].key, pass)] == n)
+            continue;
+        for (d = 0, sum = 0; d < AM_RADIX_BUCKETS; d++) {
+            pos[d] = sum;
+            fill[d] = 0;
+            sum += count[pass][d];
+        }
+        for (i = 0; i < n; i++) {
+            d = AM_RADIX_DIGIT(src[i].key, pass);
+            wc[d * AM_RADIX_WC + fill[d]] = src[i];
+            if (++fill[d] == AM_RADIX_WC) {
+                memcpy(dst + pos[d], wc + d * AM_RADIX_WC,
+                       AM_RADIX_WC * sizeof(AM_PAIR));
+                pos[d] += AM_RADIX_WC;
+                fill[d] = 0;
+            }
+        }
+        for (d = 0; d < AM_RADIX_BUCKETS; d++)
+            if (fill[d] > 0)
+                memcpy(dst + pos[d], wc + d * AM_RADIX_WC,
+                       fill[d] * sizeof(AM_PAIR));
+        t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != pairs)
+        memcpy(pairs, src, n * sizeof(AM_PAIR));
+
+    free(wc);
+    free(tmp);
+    return AME_OK;
+}
@@ -7,6 +7,10 @@ void AM_ResetStats()
 {
     PFbufStatsInit();
     AMstats.pagesAccessed = 0;
+    AMstats.sort_ms = 0;
+    AMstats.read_ms = 0;
+    AMstats.sortRuns = 0;
+    AMstats.sortPages = 0;
 }
 
 void AM_CaptureStats(double elapsed_ms)
@@ -4,11 +4,15 @@
 
 struct AM_Stats {
     double time_ms;
+    double sort_ms;     /* sorting before the build, if timed apart */
+    double read_ms;     /* reading before that sort; -1 if they interleave */
     int logicalReads;
     int physicalReads;
     int logicalWrites;
     int physicalWrites;
     int pagesAccessed;
+    int sortRuns;       /* sorted runs spilled by a bulk load */
+    long sortPages;     /* pages written to those runs */
 };
 
 extern struct AM_Stats AMstats;
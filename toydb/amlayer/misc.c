@@ -1,4 +1,7 @@
 /* misc.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "pf.h"
 #include "testam.h"
 #include "am.h"
@@ -132,8 +135,8 @@ char *fname;
 {
 int errval;
 
-	if ((errval=PF_OpenFile(fname))<0){
-		printf("PF_OpenFile(%s) failed: %d\n",errval);
+	if ((errval=PF_OpenFile(fname,PF_REPLACE_LRU))<0){
+		printf("PF_OpenFile(%s) failed: %d\n",fname,errval);
 		exit(1);
 	}
 	return(errval);
@@ -312,6 +312,191 @@ int error;
 	return(PFE_OK);
 }
 
+/* miss descriptor used by PFbufGetBatch() to sort misses by page number */
+typedef struct PFbufMiss {
+	int page;	/* page number */
+	int idx;	/* position in the caller's arrays */
+	PFbpage *bpage;	/* frame allocated for the page, or NULL */
+} PFbufMiss;
+
+static int PFbufMissCmp(a,b)
+const void *a;
+const void *b;
+{
+	const PFbufMiss *x = (const PFbufMiss *)a;
+	const PFbufMiss *y = (const PFbufMiss *)b;
+
+	if (x->page != y->page)
+		return((x->page < y->page) ? -1 : 1);
+	return(x->idx - y->idx);
+}
+
+static void PFbufDropFrame(bpage)
+PFbpage *bpage;
+/****************************************************************************
+SPECIFICATIONS:
+	Undo the allocation of a frame that was hashed and fixed by
+	PFbufGetBatch() but whose page could not be read.
+*****************************************************************************/
+{
+	PFhashDelete(bpage->fd,bpage->page);
+	bpage->fixed = FALSE;
+	PFbufUnlink(bpage);
+	PFbufInsertFree(bpage);
+}
+
+PFbufGetBatch(fd,pagenums,n,fpages,errs,readvfcn,writefcn)
+int fd;		/* file descriptor */
+int *pagenums;	/* page numbers to fix */
+int n;		/* # of entries in pagenums */
+PFfpage **fpages;	/* set to the data of each page */
+int *errs;	/* error code of each page */
+int (*readvfcn)();	/* function to read a run of pages */
+int (*writefcn)();	/* function to write a page */
+/****************************************************************************
+SPECIFICATIONS:
+	Fix the "n" pages listed in "pagenums" of file "fd", and set
+	fpages[i] to point to the data of pagenums[i].  Entries whose
+	errs[i] is not PFE_OK on input are skipped.  On output errs[i]
+	holds the outcome for pagenums[i], with the same meaning as the
+	return value of PFbufGet(): in particular, fpages[i] is still set
+	when errs[i] is PFE_PAGEFIXED.  A page listed twice is fixed once;
+	the second entry reports PFE_PAGEFIXED.
+
+	This function requires a function
+		readvfcn(fd,pagenum,count,fpages)
+		int fd;
+		int pagenum;
+		int count;
+		PFfpage *fpages[];
+	which reads the "count" consecutive pages starting at "pagenum"
+	into the buffers fpages[0..count-1] with one request.
+
+ALGORITHM:
+	Pages already in the buffer are fixed first.  The misses are sorted
+	by page number, a frame is allocated and fixed for each of them,
+	and runs of consecutive page numbers are then read with a single
+	call to readvfcn() each.
+
+RETURN VALUE:
+	PFE_OK	if every page was fixed.
+	The first error code found in errs[] otherwise.
+*****************************************************************************/
+{
+PFbpage *bpage;
+PFbufMiss *miss;	/* misses, sorted by page number */
+PFfpage *run[PF_MAX_IOV];	/* frames of the run being read */
+int nmiss = 0;
+int i, k, len, error;
+
+	if ((miss = (PFbufMiss *)malloc(sizeof(PFbufMiss) * (n + 1))) == NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+
+	/* fix the pages that are already in the buffer */
+	for (i=0; i < n; i++){
+		fpages[i] = NULL;
+		if (errs[i] != PFE_OK)
+			continue;
+		if ((bpage=PFhashFind(fd,pagenums[i])) == NULL){
+			miss[nmiss].page = pagenums[i];
+			miss[nmiss].idx = i;
+			miss[nmiss].bpage = NULL;
+			nmiss++;
+			continue;
+		}
+		PF_logicalReads++;
+		fpages[i] = &bpage->fpage;
+		if (bpage->fixed)
+			errs[i] = PFE_PAGEFIXED;
+		else	bpage->fixed = TRUE;
+	}
+
+	qsort((char *)miss,nmiss,sizeof(PFbufMiss),PFbufMissCmp);
+
+	/* allocate a fixed frame for every distinct missing page */
+	for (k=0; k < nmiss; k++){
+		i = miss[k].idx;
+		if (k > 0 && miss[k].page == miss[k-1].page){
+			/* duplicate: resolved once the first copy is read */
+			continue;
+		}
+		if ((error=PFbufInternalAlloc(&bpage,writefcn,fd))!= PFE_OK){
+			errs[i] = error;
+			continue;
+		}
+		bpage->fd = fd;
+		bpage->page = miss[k].page;
+		bpage->dirty = FALSE;
+		bpage->fixed = TRUE;
+		if ((error=PFhashInsert(fd,miss[k].page,bpage))!= PFE_OK){
+			bpage->fixed = FALSE;
+			PFbufUnlink(bpage);
+			PFbufInsertFree(bpage);
+			errs[i] = error;
+			continue;
+		}
+		miss[k].bpage = bpage;
+	}
+
+	/* read runs of consecutive pages with one request each */
+	for (k=0; k < nmiss; k += len){
+		if (miss[k].bpage == NULL){
+			len = 1;
+			continue;
+		}
+		run[0] = &miss[k].bpage->fpage;
+		for (len=1, i=k+1; i < nmiss && len < PF_MAX_IOV; i++){
+			if (miss[i].page == miss[i-1].page)
+				continue;	/* duplicate, no frame */
+			if (miss[i].bpage == NULL ||
+					miss[i].page != miss[k].page + len)
+				break;
+			run[len++] = &miss[i].bpage->fpage;
+		}
+		error = (*readvfcn)(fd,miss[k].page,len,run);
+
+		/* i is the end of the run in miss[] */
+		for (len=i-k, i=k; i < k+len; i++){
+			if (miss[i].bpage == NULL)
+				continue;
+			if (error != PFE_OK){
+				errs[miss[i].idx] = error;
+				PFbufDropFrame(miss[i].bpage);
+				miss[i].bpage = NULL;
+			}
+			else {
+				PF_logicalReads++;
+				fpages[miss[i].idx] = &miss[i].bpage->fpage;
+			}
+		}
+	}
+
+	/* resolve duplicates of missing pages */
+	for (k=1; k < nmiss; k++){
+		if (miss[k].page != miss[k-1].page)
+			continue;
+		miss[k].bpage = miss[k-1].bpage;
+		i = miss[k].idx;
+		if (miss[k].bpage == NULL)
+			errs[i] = errs[miss[k-1].idx];
+		else {
+			PF_logicalReads++;
+			fpages[i] = &miss[k].bpage->fpage;
+			errs[i] = PFE_PAGEFIXED;
+		}
+	}
+	free((char *)miss);
+
+	for (i=0; i < n; i++)
+		if (errs[i] != PFE_OK){
+			PFerrno = errs[i];
+			return(PFerrno);
+		}
+	return(PFE_OK);
+}
+
 PFbufUnfix(fd,pagenum,dirty)
 int fd;		/* file descriptor */
 int pagenum;	/* page number */
@@ -0,0 +1,423 @@
+/* loadtable.c: parallel bulk loader for the data/ tables.
+ *
+ * Each table file (';'-separated lines after a title line) is mapped
+ * with mmap() and cut into one chunk per thread at line boundaries.
+ * The chunks are parsed in two parallel passes: the first counts the
+ * lines and fields of its chunk and notes which columns hold only plain
+ * ints, the second encodes every line as a schema tuple into a private
+ * arena once the per-chunk results have been merged into a schema.  The
+ * main thread takes the chunks in file order as their parsers finish
+ * and writes them with RM_InsertRecords(), so the file gets the lines
+ * in their original order while the later chunks are still parsing.
+ *
+ * The schema is inferred as in rmbench: as many columns as the widest
+ * line (at most RM_MAX_ATTRS), ints where every value is a plain int,
+ * varchars elsewhere, named c0, c1, ...  Lines that do not encode
+ * are counted as rejected.
+ *
+ * usage: loadtable [-D datadir] [-o outdir] [-b bufs] [-t threads] [-d]
+ *                  [table ...]
+ *     -D dir    data directory                          [../../data]
+ *     -o dir    directory for the <table>.rm files      [.]
+ *     -b n      buffer pool size in pages               [256]
+ *     -t n      parser threads                          [4]
+ *     -d        destroy each RM file after loading it
+ *
+ * Without table names every .txt file of the data directory is loaded.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rm.h"
+#include "pf.h"
+#include "pftypes.h"
+
+/* loader configuration */
+static char *cfgDir     = "../../data";
+static char *cfgOut     = ".";
+static int   cfgBuffers = 256;
+static int   cfgThreads = 4;
+static int   cfgDestroy = FALSE;
+
+/* one chunk of a table file and what its parser made of it */
+typedef struct LoadChunk {
+    char *begin, *end;          /* whole lines of the mapped file */
+    RM_Schema *schema;          /* pass 2: schema of the tuples */
+
+    int numFields;              /* pass 1: fields on the widest line */
+    int isInt[RM_MAX_ATTRS];    /* pass 1: column holds plain ints only */
+    int numLines;               /* pass 1: non-empty lines */
+
+    RM_Record *recs;            /* pass 2: encoded tuples, in line order */
+    int numRecs;
+    int rejected;               /* pass 2: lines that did not encode */
+    char *arena;                /* pass 2: tuple storage */
+    double ms;                  /* pass 2: parse time */
+
+    pthread_t thread;
+    int started;                /* TRUE if "thread" runs the parser */
+} LoadChunk;
+
+static LoadChunk chunks[RM_MAX_WORKERS];
+
+/* timestamp in milliseconds */
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/* next line of [*pp, end) without its line end; returns its length, or
+   -1 at the end of the chunk */
+static int next_line(pp, end, line)
+char **pp;
+char *end;
+char **line;
+{
+    char *p = *pp, *eol;
+    int len;
+
+    if (p >= end)
+        return -1;
+    eol = memchr(p, '\n', end - p);
+    if (eol == NULL)
+        eol = end;
+    len = eol - p;
+    if (len > 0 && p[len - 1] == '\r')
+        len--;
+    *line = p;
+    *pp = eol + 1;
+    return len;
+}
+
+/* pass 1: count the lines and fields of a chunk, note the int columns */
+static void *scan_chunk(arg)
+void *arg;
+{
+    LoadChunk *c = (LoadChunk *) arg;
+    char *p = c->begin, *line, *f, *eol;
+    int len, i, flen, n;
+
+    c->numFields = 0;
+    c->numLines = 0;
+    for (i = 0; i < RM_MAX_ATTRS; i++)
+        c->isInt[i] = TRUE;
+    while ((len = next_line(&p, c->end, &line)) >= 0) {
+        if (len == 0)
+            continue;
+        c->numLines++;
+        f = line;
+        eol = line + len;
+        for (i = 0; i < RM_MAX_ATTRS && f <= eol; i++) {
+            for (flen = 0; f + flen < eol && f[flen] != ';'; flen++)
+                ;
+            if (flen > 0 && !RM_TextIsInt(f, flen))
+                c->isInt[i] = FALSE;
+            f += flen + 1;
+        }
+        n = i;
+        if (n > c->numFields)
+            c->numFields = n;
+    }
+    return NULL;
+}
+
+/* pass 2: encode the lines of a chunk as tuples of c->schema */
+static void *parse_chunk(arg)
+void *arg;
+{
+    LoadChunk *c = (LoadChunk *) arg;
+    char *p = c->begin, *line, *out;
+    double t0 = now_ms();
+    int len, extra;
+
+    /* an int takes at most 3 bytes more than its text */
+    extra = c->schema->dataPos + 3 * c->schema->numAttrs;
+    c->numRecs = c->rejected = 0;
+    c->recs = (RM_Record *) malloc((c->numLines + 1) * sizeof(RM_Record));
+    c->arena = (char *) malloc((c->end - c->begin) + (long) c->numLines * extra + 1);
+    if (c->recs == NULL || c->arena == NULL) {
+        c->rejected = c->numLines;
+        c->ms = now_ms() - t0;
+        return NULL;
+    }
+    out = c->arena;
+    while ((len = next_line(&p, c->end, &line)) >= 0) {
+        if (len == 0)
+            continue;
+        if (RM_TupleFromText(c->schema, line, len, ';', out, len + extra,
+                             &c->recs[c->numRecs].length) != PFE_OK) {
+            c->rejected++;
+            continue;
+        }
+        c->recs[c->numRecs].data = out;
+        out += c->recs[c->numRecs++].length;
+    }
+    c->ms = now_ms() - t0;
+    return NULL;
+}
+
+/* run "fcn" on chunks 0..n-1, one thread each; a chunk whose thread
+   cannot be started (or the only one) is run inline */
+static void start_chunks(n, fcn)
+int n;
+void *(*fcn)();
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        chunks[i].started = (n > 1 && pthread_create(&chunks[i].thread, NULL, fcn,
+                                                     (void *) &chunks[i]) == 0);
+        if (!chunks[i].started)
+            (*fcn)((void *) &chunks[i]);
+    }
+}
+
+/* wait for the parser of chunk i */
+static void join_chunk(i)
+int i;
+{
+    if (chunks[i].started)
+        pthread_join(chunks[i].thread, NULL);
+    chunks[i].started = FALSE;
+}
+
+/* Load table "name" into <outdir>/<name>.rm; prints one result line.
+   Returns the rows stored, or -1. */
+static long load_table(name, parseMs, insertMs, totalMs)
+char *name;
+double *parseMs, *insertMs, *totalMs;
+{
+    RM_FileHandle fh;
+    RM_Schema schema;
+    struct stat st;
+    char path[512], rmname[512], attr[16];
+    char *map, *p, *end, *cut;
+    RID *rids;
+    double t0, tIns, maxParse;
+    long rows, rejected;
+    int fd, n, i, k, numFields, numInts, error, opened, maxRecs;
+
+    t0 = now_ms();
+    *parseMs = *insertMs = *totalMs = 0.0;
+    sprintf(path, "%s/%s.txt", cfgDir, name);
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "loadtable: cannot open %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == (char *) MAP_FAILED) {
+        fprintf(stderr, "loadtable: cannot map %s\n", path);
+        return -1;
+    }
+    end = map + st.st_size;
+
+    /* skip the title line, then cut the rest at line boundaries */
+    p = memchr(map, '\n', st.st_size);
+    p = (p == NULL) ? end : p + 1;
+    n = cfgThreads;
+    for (i = 0; i < n; i++) {
+        chunks[i].begin = p;
+        cut = (i == n - 1) ? end : p + (end - p) / (n - i);
+        if (cut < end && (cut = memchr(cut, '\n', end - cut)) != NULL)
+            cut++;
+        else
+            cut = end;
+        chunks[i].end = cut;
+        chunks[i].recs = NULL;
+        chunks[i].arena = NULL;
+        p = cut;
+    }
+
+    /* pass 1, then merge the chunks into a schema */
+    start_chunks(n, scan_chunk);
+    for (i = 0; i < n; i++)
+        join_chunk(i);
+    numFields = 0;
+    for (i = 0; i < n; i++)
+        if (chunks[i].numFields > numFields)
+            numFields = chunks[i].numFields;
+    RM_SchemaInit(&schema);
+    for (k = numInts = 0; k < numFields; k++) {
+        for (i = 0; i < n && chunks[i].isInt[k]; i++)
+            ;
+        sprintf(attr, "c%d", k);
+        RM_SchemaAddAttr(&schema, attr, i == n ? RM_TYPE_INT : RM_TYPE_VARCHAR, 0);
+        numInts += (i == n);
+    }
+    for (i = 0; i < n; i++)
+        chunks[i].schema = &schema;
+
+    sprintf(rmname, "%s/%s.rm", cfgOut, name);
+    PF_DestroyFile(rmname);
+    opened = FALSE;
+    error = RM_CreateFile(rmname);
+    if (error == PFE_OK && (error = RM_OpenFile(rmname, &fh)) == PFE_OK) {
+        opened = TRUE;
+        error = RM_SetSchema(&fh, &schema);
+    }
+
+    /* pass 2; insert each chunk as soon as it is parsed */
+    start_chunks(n, parse_chunk);
+    rows = rejected = 0;
+    tIns = maxParse = 0.0;
+    maxRecs = 0;
+    rids = NULL;
+    for (i = 0; i < n; i++) {
+        join_chunk(i);
+        rejected += chunks[i].rejected;
+        if (chunks[i].ms > maxParse)
+            maxParse = chunks[i].ms;
+        if (error == PFE_OK && chunks[i].numRecs > maxRecs) {
+            free(rids);
+            maxRecs = chunks[i].numRecs;
+            if ((rids = (RID *) malloc(maxRecs * sizeof(RID))) == NULL)
+                error = PFE_NOMEM;
+        }
+        if (error == PFE_OK && chunks[i].numRecs > 0) {
+            double t1 = now_ms();
+
+            error = RM_InsertRecords(&fh, chunks[i].recs, chunks[i].numRecs, rids);
+            tIns += now_ms() - t1;
+            if (error == PFE_OK)
+                rows += chunks[i].numRecs;
+        }
+        free(chunks[i].recs);
+        free(chunks[i].arena);
+    }
+    free(rids);
+    munmap(map, st.st_size);
+
+    if (error != PFE_OK) {
+        fprintf(stderr, "loadtable: cannot load %s: %d\n", name, error);
+        if (opened)
+            RM_CloseFile(&fh);
+        return -1;
+    }
+    k = PF_GetNumPages(fh.fd);
+    RM_CloseFile(&fh);
+    if (cfgDestroy)
+        PF_DestroyFile(rmname);
+
+    *parseMs = maxParse;
+    *insertMs = tIns;
+    *totalMs = now_ms() - t0;
+    sprintf(attr, "%d/%d", numInts, numFields);
+    printf("| %-11s | %6s | %7ld | %5ld | %6d | %8.2f | %9.2f | %8.2f | %10.0f |\n",
+           name, attr, rows, rejected, k, *parseMs, *insertMs, *totalMs,
+           *totalMs > 0 ? rows / (*totalMs / 1000.0) : 0.0);
+    return rows;
+}
+
+static void usage(prog)
+char *prog;
+{
+    fprintf(stderr,
+        "usage: %s [-D datadir] [-o outdir] [-b bufs] [-t threads] [-d] [table ...]\n",
+        prog);
+    exit(2);
+}
+
+int main(argc, argv)
+int argc;
+char **argv;
+{
+    DIR *dir;
+    struct dirent *de;
+    char name[64];
+    double parseMs, insertMs, totalMs, sumParse, sumInsert, sumTotal;
+    long rows, totalRows;
+    int i, len, first, numTables;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        char *opt = argv[i];
+
+        if (opt[1] == '\0' || opt[2] != '\0')
+            usage(argv[0]);
+        if (opt[1] == 'd') {
+            cfgDestroy = TRUE;
+            continue;
+        }
+        if (++i >= argc)
+            usage(argv[0]);
+        switch (opt[1]) {
+        case 'D': cfgDir = argv[i]; break;
+        case 'o': cfgOut = argv[i]; break;
+        case 'b': cfgBuffers = atoi(argv[i]); break;
+        case 't': cfgThreads = atoi(argv[i]); break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (cfgBuffers < 1 || cfgThreads < 1 || cfgThreads > RM_MAX_WORKERS)
+        usage(argv[0]);
+    first = i;
+
+    PF_Init(cfgBuffers);
+    printf("Loading with %d parser thread(s):\n", cfgThreads);
+    printf("---------------------------------------------------------------------------------------------\n");
+    printf("| %-11s | %6s | %7s | %5s | %6s | %8s | %9s | %8s | %10s |\n", "table",
+           "int/n", "rows", "rej", "pages", "parse ms", "insert ms", "total ms", "rows/sec");
+    printf("---------------------------------------------------------------------------------------------\n");
+
+    totalRows = 0;
+    numTables = 0;
+    sumParse = sumInsert = sumTotal = 0.0;
+    dir = NULL;
+    if (first == argc && (dir = opendir(cfgDir)) == NULL) {
+        fprintf(stderr, "loadtable: cannot open %s\n", cfgDir);
+        return 1;
+    }
+    for (i = first; ; i++) {
+        if (dir == NULL) {
+            if (i >= argc)
+                break;
+            strncpy(name, argv[i], sizeof(name) - 1);
+            name[sizeof(name) - 1] = '\0';
+        }
+        else {
+            if ((de = readdir(dir)) == NULL)
+                break;
+            len = strlen(de->d_name);
+            if (len < 5 || len >= (int) sizeof(name) + 4
+                || strcmp(de->d_name + len - 4, ".txt") != 0)
+                continue;
+            memcpy(name, de->d_name, len - 4);
+            name[len - 4] = '\0';
+        }
+        if ((rows = load_table(name, &parseMs, &insertMs, &totalMs)) < 0)
+            continue;
+        totalRows += rows;
+        sumParse += parseMs;
+        sumInsert += insertMs;
+        sumTotal += totalMs;
+        numTables++;
+    }
+    if (dir != NULL)
+        closedir(dir);
+
+    printf("---------------------------------------------------------------------------------------------\n");
+    printf("| %-11s | %6d | %7ld | %5s | %6s | %8.2f | %9.2f | %8.2f | %10.0f |\n",
+           "all", numTables, totalRows, "", "", sumParse, sumInsert, sumTotal,
+           sumTotal > 0 ? totalRows / (sumTotal / 1000.0) : 0.0);
+    printf("---------------------------------------------------------------------------------------------\n");
+    return 0;
+}
@@ -4,6 +4,9 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <sys/file.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "pftypes.h"
 
 /* To keep system V and PC users happy */
@@ -18,6 +21,14 @@ int PFerrno = PFE_OK;	/* last error message */
 
 PFftab_ele PFftab[PF_FTAB_SIZE]; /* table of opened files */
 
+/* Latch serializing the PF interface routines, which makes the PF layer
+safe to call from several threads.  The routines are written as static
+PFxxx() functions; the public PF_Xxx() entry points at the end of this
+file take the latch around them.  Pages are still fixed by at most one
+caller at a time, and PFerrno is shared by all threads. */
+static pthread_mutex_t PFlatch = PTHREAD_MUTEX_INITIALIZER;
+static PFgetNextPage();
+
 /* true if file descriptor fd is invaild */
 #define PFinvalidFd(fd) ((fd) < 0 || (fd) >= PF_FTAB_SIZE \
 				|| PFftab[fd].fname == NULL)
@@ -129,6 +140,50 @@ int error;
 	return(PFE_OK);
 }
 
+PFreadvfcn(fd,pagenum,count,bufs)
+int fd;		/* file descriptor */
+int pagenum;	/* first page to read */
+int count;	/* # of consecutive pages to read, at most PF_MAX_IOV */
+PFfpage *bufs[];	/* buffer for each page */
+/****************************************************************************
+SPECIFICATIONS:
+	Read the "count" consecutive pages starting at "pagenum" from
+	the file indexed by "fd" into the buffers bufs[0..count-1],
+	using a single vectored read.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+struct iovec iov[PF_MAX_IOV];
+int i;
+int error;
+
+	for (i=0; i < count; i++){
+		iov[i].iov_base = (char *)bufs[i];
+		iov[i].iov_len = sizeof(PFfpage);
+	}
+
+	/* seek to the first page of the run */
+	if ((error=lseek(PFftab[fd].unixfd,pagenum*sizeof(PFfpage)+PF_HDR_SIZE,
+				L_SET)) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+
+	/* read the whole run */
+	if((error=readv(PFftab[fd].unixfd,iov,count))
+			!= count*sizeof(PFfpage)){
+		if (error <0)
+			PFerrno = PFE_UNIX;
+		else	PFerrno = PFE_INCOMPLETEREAD;
+		return(PFerrno);
+	}
+	PF_physicalReads += count;
+	return(PFE_OK);
+}
+
 PFwritefcn(fd,pagenum,buf)
 int fd;		/* file descriptor */
 int pagenum;	/* page to read */
@@ -197,7 +252,7 @@ PF_MAX_BUFS_RUNTIME = numBuffers;
 	}
 }
 
-PF_CreateFile(fname)
+static PFcreateFile(fname)
 char *fname;	/* name of file to create */
 /****************************************************************************
 SPECIFICATIONS:
@@ -244,7 +299,7 @@ int error;
 }
 
 
-PF_DestroyFile(fname)
+static PFdestroyFile(fname)
 char *fname;		/* file name to destroy */
 /****************************************************************************
 SPECIFICATIONS:
@@ -278,7 +333,7 @@ int error;
 }
 
 
-PF_OpenFile(fname,strategy)
+static PFopenFile(fname,strategy)
 char *fname;		/* name of the file to open */
 int strategy;	/* replacement strategy for this file */
 /****************************************************************************
@@ -343,7 +398,7 @@ int fd; /* file descriptor */
 	return(fd);
 }
 
-PF_CloseFile(fd)
+static PFcloseFile(fd)
 int fd;		/* file descriptor to close */
 /****************************************************************************
 SPECIFICATIONS:
@@ -408,7 +463,7 @@ int error;
 }
 
 
-PF_GetFirstPage(fd,pagenum,pagebuf)
+static PFgetFirstPage(fd,pagenum,pagebuf)
 int fd;	/* file descriptor */
 int *pagenum;	/* page number of first page */
 char **pagebuf;	/* pointer to the pointer to buffer */
@@ -430,11 +485,11 @@ RETURN VALUE:
 {
 
 	*pagenum = -1;
-	return(PF_GetNextPage(fd,pagenum,pagebuf));
+	return(PFgetNextPage(fd,pagenum,pagebuf));
 }
 
 
-PF_GetNextPage(fd,pagenum,pagebuf)
+static PFgetNextPage(fd,pagenum,pagebuf)
 int fd;	/* file descriptor of the file */
 int *pagenum;	/* old page number on input, new page number on output */
 char **pagebuf;	/* pointer to pointer to buffer of page data */
@@ -496,7 +551,7 @@ PFfpage *fpage;	/* pointer to file page */
 
 }
 
-PF_GetThisPage(fd,pagenum,pagebuf)
+static PFgetThisPage(fd,pagenum,pagebuf)
 int fd;		/* file descriptor */
 int pagenum;	/* page number to read */
 char **pagebuf;	/* pointer to pointer to page data */
@@ -551,7 +606,114 @@ PFfpage *fpage;
 	}
 }
 
-PF_AllocPage(fd,pagenum,pagebuf)
+static PFgetPages(fd,pagenums,n,pagebufs,errors)
+int fd;		/* file descriptor */
+int *pagenums;	/* page numbers to read */
+int n;		/* # of pages in pagenums */
+char **pagebufs;	/* set to point to the data of each page */
+int *errors;	/* error code of each page, or NULL */
+/****************************************************************************
+SPECIFICATIONS:
+	Read the "n" pages listed in "pagenums" in one call, and set
+	pagebufs[i] to point to the data of page pagenums[i].  Each page
+	read is fixed in the buffer until it is unfixed with
+	PF_UnfixPage(), exactly as if PF_GetThisPage() had been called
+	once per page.  If "errors" is not NULL, errors[i] is set to the
+	outcome for pagenums[i], with the same meaning as the return value
+	of PF_GetThisPage().  Pages whose errors[i] is PFE_OK were fixed by
+	this call and must be unfixed by the caller.  PFE_PAGEFIXED means
+	the page was already fixed, or is listed earlier in "pagenums";
+	pagebufs[i] is still set in that case.
+
+	Pages not in the buffer are sorted and read with as few vectored
+	reads as possible: each run of consecutive page numbers costs one
+	read request.  All pages requested must fit in the buffer pool at
+	the same time; the ones that do not get PFE_NOBUF.
+
+RETURN VALUE:
+	PFE_OK	if every page was read.
+	The error code of the first page, in the order of "pagenums",
+	that could not be read otherwise.
+*****************************************************************************/
+{
+PFfpage **fpages;	/* file page of each entry */
+int *errs;
+int i;
+int error;
+
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+
+	fpages = (PFfpage **)malloc(sizeof(PFfpage *) * (n + 1));
+	errs = (errors != NULL) ? errors : (int *)malloc(sizeof(int) * (n + 1));
+	if (fpages == NULL || errs == NULL){
+		if (fpages != NULL)
+			free((char *)fpages);
+		if (errs != NULL && errs != errors)
+			free((char *)errs);
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+
+	for (i=0; i < n; i++)
+		errs[i] = PFinvalidPagenum(fd,pagenums[i]) ? PFE_INVALIDPAGE
+								: PFE_OK;
+
+	PFbufGetBatch(fd,pagenums,n,fpages,errs,PFreadvfcn,PFwritefcn);
+
+	error = PFE_OK;
+	for (i=0; i < n; i++){
+		pagebufs[i] = NULL;
+		if (fpages[i] == NULL){
+			/* nothing fixed for this entry */
+		}
+		else if (errs[i] == PFE_PAGEFIXED)
+			pagebufs[i] = fpages[i]->pagebuf;
+		else if (fpages[i]->nextfree == PF_PAGE_USED)
+			pagebufs[i] = fpages[i]->pagebuf;
+		else {
+			/* free page: not a valid page to read */
+			if (PFbufUnfix(fd,pagenums[i],FALSE)!= PFE_OK){
+				printf("internal error:PF_GetPages()\n");
+				exit(1);
+			}
+			errs[i] = PFE_INVALIDPAGE;
+		}
+		if (error == PFE_OK && errs[i] != PFE_OK)
+			error = errs[i];
+	}
+
+	free((char *)fpages);
+	if (errs != errors)
+		free((char *)errs);
+
+	if (error != PFE_OK)
+		PFerrno = error;
+	return(error);
+}
+
+static PFgetNumPages(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Return the number of pages, used or free, in the file "fd".
+	Valid page numbers are 0 .. PF_GetNumPages(fd)-1.
+
+RETURN VALUE:
+	The number of pages (>= 0) if no error.
+	PF error code otherwise.
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	return(PFftab[fd].hdr.numpages);
+}
+
+static PFallocPage(fd,pagenum,pagebuf)
 int fd;		/* file descriptor */
 int *pagenum;	/* page number */
 char **pagebuf;	/* pointer to pointer to page buffer*/
@@ -622,7 +784,7 @@ int error;
 	return(PFE_OK);
 }
 
-PF_DisposePage(fd,pagenum)
+static PFdisposePage(fd,pagenum)
 int fd;		/* file descriptor */
 int pagenum;	/* page number */
 /****************************************************************************
@@ -674,7 +836,7 @@ int error;
 	return(PFbufUnfix(fd,pagenum,TRUE));
 }
 
-PF_UnfixPage(fd,pagenum,dirty)
+static PFunfixPage(fd,pagenum,dirty)
 int fd;	/* file descriptor */
 int pagenum;	/* page number */
 int dirty;	/* true if file is dirty */
@@ -754,10 +916,174 @@ RETURN VALUE: none
 }
 
 
-int PF_MarkDirty(int fd, int pagenum) {
+static int PFmarkDirty(int fd, int pagenum) {
     PFbpage *b;
     if ((b = PFhashFind(fd, pagenum)) == NULL)
         return (PFerrno = PFE_PAGENOTINBUF);
     b->dirty = TRUE;
     return PFE_OK;
-}
\ No newline at end of file
+}
+
+/****************** Latched Entry Points *****************************/
+/* Each entry point runs the routine of the same name above (see its
+SPECIFICATIONS) with PFlatch held. */
+
+PF_CreateFile(fname)
+char *fname;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFcreateFile(fname);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+PF_DestroyFile(fname)
+char *fname;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFdestroyFile(fname);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+PF_OpenFile(fname,strategy)
+char *fname;
+int strategy;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFopenFile(fname,strategy);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+PF_CloseFile(fd)
+int fd;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFcloseFile(fd);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+PF_GetFirstPage(fd,pagenum,pagebuf)
+int fd;
+int *pagenum;
+char **pagebuf;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFgetFirstPage(fd,pagenum,pagebuf);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+PF_GetNextPage(fd,pagenum,pagebuf)
+int fd;
+int *pagenum;
+char **pagebuf;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFgetNextPage(fd,pagenum,pagebuf);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+PF_GetThisPage(fd,pagenum,pagebuf)
+int fd;
+int pagenum;
+char **pagebuf;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFgetThisPage(fd,pagenum,pagebuf);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+PF_GetPages(fd,pagenums,n,pagebufs,errors)
+int fd;
+int *pagenums;
+int n;
+char **pagebufs;
+int *errors;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFgetPages(fd,pagenums,n,pagebufs,errors);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+PF_GetNumPages(fd)
+int fd;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFgetNumPages(fd);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+PF_AllocPage(fd,pagenum,pagebuf)
+int fd;
+int *pagenum;
+char **pagebuf;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFallocPage(fd,pagenum,pagebuf);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+PF_DisposePage(fd,pagenum)
+int fd;
+int pagenum;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFdisposePage(fd,pagenum);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+PF_UnfixPage(fd,pagenum,dirty)
+int fd;
+int pagenum;
+int dirty;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFunfixPage(fd,pagenum,dirty);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+int PF_MarkDirty(fd,pagenum)
+int fd;
+int pagenum;
+{
+int error;
+
+	pthread_mutex_lock(&PFlatch);
+	error = PFmarkDirty(fd,pagenum);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
@@ -43,3 +43,5 @@ extern int PFerrno;		/* error number of last error */
 extern void PF_Init(int numBuffers);
 extern void PF_PrintError();
 extern int PF_MarkDirty(int fd, int pagenum);
+extern int PF_GetPages();	/* PF_GetPages(fd,pagenums,n,pagebufs,errors) */
+extern int PF_GetNumPages();	/* PF_GetNumPages(fd) */
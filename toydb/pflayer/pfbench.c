@@ -0,0 +1,439 @@
+/* pfbench.c: configurable workload generator and benchmark driver for
+ * the PF buffer manager.
+ *
+ * Every run builds a fresh paged file, then issues a stream of page
+ * fix/unfix operations drawn from the chosen access distribution and
+ * prints one CSV line with throughput, hit ratio and latency
+ * percentiles.  Sweeps are done by calling the driver repeatedly, e.g.
+ *
+ *     ./pfbench -H > out.csv
+ *     for p in lru mru; do for b in 8 16 32; do
+ *         ./pfbench -p $p -b $b -d zipf -z 0.9 >> out.csv; done; done
+ *
+ * Options (defaults in brackets):
+ *     -b n      buffer pool size in pages                      [20]
+ *     -n n      file size in pages                             [100]
+ *     -o n      total number of operations                     [10000]
+ *     -r pct    percentage of operations that are reads        [70]
+ *     -d dist   uniform | zipf | seq | loop | hotcold          [uniform]
+ *     -z theta  Zipfian skew                                   [0.99]
+ *     -l n      loop length in pages for "loop"                [file size]
+ *     -h pct    hot set size, percent of file, for "hotcold"   [20]
+ *     -a pct    percent of accesses going to the hot set       [80]
+ *     -t n      number of client threads                       [1]
+ *     -B n      pages fixed per request with PF_GetPages()     [1]
+ *     -p strat  lru | mru                                      [lru]
+ *     -s seed   random seed                                    [7]
+ *     -f name   name of the paged file to use                  [pfbench.dat]
+ *     -H        print only the CSV header line and exit
+ *
+ * Every PF call takes the PF latch, but a page can only be fixed by one
+ * caller at a time, so client threads also serialize each fix/unfix
+ * pair on a latch of their own.  Latencies therefore include the time
+ * spent waiting for that latch.  With -B, every request fixes a
+ * batch of pages with one PF_GetPages() call; "ops" still counts page
+ * accesses while the latency percentiles are per request.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include "pf.h"
+#include "pftypes.h"
+
+#define BENCH_UNIFORM   0
+#define BENCH_ZIPF      1
+#define BENCH_SEQ       2
+#define BENCH_LOOP      3
+#define BENCH_HOTCOLD   4
+
+static char *distNames[] = { "uniform", "zipf", "seq", "loop", "hotcold" };
+
+/* benchmark configuration */
+static int    cfgBuffers  = 20;
+static int    cfgPages    = 100;
+static int    cfgOps      = 10000;
+static int    cfgReadPct  = 70;
+static int    cfgDist     = BENCH_UNIFORM;
+static double cfgTheta    = 0.99;
+static int    cfgLoopLen  = 0;
+static int    cfgHotPct   = 20;
+static int    cfgHotAcc   = 80;
+static int    cfgThreads  = 1;
+static int    cfgBatch    = 1;
+static int    cfgStrategy = PF_REPLACE_LRU;
+static unsigned long cfgSeed = 7;
+static char  *cfgFile     = "pfbench.dat";
+
+static double *zipfCdf = NULL;  /* cumulative Zipf probabilities */
+static int     benchFd;         /* PF file descriptor under test */
+static pthread_mutex_t benchLatch = PTHREAD_MUTEX_INITIALIZER;
+
+/* per-thread state */
+typedef struct BenchWorker {
+    pthread_t tid;
+    int id;
+    int nops;               /* operations issued by this thread */
+    unsigned long rng;      /* private generator state */
+    int cursor;             /* position for seq / loop */
+    double *lat;            /* latency of each request, in us */
+    int nlat;               /* # of requests issued */
+    int errors;
+} BenchWorker;
+
+/* timestamp in microseconds */
+static double now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+/* 32-bit xorshift generator, period 2^32 - 1 whatever the width of a
+   long; the state is never 0. rand() is shared and not thread-safe */
+static unsigned long bench_rand(state)
+unsigned long *state;
+{
+    unsigned long x = *state;
+
+    x ^= (x << 13) & 0xffffffffUL;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xffffffffUL;
+    return *state = x;
+}
+
+/* uniform double in [0,1) */
+static double bench_urand(state)
+unsigned long *state;
+{
+    return (double)(bench_rand(state) & 0xffffff) / (double)0x1000000;
+}
+
+static void zipf_init(n, theta)
+int n;
+double theta;
+{
+    int i;
+    double sum = 0.0;
+
+    zipfCdf = (double *)malloc(sizeof(double) * n);
+    if (zipfCdf == NULL) {
+        fprintf(stderr, "pfbench: no memory for zipf table\n");
+        exit(1);
+    }
+    for (i = 0; i < n; i++) {
+        sum += 1.0 / pow((double)(i + 1), theta);
+        zipfCdf[i] = sum;
+    }
+    for (i = 0; i < n; i++)
+        zipfCdf[i] /= sum;
+}
+
+static int zipf_next(w)
+BenchWorker *w;
+{
+    double u = bench_urand(&w->rng);
+    int lo = 0, hi = cfgPages - 1, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (zipfCdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* pick the next page according to the configured distribution */
+static int next_page(w)
+BenchWorker *w;
+{
+    int hot;
+
+    switch (cfgDist) {
+    case BENCH_ZIPF:
+        return zipf_next(w);
+    case BENCH_SEQ:
+        return (w->cursor++) % cfgPages;
+    case BENCH_LOOP:
+        return (w->cursor++) % cfgLoopLen;
+    case BENCH_HOTCOLD:
+        hot = (cfgPages * cfgHotPct) / 100;
+        if (hot < 1)
+            hot = 1;
+        if (hot >= cfgPages || (int)(bench_rand(&w->rng) % 100) < cfgHotAcc)
+            return bench_rand(&w->rng) % hot;
+        return hot + bench_rand(&w->rng) % (cfgPages - hot);
+    default:
+        return bench_rand(&w->rng) % cfgPages;
+    }
+}
+
+static void *bench_worker(arg)
+void *arg;
+{
+    BenchWorker *w = (BenchWorker *)arg;
+    int i, k, n, write, error;
+    int *pages, *errs;
+    char *buf, **bufs;
+    double t0;
+
+    pages = (int *)malloc(sizeof(int) * cfgBatch);
+    errs = (int *)malloc(sizeof(int) * cfgBatch);
+    bufs = (char **)malloc(sizeof(char *) * cfgBatch);
+    if (pages == NULL || errs == NULL || bufs == NULL) {
+        fprintf(stderr, "pfbench: no memory\n");
+        exit(1);
+    }
+
+    w->nlat = 0;
+    for (i = 0; i < w->nops; i += n) {
+        n = (w->nops - i < cfgBatch) ? w->nops - i : cfgBatch;
+        for (k = 0; k < n; k++)
+            pages[k] = next_page(w);
+        write = (int)(bench_rand(&w->rng) % 100) >= cfgReadPct;
+
+        t0 = now_us();
+        pthread_mutex_lock(&benchLatch);
+        if (cfgBatch == 1) {
+            error = PF_GetThisPage(benchFd, pages[0], &buf);
+            if (error == PFE_OK) {
+                if (write)
+                    buf[w->id % PF_PAGE_SIZE] = (char)i;
+                error = PF_UnfixPage(benchFd, pages[0], write);
+            }
+            if (error != PFE_OK)
+                w->errors++;
+        }
+        else {
+            PF_GetPages(benchFd, pages, n, bufs, errs);
+            for (k = 0; k < n; k++) {
+                if (errs[k] == PFE_PAGEFIXED)
+                    continue;   /* page listed twice in the batch */
+                if (errs[k] != PFE_OK) {
+                    w->errors++;
+                    continue;
+                }
+                if (write)
+                    bufs[k][w->id % PF_PAGE_SIZE] = (char)i;
+                if (PF_UnfixPage(benchFd, pages[k], write) != PFE_OK)
+                    w->errors++;
+            }
+        }
+        pthread_mutex_unlock(&benchLatch);
+        w->lat[w->nlat++] = now_us() - t0;
+    }
+
+    free(pages);
+    free(errs);
+    free(bufs);
+    return NULL;
+}
+
+static int cmp_double(a, b)
+const void *a;
+const void *b;
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x < y) ? -1 : (x > y);
+}
+
+static double percentile(sorted, n, pct)
+double *sorted;
+int n;
+double pct;
+{
+    int idx;
+
+    if (n == 0)
+        return 0.0;
+    idx = (int)(pct / 100.0 * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+/* create the test file with cfgPages pages, then reopen it cold */
+static int setup_file()
+{
+    int i, page, error;
+    char *buf;
+
+    PF_DestroyFile(cfgFile);
+    if ((error = PF_CreateFile(cfgFile)) != PFE_OK)
+        return error;
+    if ((benchFd = PF_OpenFile(cfgFile, cfgStrategy)) < 0)
+        return benchFd;
+    for (i = 0; i < cfgPages; i++) {
+        if ((error = PF_AllocPage(benchFd, &page, &buf)) != PFE_OK)
+            return error;
+        memset(buf, 0, PF_PAGE_SIZE);
+        if ((error = PF_UnfixPage(benchFd, page, TRUE)) != PFE_OK)
+            return error;
+    }
+    if ((error = PF_CloseFile(benchFd)) != PFE_OK)
+        return error;
+    if ((benchFd = PF_OpenFile(cfgFile, cfgStrategy)) < 0)
+        return benchFd;
+    return PFE_OK;
+}
+
+static void print_header()
+{
+    printf("strategy,buffers,pages,ops,read_pct,dist,skew,threads,batch,"
+           "elapsed_ms,ops_per_sec,logical_reads,physical_reads,"
+           "logical_writes,physical_writes,hit_ratio,"
+           "p50_us,p90_us,p99_us,max_us,errors\n");
+}
+
+static void usage(prog)
+char *prog;
+{
+    fprintf(stderr,
+        "usage: %s [-b bufs] [-n pages] [-o ops] [-r readpct]\n"
+        "          [-d uniform|zipf|seq|loop|hotcold] [-z theta] [-l looplen]\n"
+        "          [-h hotpct] [-a hotaccpct] [-t threads] [-B batch]\n"
+        "          [-p lru|mru] [-s seed] [-f file] [-H]\n", prog);
+    exit(2);
+}
+
+int main(argc, argv)
+int argc;
+char **argv;
+{
+    BenchWorker *workers;
+    double *all, t0, elapsed, hit, skew;
+    int i, j, k, error, total, nops, errors;
+
+    for (i = 1; i < argc; i++) {
+        char *opt = argv[i];
+
+        if (strcmp(opt, "-H") == 0) {
+            print_header();
+            return 0;
+        }
+        if (opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0' || i + 1 >= argc)
+            usage(argv[0]);
+        ++i;
+        switch (opt[1]) {
+        case 'b': cfgBuffers = atoi(argv[i]); break;
+        case 'n': cfgPages = atoi(argv[i]); break;
+        case 'o': cfgOps = atoi(argv[i]); break;
+        case 'r': cfgReadPct = atoi(argv[i]); break;
+        case 'z': cfgTheta = atof(argv[i]); break;
+        case 'l': cfgLoopLen = atoi(argv[i]); break;
+        case 'h': cfgHotPct = atoi(argv[i]); break;
+        case 'a': cfgHotAcc = atoi(argv[i]); break;
+        case 't': cfgThreads = atoi(argv[i]); break;
+        case 'B': cfgBatch = atoi(argv[i]); break;
+        case 's': cfgSeed = strtoul(argv[i], NULL, 10); break;
+        case 'f': cfgFile = argv[i]; break;
+        case 'p':
+            if (strcmp(argv[i], "lru") == 0)
+                cfgStrategy = PF_REPLACE_LRU;
+            else if (strcmp(argv[i], "mru") == 0)
+                cfgStrategy = PF_REPLACE_MRU;
+            else
+                usage(argv[0]);
+            break;
+        case 'd':
+            for (k = 0; k < 5; k++)
+                if (strcmp(argv[i], distNames[k]) == 0)
+                    break;
+            if (k == 5)
+                usage(argv[0]);
+            cfgDist = k;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (cfgBuffers < 1 || cfgPages < 1 || cfgOps < 0 || cfgThreads < 1
+        || cfgBatch < 1        || cfgReadPct < 0 || cfgReadPct > 100)
+        usage(argv[0]);
+    if (cfgLoopLen <= 0 || cfgLoopLen > cfgPages)
+        cfgLoopLen = cfgPages;
+    if (cfgDist == BENCH_ZIPF)
+        zipf_init(cfgPages, cfgTheta);
+
+    PF_Init(cfgBuffers);
+    if ((error = setup_file()) != PFE_OK) {
+        PF_PrintError("pfbench: setup");
+        return 1;
+    }
+
+    workers = (BenchWorker *)malloc(sizeof(BenchWorker) * cfgThreads);
+    all = (double *)malloc(sizeof(double) * (cfgOps + 1));
+    if (workers == NULL || all == NULL) {
+        fprintf(stderr, "pfbench: no memory\n");
+        return 1;
+    }
+    for (i = 0; i < cfgThreads; i++) {
+        workers[i].id = i;
+        workers[i].nops = cfgOps / cfgThreads + (i < cfgOps % cfgThreads);
+        workers[i].rng = ((cfgSeed + 1) * 2654435761UL + (unsigned long)i * 40503UL)
+                         & 0xffffffffUL;
+        if (workers[i].rng == 0)
+            workers[i].rng = 1;
+        /* spread sequential clients over the file */
+        workers[i].cursor = (int)(((long)cfgPages * i) / cfgThreads);
+        workers[i].errors = 0;
+        workers[i].lat = (double *)malloc(sizeof(double) * (workers[i].nops + 1));
+        if (workers[i].lat == NULL) {
+            fprintf(stderr, "pfbench: no memory\n");
+            return 1;
+        }
+    }
+
+    PFbufStatsInit();
+    t0 = now_us();
+    for (i = 0; i < cfgThreads; i++)
+        pthread_create(&workers[i].tid, NULL, bench_worker, &workers[i]);
+    for (i = 0; i < cfgThreads; i++)
+        pthread_join(workers[i].tid, NULL);
+    elapsed = now_us() - t0;
+
+    total = 0;
+    nops = 0;
+    errors = 0;
+    for (i = 0; i < cfgThreads; i++) {
+        for (j = 0; j < workers[i].nlat; j++)
+            all[total++] = workers[i].lat[j];
+        nops += workers[i].nops;
+        errors += workers[i].errors;
+    }
+    qsort(all, total, sizeof(double), cmp_double);
+
+    hit = (PF_logicalReads > 0)
+        ? 1.0 - (double)PF_physicalReads / (double)PF_logicalReads : 0.0;
+    skew = (cfgDist == BENCH_ZIPF) ? cfgTheta
+         : (cfgDist == BENCH_HOTCOLD) ? (double)cfgHotAcc / 100.0 : 0.0;
+
+    printf("%s,%d,%d,%d,%d,%s,%.2f,%d,%d,%.3f,%.0f,%d,%d,%d,%d,%.4f,"
+           "%.2f,%.2f,%.2f,%.2f,%d\n",
+           (cfgStrategy == PF_REPLACE_LRU ? "LRU" : "MRU"),
+           cfgBuffers, cfgPages, nops, cfgReadPct, distNames[cfgDist],
+           skew, cfgThreads, cfgBatch, elapsed / 1000.0,
+           (elapsed > 0.0) ? nops / (elapsed / 1e6) : 0.0,
+           PF_logicalReads, PF_physicalReads,
+           PF_logicalWrites, PF_physicalWrites, hit,
+           percentile(all, total, 50.0), percentile(all, total, 90.0),
+           percentile(all, total, 99.0),
+           (total > 0) ? all[total - 1] : 0.0, errors);
+
+    PF_CloseFile(benchFd);
+    PF_DestroyFile(cfgFile);
+
+    for (i = 0; i < cfgThreads; i++)
+        free(workers[i].lat);
+    free(workers);
+    free(all);
+    if (zipfCdf != NULL)
+        free(zipfCdf);
+    return 0;
+}
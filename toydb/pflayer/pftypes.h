@@ -26,7 +26,7 @@ typedef struct PFfpage {
 } PFfpage;
 
 /*************************** Opened File Table **********************/
-#define PF_FTAB_SIZE	20	/* size of open file table */
+#define PF_FTAB_SIZE	32	/* size of open file table */
 
 /* open file table entry */
 typedef struct PFftab_ele {
@@ -39,6 +39,7 @@ typedef struct PFftab_ele {
 extern PFftab_ele PFftab[];
 /************************** Buffer Page Decls *********************/
 #define PF_MAX_BUFS	20	/* max # of buffers */
+#define PF_MAX_IOV	64	/* max # of pages read by one vectored read */
 
 /* buffer page decl */
 typedef struct PFbpage {
@@ -82,6 +83,7 @@ extern PFbufGet();
 extern PFbufUnfix();
 extern PFbufalloc();
 extern PFbufReleaseFile();
+extern PFbufGetBatch();
 
 /****************** New Interface functions from Buffer Manager *************/
 extern void PFbufInit(int numBuffers);
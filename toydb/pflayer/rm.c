@@ -1,6 +1,10 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "rm.h"
 #include "pf.h"
@@ -10,6 +14,33 @@
 
 #define RM_PAGE_HDR_SIZE   sizeof(struct RM_PageHdr)
 #define RM_SLOT_SIZE       sizeof(struct RM_Slot)
+#define RM_SLOT_LEN(slot)  ((slot)->length & RM_SLOT_LENMASK)
+#define RM_RID_SIZE        ((int) sizeof(RID))
+
+/* largest record that fits in an empty data page */
+#define RM_MAX_RECORD      ((int)(PF_PAGE_SIZE - RM_PAGE_HDR_SIZE - RM_SLOT_SIZE))
+
+/* longest record kept whole in its slot; longer ones get overflow pages */
+#define RM_INLINE_MAX      (RM_MAX_RECORD - RM_RID_SIZE)
+#define RM_OVFL_STUB_SIZE  ((int) sizeof(struct RM_OvflStub) + RM_OVFL_PREFIX)
+#define RM_OVFL_PAGE_DATA  ((int) (PF_PAGE_SIZE - sizeof(struct RM_OvflPageHdr)))
+
+/* pages per morsel of a parallel scan when none is given */
+#define RM_MORSEL_PAGES    16
+
+/* sampled pages read together by RM_SamplePages() */
+#define RM_SAMPLE_BATCH    16
+
+/* home pages fixed together by RM_FetchRIDs() */
+#define RM_FETCH_BATCH     16
+
+/* largest tuple rebuilt from a PAX page */
+#define RM_PAX_TUPLE_MAX   (PF_PAGE_SIZE + (RM_MAX_ATTRS + 7) / 8 \
+                            + (RM_MAX_ATTRS + 1) * (int) sizeof(unsigned short))
+
+/* how far past the first record that does not fit RM_InsertRecords()
+   looks for smaller records to fill the rest of a page */
+#define RM_BULK_LOOKAHEAD  32
 
 /*************** INTERNAL FUNCTIONS *****************/
 
@@ -19,9 +50,12 @@ char *pagebuf;
     struct RM_PageHdr *hdr;
 
     hdr = (struct RM_PageHdr *) pagebuf;
+    hdr->pageType  = RM_PAGE_DATA;
     hdr->freeStart = sizeof(struct RM_PageHdr);
     hdr->freeEnd   = PF_PAGE_SIZE;
     hdr->numSlots  = 0;
+    hdr->freeSlots = 0;
+    hdr->deadBytes = 0;
 
     return PFE_OK;
 }
@@ -41,12 +75,551 @@ int slotno;
     return (struct RM_Slot *)( base + PF_PAGE_SIZE - (slotno+1)*RM_SLOT_SIZE );
 }
 
+static int rm_IsDataPage(pagebuf)
+char *pagebuf;
+{
+    return pagebuf[0] == RM_PAGE_DATA;
+}
+
+static int rm_IsPaxPage(pagebuf)
+char *pagebuf;
+{
+    return pagebuf[0] == RM_PAGE_PAX;
+}
+
+/* Bytes an insert can use on the page for its record and slot: the
+   contiguous gap, the space of deleted records (reclaimed by compaction)
+   and a deleted slot if one can be reused. */
+static int rm_PageFreeBytes(pagebuf)
+char *pagebuf;
+{
+    struct RM_PageHdr *hdr = rm_GetHdr(pagebuf);
+    return hdr->freeEnd - hdr->freeStart + hdr->deadBytes
+           + (hdr->freeSlots > 0 ? RM_SLOT_SIZE : 0);
+}
+
+/* Slide the live records of a page together right after the header so
+   that the space of deleted records becomes one contiguous gap. Slot
+   numbers, and so RIDs, do not change. */
+static void rm_CompactPage(pagebuf)
+char *pagebuf;
+{
+    struct RM_PageHdr *hdr = rm_GetHdr(pagebuf);
+    struct RM_Slot *slot;
+    char old[PF_PAGE_SIZE];
+    int s, off;
+
+    memcpy(old, pagebuf, hdr->freeStart);
+    off = RM_PAGE_HDR_SIZE;
+    for (s = 0; s < hdr->numSlots; s++) {
+        slot = rm_GetSlot(pagebuf, s);
+        if (slot->offset == -1)
+            continue;
+        memcpy(pagebuf + off, old + slot->offset, RM_SLOT_LEN(slot));
+        slot->offset = off;
+        off += RM_SLOT_LEN(slot);
+    }
+    hdr->freeStart = off;
+    hdr->deadBytes = 0;
+}
+
+/* Store "rec" on a data page known to have room (rm_PageFreeBytes());
+   returns its slot. A deleted slot is reused before a new one is added,
+   and the page is compacted if the contiguous gap is too small. */
+static int rm_PlaceRecord(pagebuf, rec)
+char *pagebuf;
+RM_Record *rec;
+{
+    struct RM_PageHdr *hdr = rm_GetHdr(pagebuf);
+    struct RM_Slot *slot;
+    int s, slotBytes;
+
+    /* pick a slot */
+    if (hdr->freeSlots > 0) {
+        for (s = 0; rm_GetSlot(pagebuf, s)->offset != -1; s++)
+            ;
+        slotBytes = 0;
+    } else {
+        s = hdr->numSlots;
+        slotBytes = RM_SLOT_SIZE;
+    }
+
+    if (hdr->freeEnd - hdr->freeStart - slotBytes < rec->length)
+        rm_CompactPage(pagebuf);
+
+    if (slotBytes > 0) {
+        hdr->numSlots++;
+        hdr->freeEnd -= RM_SLOT_SIZE;
+    } else {
+        hdr->freeSlots--;
+    }
+
+    slot = rm_GetSlot(pagebuf, s);
+    slot->offset = hdr->freeStart;
+    slot->length = rec->length;
+
+    /* copy record */
+    memcpy(pagebuf + hdr->freeStart, rec->data, rec->length);
+    hdr->freeStart += rec->length;
+
+    return s;
+}
+
+/* Give the data bytes of slot "s" from byte "keep" on back to the page:
+   at once if they end the data area, else at the next compaction. */
+static void rm_ReleaseBytes(pagebuf, s, keep)
+char *pagebuf;
+int s;
+int keep;
+{
+    struct RM_PageHdr *hdr = rm_GetHdr(pagebuf);
+    struct RM_Slot *slot = rm_GetSlot(pagebuf, s);
+    int len = RM_SLOT_LEN(slot);
+
+    if (slot->offset + len == hdr->freeStart)
+        hdr->freeStart -= len - keep;
+    else
+        hdr->deadBytes += len - keep;
+}
+
+/* delete slot "s"; trailing deleted slots go back to the free gap */
+static void rm_FreeSlot(pagebuf, s)
+char *pagebuf;
+int s;
+{
+    struct RM_PageHdr *hdr = rm_GetHdr(pagebuf);
+    struct RM_Slot *slot = rm_GetSlot(pagebuf, s);
+
+    rm_ReleaseBytes(pagebuf, s, 0);
+    slot->offset = -1; /* mark deleted */
+    slot->length = 0;
+    hdr->freeSlots++;
+
+    while (hdr->numSlots > 0
+           && rm_GetSlot(pagebuf, hdr->numSlots - 1)->offset == -1) {
+        hdr->numSlots--;
+        hdr->freeSlots--;
+        hdr->freeEnd += RM_SLOT_SIZE;
+    }
+}
+
+/* can the data of live slot "s" be replaced by "len" bytes in the page? */
+static int rm_HasRoom(pagebuf, s, len)
+char *pagebuf;
+int s;
+int len;
+{
+    struct RM_PageHdr *hdr = rm_GetHdr(pagebuf);
+
+    return hdr->freeEnd - hdr->freeStart + hdr->deadBytes
+           + RM_SLOT_LEN(rm_GetSlot(pagebuf, s)) >= len;
+}
+
+/* Replace the data of live slot "s" by "len" bytes (after rm_HasRoom())
+   and set the slot flags. Data that does not grow is overwritten in
+   place; larger data is written to the free gap, compacting if needed. */
+static void rm_RewriteSlot(pagebuf, s, data, len, flags)
+char *pagebuf;
+int s;
+char *data;
+int len;
+int flags;
+{
+    struct RM_PageHdr *hdr = rm_GetHdr(pagebuf);
+    struct RM_Slot *slot = rm_GetSlot(pagebuf, s);
+
+    if (len <= RM_SLOT_LEN(slot)) {
+        rm_ReleaseBytes(pagebuf, s, len);
+    } else {
+        rm_ReleaseBytes(pagebuf, s, 0);
+        slot->offset = -1;      /* keep compaction off the old bytes */
+        if (hdr->freeEnd - hdr->freeStart < len)
+            rm_CompactPage(pagebuf);
+        slot->offset = hdr->freeStart;
+        hdr->freeStart += len;
+    }
+    memcpy(pagebuf + slot->offset, data, len);
+    slot->length = len | flags;
+}
+
+/*************** FREE-SPACE MAP *****************/
+
+#define RM_FSM_GROUP (RM_FSM_SPAN + 1)   /* FSM page + the pages it covers */
+
+static int rm_IsFsmPageNum(page)
+int page;
+{
+    return page >= 1 && (page - 1) % RM_FSM_GROUP == 0;
+}
+
+/* FSM page covering data page "page" */
+static int rm_FsmPageOf(page)
+int page;
+{
+    return 1 + ((page - 1) / RM_FSM_GROUP) * RM_FSM_GROUP;
+}
+
+/* Lower bound, in bytes, of each free-space class. Classes are finer at
+   the low end so that nearly full pages stay usable for small records. */
+static int rm_FsmBound[RM_FSM_CLASSES] = {
+    0, 16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072
+};
+
+/* class of a page with "freeBytes" bytes free */
+static int rm_FsmClass(freeBytes)
+int freeBytes;
+{
+    int c = RM_FSM_CLASSES - 1;
+
+    while (c > 0 && rm_FsmBound[c] > freeBytes)
+        c--;
+    return c;
+}
+
+/* smallest class guaranteed to hold "need" bytes (capped: pages of the
+   top class must still be checked) */
+static int rm_FsmNeedClass(need)
+int need;
+{
+    int c = 0;
+
+    while (c < RM_FSM_CLASSES - 1 && rm_FsmBound[c] < need)
+        c++;
+    return c;
+}
+
+static int rm_FsmGetEntry(fsmbuf, idx)
+char *fsmbuf;
+int idx;
+{
+    unsigned char b = (unsigned char) fsmbuf[RM_FSM_HDR_SIZE + idx / 2];
+    return (idx & 1) ? (b >> 4) : (b & 0x0f);
+}
+
+static void rm_FsmSetEntry(fsmbuf, idx, c)
+char *fsmbuf;
+int idx;
+int c;
+{
+    unsigned char *b = (unsigned char *) fsmbuf + RM_FSM_HDR_SIZE + idx / 2;
+    if (idx & 1)
+        *b = (unsigned char) ((*b & 0x0f) | (c << 4));
+    else
+        *b = (unsigned char) ((*b & 0xf0) | c);
+}
+
+static void rm_InitFsmPage(pagebuf)
+char *pagebuf;
+{
+    memset(pagebuf, 0, PF_PAGE_SIZE);
+    pagebuf[0] = RM_PAGE_FSM;
+}
+
+/* record the free space left on data page "page" in the FSM */
+static int rm_FsmUpdate(fh, page, pagebuf)
+RM_FileHandle *fh;
+int page;
+char *pagebuf;
+{
+    int fsmPage = rm_FsmPageOf(page);
+    int idx = page - fsmPage - 1;
+    int c = rm_FsmClass(rm_PageFreeBytes(pagebuf));
+    char *fsmbuf;
+    int error;
+
+    if ((error = PF_GetThisPage(fh->fd, fsmPage, &fsmbuf)) != PFE_OK)
+        return error;
+    if (rm_FsmGetEntry(fsmbuf, idx) == c)
+        return PF_UnfixPage(fh->fd, fsmPage, FALSE);
+    rm_FsmSetEntry(fsmbuf, idx, c);
+    return PF_UnfixPage(fh->fd, fsmPage, TRUE);
+}
+
+/* Allocate and initialize a new data page, creating the FSM page of a
+   new group on the way when its position comes up. */
+static int rm_AllocDataPage(fh, page, pagebuf)
+RM_FileHandle *fh;
+int *page;
+char **pagebuf;
+{
+    int error;
+
+    while (1) {
+        if ((error = PF_AllocPage(fh->fd, page, pagebuf)) != PFE_OK)
+            return error;
+        if (!rm_IsFsmPageNum(*page))
+            break;
+        rm_InitFsmPage(*pagebuf);
+        if ((error = PF_UnfixPage(fh->fd, *page, TRUE)) != PFE_OK)
+            return error;
+    }
+    rm_InitSlottedPage(*pagebuf);
+    return PFE_OK;
+}
+
+/* Allocate a page for another page type of the file (rmdict.c); it
+   comes fixed, as an empty data page the caller reinitializes. */
+int RMallocPage(fh, page, pagebuf)
+RM_FileHandle *fh;
+int *page;
+char **pagebuf;
+{
+    return rm_AllocDataPage(fh, page, pagebuf);
+}
+
+/* fix "page" if it really has "need" bytes free */
+static int rm_TryPage(fh, page, need, pagebuf)
+RM_FileHandle *fh;
+int page;
+int need;
+char **pagebuf;
+{
+    if (PF_GetThisPage(fh->fd, page, pagebuf) != PFE_OK)
+        return FALSE;
+    if (rm_IsDataPage(*pagebuf) && rm_PageFreeBytes(*pagebuf) >= need)
+        return TRUE;
+    PF_UnfixPage(fh->fd, page, FALSE);
+    return FALSE;
+}
+
+/* Find a data page with "need" free bytes through the FSM and fix it.
+   A new page is allocated when no page has room. */
+static int rm_FindPage(fh, need, page, pagebuf)
+RM_FileHandle *fh;
+int need;
+int *page;
+char **pagebuf;
+{
+    int numPages = PF_GetNumPages(fh->fd);
+    int want = rm_FsmNeedClass(need);
+    int fsmPage, idx, last, cand;
+    char *fsmbuf;
+
+    /* the page of the last insert is the most likely to have room */
+    if (fh->lastPage > 0 && fh->lastPage < numPages
+        && rm_TryPage(fh, fh->lastPage, need, pagebuf)) {
+        *page = fh->lastPage;
+        return PFE_OK;
+    }
+
+    for (fsmPage = 1; fsmPage < numPages; fsmPage += RM_FSM_GROUP) {
+        last = numPages - fsmPage - 1;
+        if (last > RM_FSM_SPAN)
+            last = RM_FSM_SPAN;
+        for (idx = 0; idx < last; idx++) {
+            if (PF_GetThisPage(fh->fd, fsmPage, &fsmbuf) != PFE_OK)
+                break;
+            while (idx < last && rm_FsmGetEntry(fsmbuf, idx) < want)
+                idx++;
+            PF_UnfixPage(fh->fd, fsmPage, FALSE);
+            if (idx == last)
+                break;
+            cand = fsmPage + 1 + idx;
+            if (cand != fh->lastPage && rm_TryPage(fh, cand, need, pagebuf)) {
+                *page = cand;
+                return PFE_OK;
+            }
+        }
+    }
+
+    return rm_AllocDataPage(fh, page, pagebuf);
+}
+
+/* check that "rid" names a live record by its home slot on "pagebuf" */
+static int rm_CheckHome(pagebuf, rid)
+char *pagebuf;
+RID *rid;
+{
+    if (!rm_IsDataPage(pagebuf) || rid->slot < 0
+        || rid->slot >= rm_GetHdr(pagebuf)->numSlots
+        || (rm_GetSlot(pagebuf, rid->slot)->length & RM_SLOT_MOVED)) {
+        PFerrno = PFE_INVALIDPAGE;
+        return PFerrno;
+    }
+    if (rm_GetSlot(pagebuf, rid->slot)->offset == -1) {
+        /* already deleted */
+        PFerrno = PFE_PAGEFREE;
+        return PFerrno;
+    }
+    return PFE_OK;
+}
+
+/* Fix the page of "rid" and check that the RID names a live record by
+   its home slot. The page is left unfixed on error. */
+static int rm_FixHome(fh, rid, pagebuf)
+RM_FileHandle *fh;
+RID *rid;
+char **pagebuf;
+{
+    int error;
+
+    if ((error = PF_GetThisPage(fh->fd, rid->page, pagebuf)) != PFE_OK)
+        return error;
+    if ((error = rm_CheckHome(*pagebuf, rid)) != PFE_OK)
+        PF_UnfixPage(fh->fd, rid->page, FALSE);
+    return error;
+}
+
+/*************** OVERFLOW RECORDS *****************/
+
+static int rm_OvflLength(stub)
+char *stub;
+{
+    struct RM_OvflStub st;
+
+    memcpy((char *) &st, stub, sizeof(st));
+    return st.length;
+}
+
+static int rm_OvflFirst(stub)
+char *stub;
+{
+    struct RM_OvflStub st;
+
+    memcpy((char *) &st, stub, sizeof(st));
+    return st.first;
+}
+
+/* Give the pages of the overflow chain starting at "page" back to the
+   PF free list. */
+static int rm_OvflFree(fh, page)
+RM_FileHandle *fh;
+int page;
+{
+    char *pagebuf;
+    int next, error;
+
+    while (page > 0) {
+        if ((error = PF_GetThisPage(fh->fd, page, &pagebuf)) != PFE_OK)
+            return error;
+        next = (pagebuf[0] == RM_PAGE_OVERFLOW)
+               ? ((struct RM_OvflPageHdr *) pagebuf)->next : 0;
+        PF_UnfixPage(fh->fd, page, FALSE);
+        if ((error = PF_DisposePage(fh->fd, page)) != PFE_OK)
+            return error;
+        page = next;
+    }
+    return PFE_OK;
+}
+
+/* Write the "len" bytes of "data" past the prefix to a new overflow
+   chain and build the stub of the record in "stub" (RM_OVFL_STUB_SIZE
+   bytes). Pages are allocated in chain order, two fixed at a time. */
+static int rm_OvflWrite(fh, data, len, stub)
+RM_FileHandle *fh;
+char *data;
+int len;
+char *stub;
+{
+    struct RM_OvflStub st;
+    struct RM_OvflPageHdr *ohdr;
+    char *pagebuf, *nextbuf;
+    int page, next, pos, n, error;
+
+    if ((error = rm_AllocDataPage(fh, &page, &pagebuf)) != PFE_OK)
+        return error;
+    st.length = len;
+    st.first = page;
+    for (pos = RM_OVFL_PREFIX; ; page = next, pagebuf = nextbuf) {
+        n = len - pos;
+        if (n > RM_OVFL_PAGE_DATA)
+            n = RM_OVFL_PAGE_DATA;
+        ohdr = (struct RM_OvflPageHdr *) pagebuf;
+        ohdr->pageType = RM_PAGE_OVERFLOW;
+        ohdr->next = 0;
+        ohdr->used = n;
+        memcpy(pagebuf + sizeof(struct RM_OvflPageHdr), data + pos, n);
+        pos += n;
+        if (pos < len
+            && (error = rm_AllocDataPage(fh, &next, &nextbuf)) != PFE_OK) {
+            PF_UnfixPage(fh->fd, page, TRUE);
+            rm_OvflFree(fh, st.first);
+            return error;
+        }
+        if (pos < len)
+            ohdr->next = next;
+        PF_UnfixPage(fh->fd, page, TRUE);
+        if (pos >= len)
+            break;
+    }
+
+    memcpy(stub, (char *) &st, sizeof(st));
+    memcpy(stub + sizeof(st), data, RM_OVFL_PREFIX);
+    return PFE_OK;
+}
+
+/* Assemble the record of overflow stub "stub" in *buf, which is grown
+   to hold it (*size bytes allocated), and set *len to its length. With
+   "wait", a chain page another thread holds is waited for. */
+static int rm_OvflFetch(fd, stub, buf, size, len, wait)
+int fd;
+char *stub;
+char **buf;
+int *size;
+int *len;
+int wait;
+{
+    struct RM_OvflPageHdr *ohdr;
+    char *pagebuf, *nbuf;
+    int page, next, pos, error;
+
+    *len = rm_OvflLength(stub);
+    if (*len > *size) {
+        if ((nbuf = (char *) realloc(*buf, *len)) == NULL) {
+            PFerrno = PFE_NOMEM;
+            return PFerrno;
+        }
+        *buf = nbuf;
+        *size = *len;
+    }
+    memcpy(*buf, stub + sizeof(struct RM_OvflStub), RM_OVFL_PREFIX);
+
+    for (pos = RM_OVFL_PREFIX, page = rm_OvflFirst(stub); pos < *len; page = next) {
+        while ((error = PF_GetThisPage(fd, page, &pagebuf)) == PFE_PAGEFIXED && wait)
+            sched_yield();
+        if (error != PFE_OK)
+            return error;
+        ohdr = (struct RM_OvflPageHdr *) pagebuf;
+        if (pagebuf[0] != RM_PAGE_OVERFLOW || ohdr->used > *len - pos) {
+            PF_UnfixPage(fd, page, FALSE);
+            PFerrno = PFE_INVALIDPAGE;
+            return PFerrno;
+        }
+        memcpy(*buf + pos, pagebuf + sizeof(struct RM_OvflPageHdr), ohdr->used);
+        pos += ohdr->used;
+        next = ohdr->next;
+        PF_UnfixPage(fd, page, FALSE);
+    }
+    return PFE_OK;
+}
+
 /*************** PUBLIC RM FUNCTIONS ****************/
 
+/* Create an RM file: a paged file whose page 0 is the RM header */
 int RM_CreateFile(fname)
 char *fname;
 {
-    return PF_CreateFile(fname);
+    struct RM_FileHdr *fhdr;
+    char *pagebuf;
+    int fd, page, error;
+
+    if ((error = PF_CreateFile(fname)) != PFE_OK)
+        return error;
+    if ((fd = PF_OpenFile(fname, PF_REPLACE_LRU)) < 0)
+        return fd;
+    if ((error = PF_AllocPage(fd, &page, &pagebuf)) != PFE_OK) {
+        PF_CloseFile(fd);
+        return error;
+    }
+    memset(pagebuf, 0, PF_PAGE_SIZE);
+    fhdr = (struct RM_FileHdr *) pagebuf;
+    fhdr->pageType = RM_PAGE_FILEHDR;
+    fhdr->magic = RM_FILE_MAGIC;
+    if ((error = PF_UnfixPage(fd, page, TRUE)) != PFE_OK) {
+        PF_CloseFile(fd);
+        return error;
+    }
+    return PF_CloseFile(fd);
 }
 
 int RM_DestroyFile(fname)
@@ -59,16 +632,43 @@ int RM_OpenFile(fname, fh)
 char *fname;
 RM_FileHandle *fh;
 {
-    int fd;
+    struct RM_FileHdr *fhdr;
+    int fd, error, magic;
+    char *pagebuf;
+
     fd = PF_OpenFile(fname, PF_REPLACE_LRU);
     if (fd < 0)
         return fd;
     fh->fd = fd;
 
+    /* check the RM header page */
+    if ((error = PF_GetThisPage(fd, 0, &pagebuf)) != PFE_OK) {
+        PF_CloseFile(fd);
+        return (error == PFE_INVALIDPAGE) ? RME_NOTRMFILE : error;
+    }
+    fhdr = (struct RM_FileHdr *) pagebuf;
+    magic = fhdr->magic;
+    fh->format = fhdr->format;
+    if (fhdr->hasSchema)
+        memcpy((char *) &fh->schema, (char *) &fhdr->schema, sizeof(RM_Schema));
+    else
+        memset((char *) &fh->schema, 0, sizeof(RM_Schema));
+    PF_UnfixPage(fd, 0, FALSE);
+    if (pagebuf[0] != RM_PAGE_FILEHDR || magic != RM_FILE_MAGIC) {
+        PF_CloseFile(fd);
+        return RME_NOTRMFILE;
+    }
+    if ((error = RMdictLoad(fh)) != PFE_OK) {
+        RMdictFree(fh);
+        PF_CloseFile(fd);
+        return error;
+    }
+
     /* initialize RM metrics */
     fh->totalRecords = 0;
     fh->totalDeleted = 0;
     fh->totalPayloadBytes = 0;
+    fh->lastPage = -1;
 
     return PFE_OK;
 }
@@ -76,155 +676,1405 @@ RM_FileHandle *fh;
 int RM_CloseFile(fh)
 RM_FileHandle *fh;
 {
-    return PF_CloseFile(fh->fd);
+    RMdictFree(fh);
+    return PF_CloseFile(fh->fd);
+}
+
+/* Record "schema" in the header page as the format of the file's
+   records. Slotted pages still treat records as bytes; the pages of a
+   PAX file are laid out by the schema, which is then fixed once the
+   file holds records. Dictionary attributes start with empty
+   dictionaries. */
+int RM_SetSchema(fh, schema)
+RM_FileHandle *fh;
+RM_Schema *schema;
+{
+    struct RM_FileHdr *fhdr;
+    char *pagebuf;
+    int error;
+
+    if (fh->format == RM_FORMAT_PAX && PF_GetNumPages(fh->fd) > 1)
+        return RME_NOTEMPTY;
+    if ((error = PF_GetThisPage(fh->fd, 0, &pagebuf)) != PFE_OK)
+        return error;
+    fhdr = (struct RM_FileHdr *) pagebuf;
+    fhdr->hasSchema = TRUE;
+    memcpy((char *) &fhdr->schema, (char *) schema, sizeof(RM_Schema));
+    memset((char *) fhdr->dictPage, 0, sizeof(fhdr->dictPage));
+    if ((error = PF_UnfixPage(fh->fd, 0, TRUE)) != PFE_OK)
+        return error;
+    RMdictFree(fh);
+    memcpy((char *) &fh->schema, (char *) schema, sizeof(RM_Schema));
+    return RMdictLoad(fh);
+}
+
+int RM_GetSchema(fh, schema)
+RM_FileHandle *fh;
+RM_Schema *schema;
+{
+    struct RM_FileHdr *fhdr;
+    char *pagebuf;
+    int error;
+
+    if ((error = PF_GetThisPage(fh->fd, 0, &pagebuf)) != PFE_OK)
+        return error;
+    fhdr = (struct RM_FileHdr *) pagebuf;
+    error = fhdr->hasSchema ? PFE_OK : RME_NOSCHEMA;
+    if (error == PFE_OK)
+        memcpy((char *) schema, (char *) &fhdr->schema, sizeof(RM_Schema));
+    PF_UnfixPage(fh->fd, 0, FALSE);
+    return error;
+}
+
+/* Choose the page format of the file's records (RM_FORMAT_*). This is
+   only possible while the file has no data pages. A PAX file needs a
+   schema; its records must be tuples of the schema (rmtuple.c).
+
+   RETURN VALUE: PFE_OK, RME_BADFORMAT for an unknown format,
+   RME_NOSCHEMA, RME_NOTEMPTY, or a PF error code. */
+int RM_SetFormat(fh, format)
+RM_FileHandle *fh;
+int format;
+{
+    struct RM_FileHdr *fhdr;
+    char *pagebuf;
+    int error;
+
+    if (format != RM_FORMAT_SLOTTED && format != RM_FORMAT_PAX)
+        return RME_BADFORMAT;
+    if (format == RM_FORMAT_PAX && fh->schema.numAttrs == 0)
+        return RME_NOSCHEMA;
+    if (PF_GetNumPages(fh->fd) > 1)
+        return RME_NOTEMPTY;
+    if ((error = PF_GetThisPage(fh->fd, 0, &pagebuf)) != PFE_OK)
+        return error;
+    fhdr = (struct RM_FileHdr *) pagebuf;
+    fhdr->format = format;
+    fh->format = format;
+    return PF_UnfixPage(fh->fd, 0, TRUE);
+}
+
+/*************** PAX RECORDS ****************/
+
+/* Append "rec" to the PAX page of the last insert, or to a new page
+   when it is full. PAX pages are only filled at the end of the file and
+   are not entered in the free-space map. */
+static int rm_PaxInsert(fh, rec, rid)
+RM_FileHandle *fh;
+RM_Record *rec;
+RID *rid;
+{
+    char *pagebuf;
+    int page, j, error;
+
+    if (fh->lastPage <= 0)
+        fh->lastPage = PF_GetNumPages(fh->fd) - 1;
+
+    j = RME_NOROOM;
+    page = fh->lastPage;
+    if (page > 0 && PF_GetThisPage(fh->fd, page, &pagebuf) == PFE_OK) {
+        if (rm_IsPaxPage(pagebuf))
+            j = RMpaxAppend(&fh->schema, pagebuf, rec->data, rec->length);
+        if (j < 0)
+            PF_UnfixPage(fh->fd, page, FALSE);
+        if (j < 0 && j != RME_NOROOM)
+            return j;
+    }
+    if (j == RME_NOROOM) {
+        if ((error = rm_AllocDataPage(fh, &page, &pagebuf)) != PFE_OK)
+            return error;
+        RMpaxInitPage(&fh->schema, pagebuf);
+        fh->lastPage = page;
+        j = RMpaxAppend(&fh->schema, pagebuf, rec->data, rec->length);
+        if (j < 0) {
+            PF_UnfixPage(fh->fd, page, TRUE);
+            return j == RME_NOROOM ? RME_RECTOOBIG : j;
+        }
+    }
+
+    rid->page = page;
+    rid->slot = j;
+    fh->totalRecords++;
+    fh->totalPayloadBytes += rec->length;
+    return PF_UnfixPage(fh->fd, page, TRUE);
+}
+
+/* fix the PAX page of "rid"; the page is left unfixed on error */
+static int rm_PaxFix(fh, rid, pagebuf)
+RM_FileHandle *fh;
+RID *rid;
+char **pagebuf;
+{
+    int error;
+
+    if ((error = PF_GetThisPage(fh->fd, rid->page, pagebuf)) != PFE_OK)
+        return error;
+    if (!rm_IsPaxPage(*pagebuf)) {
+        PF_UnfixPage(fh->fd, rid->page, FALSE);
+        PFerrno = PFE_INVALIDPAGE;
+        return PFerrno;
+    }
+    return PFE_OK;
+}
+
+static int rm_PaxDelete(fh, rid)
+RM_FileHandle *fh;
+RID *rid;
+{
+    char *pagebuf;
+    int error;
+
+    if ((error = rm_PaxFix(fh, rid, &pagebuf)) != PFE_OK)
+        return error;
+    if ((error = RMpaxDelete(pagebuf, rid->slot)) != PFE_OK) {
+        PF_UnfixPage(fh->fd, rid->page, FALSE);
+        PFerrno = error;
+        return error;
+    }
+    fh->totalDeleted++;
+    return PF_UnfixPage(fh->fd, rid->page, TRUE);
+}
+
+/*************** INSERT RECORD ****************/
+
+/* Insert "rec" and return its RID. A record too big for a page is
+   written to overflow pages first and stored as its stub. */
+int RM_InsertRecord(fh, rec, rid)
+RM_FileHandle *fh;
+RM_Record *rec;
+RID *rid;
+{
+    int fd = fh->fd;
+    int page, error;
+    char *pagebuf;
+    char stub[RM_OVFL_STUB_SIZE];
+    RM_Record body;     /* what the slot holds: the record or its stub */
+
+    if (fh->format == RM_FORMAT_PAX)
+        return rm_PaxInsert(fh, rec, rid);
+    if (rec->length < 0)
+        return RME_RECTOOBIG;
+    body = *rec;
+    if (rec->length > RM_INLINE_MAX) {
+        if ((error = rm_OvflWrite(fh, rec->data, rec->length, stub)) != PFE_OK)
+            return error;
+        body.data = stub;
+        body.length = RM_OVFL_STUB_SIZE;
+    }
+
+    /* find a page with room through the free-space map */
+    if ((error = rm_FindPage(fh, body.length + RM_SLOT_SIZE, &page, &pagebuf)) != PFE_OK) {
+        if (body.data == stub)
+            rm_OvflFree(fh, rm_OvflFirst(stub));
+        return error;
+    }
+
+    /* return RID */
+    rid->page = page;
+    rid->slot = rm_PlaceRecord(pagebuf, &body);
+    if (body.data == stub)
+        rm_GetSlot(pagebuf, rid->slot)->length |= RM_SLOT_OVERFLOW;
+
+    /* --- Metrics: update AFTER successful insert --- */
+    fh->totalRecords++;
+    fh->totalPayloadBytes += rec->length;
+    fh->lastPage = page;
+
+    error = rm_FsmUpdate(fh, page, pagebuf);
+    PF_UnfixPage(fd, page, TRUE);
+    return error;
+}
+
+/*************** BULK INSERT ****************/
+
+/* RM_InsertRecords() (below), looking "lookahead" records past one that
+   does not fit; with 0, records are stored in input order */
+static int rm_InsertBatch(fh, recs, n, rids, lookahead)
+RM_FileHandle *fh;
+RM_Record recs[];
+int n;
+RID rids[];
+int lookahead;
+{
+    char *placed;       /* placed[i] is TRUE once recs[i] is stored */
+    RM_Record *body;    /* what the slots hold: recs, or stubs of big ones */
+    char *stubs;
+    char *pagebuf;
+    int next;           /* first record not yet placed */
+    int limit, page, i, k, big, error;
+
+    if (fh->format == RM_FORMAT_PAX) {
+        for (i = 0, error = PFE_OK; i < n && error == PFE_OK; i++)
+            error = rm_PaxInsert(fh, &recs[i], &rids[i]);
+        return error;
+    }
+    for (i = big = 0; i < n; i++) {
+        if (recs[i].length < 0)
+            return RME_RECTOOBIG;
+        big += (recs[i].length > RM_INLINE_MAX);
+    }
+    if (n <= 0)
+        return PFE_OK;
+
+    placed = (char *) calloc((unsigned) n, 1);
+    body = (big == 0) ? recs : (RM_Record *) malloc(n * sizeof(RM_Record));
+    stubs = (big == 0) ? NULL : (char *) malloc(big * RM_OVFL_STUB_SIZE);
+    if (placed == NULL || body == NULL || (big > 0 && stubs == NULL)) {
+        if (placed != NULL)
+            free(placed);
+        if (big > 0 && body != NULL)
+            free(body);
+        if (stubs != NULL)
+            free(stubs);
+        PFerrno = PFE_NOMEM;
+        return PFerrno;
+    }
+
+    error = PFE_OK;
+    for (i = k = 0; big > 0 && i < n; i++) {
+        body[i] = recs[i];
+        if (recs[i].length <= RM_INLINE_MAX || error != PFE_OK)
+            continue;
+        error = rm_OvflWrite(fh, recs[i].data, recs[i].length,
+                             stubs + k * RM_OVFL_STUB_SIZE);
+        if (error != PFE_OK)
+            continue;
+        body[i].data = stubs + (k++) * RM_OVFL_STUB_SIZE;
+        body[i].length = RM_OVFL_STUB_SIZE;
+    }
+
+    next = (error == PFE_OK) ? 0 : n;
+    while (next < n) {
+        /* top up the last page first, then go on with new pages */
+        if (next == 0 && fh->lastPage > 0
+            && fh->lastPage < PF_GetNumPages(fh->fd)
+            && rm_TryPage(fh, fh->lastPage, body[0].length + RM_SLOT_SIZE, &pagebuf))
+            page = fh->lastPage;
+        else if ((error = rm_AllocDataPage(fh, &page, &pagebuf)) != PFE_OK)
+            break;
+
+        limit = n;
+        for (i = next; i < n && i < limit; i++) {
+            if (placed[i])
+                continue;
+            if (rm_PageFreeBytes(pagebuf) >= body[i].length + (int) RM_SLOT_SIZE) {
+                rids[i].page = page;
+                rids[i].slot = rm_PlaceRecord(pagebuf, &body[i]);
+                if (body[i].data != recs[i].data)
+                    rm_GetSlot(pagebuf, rids[i].slot)->length |= RM_SLOT_OVERFLOW;
+                placed[i] = TRUE;
+                fh->totalRecords++;
+                fh->totalPayloadBytes += recs[i].length;
+            }
+            else if (limit == n) {
+                /* page is nearly full: look a little further ahead */
+                limit = i + 1 + lookahead;
+            }
+        }
+        while (next < n && placed[next])
+            next++;
+
+        fh->lastPage = page;
+        error = rm_FsmUpdate(fh, page, pagebuf);
+        if (PF_UnfixPage(fh->fd, page, TRUE) != PFE_OK && error == PFE_OK)
+            error = PFerrno;
+        if (error != PFE_OK)
+            break;
+    }
+
+    /* chains of big records that were not placed are dropped */
+    for (i = 0; big > 0 && i < n; i++)
+        if (body[i].data != recs[i].data && !placed[i])
+            rm_OvflFree(fh, rm_OvflFirst(body[i].data));
+    if (body != recs)
+        free(body);
+    if (stubs != NULL)
+        free(stubs);
+    free(placed);
+    return error;
+}
+
+/* Insert recs[0..n-1] and return their RIDs in rids[0..n-1]. Pages are
+   packed one at a time in memory: each is fixed once, filled, unfixed
+   dirty and entered in the FSM once, with no free-space search. Packing
+   tops up the page of the last insert and then uses new pages. When a
+   record does not fit, the next RM_BULK_LOOKAHEAD records are tried
+   before the page is closed, so storage order may differ slightly from
+   input order. Records too big for a page get their overflow chains
+   first and are packed as stubs. After an error, RIDs of the records
+   already placed are valid. Records of a PAX file are appended in
+   order. */
+int RM_InsertRecords(fh, recs, n, rids)
+RM_FileHandle *fh;
+RM_Record recs[];
+int n;
+RID rids[];
+{
+    return rm_InsertBatch(fh, recs, n, rids, RM_BULK_LOOKAHEAD);
+}
+
+/*************** DELETE RECORD ****************/
+
+int RM_DeleteRecord(fh, rid)
+RM_FileHandle *fh;
+RID *rid;
+{
+    int fd = fh->fd;
+    char *pagebuf, *tbuf;
+    struct RM_Slot *slot, *tslot;
+    RID target;
+    int chain, error;
+
+    if (fh->format == RM_FORMAT_PAX)
+        return rm_PaxDelete(fh, rid);
+    if ((error = rm_FixHome(fh, rid, &pagebuf)) != PFE_OK)
+        return error;
+
+    slot = rm_GetSlot(pagebuf, rid->slot);
+    chain = (slot->length & RM_SLOT_OVERFLOW)
+            ? rm_OvflFirst(pagebuf + slot->offset) : 0;
+    if (slot->length & RM_SLOT_FORWARD) {
+        /* drop the moved record first */
+        memcpy((char *) &target, pagebuf + slot->offset, RM_RID_SIZE);
+        if ((error = PF_GetThisPage(fd, target.page, &tbuf)) != PFE_OK) {
+            PF_UnfixPage(fd, rid->page, FALSE);
+            return error;
+        }
+        tslot = rm_GetSlot(tbuf, target.slot);
+        if (tslot->length & RM_SLOT_OVERFLOW)
+            chain = rm_OvflFirst(tbuf + tslot->offset + RM_RID_SIZE);
+        rm_FreeSlot(tbuf, target.slot);
+        error = rm_FsmUpdate(fh, target.page, tbuf);
+        PF_UnfixPage(fd, target.page, TRUE);
+        if (error != PFE_OK) {
+            PF_UnfixPage(fd, rid->page, FALSE);
+            return error;
+        }
+    }
+
+    rm_FreeSlot(pagebuf, rid->slot);
+    fh->totalDeleted++;
+
+    error = rm_FsmUpdate(fh, rid->page, pagebuf);
+    PF_UnfixPage(fd, rid->page, TRUE);
+    if (error == PFE_OK && chain > 0)
+        error = rm_OvflFree(fh, chain);
+    return error;
+}
+
+/*************** UPDATE RECORD ****************/
+
+/* Move the record of home slot "rid" to another page as "len" bytes of
+   "moved" (home RID + record or stub) with slot flags "flags" besides
+   RM_SLOT_MOVED, and return where it went in "target". */
+static int rm_MoveRecord(fh, moved, len, flags, target)
+RM_FileHandle *fh;
+char *moved;
+int len;
+int flags;
+RID *target;
+{
+    RM_Record rec;
+    char *qbuf;
+    int error;
+
+    /* pages the caller has fixed fail rm_TryPage(), so the record
+       never lands on its home page or on its old place */
+    if ((error = rm_FindPage(fh, len + RM_SLOT_SIZE, &target->page, &qbuf)) != PFE_OK)
+        return error;
+    rec.data = moved;
+    rec.length = len;
+    target->slot = rm_PlaceRecord(qbuf, &rec);
+    rm_GetSlot(qbuf, target->slot)->length |= RM_SLOT_MOVED | flags;
+    error = rm_FsmUpdate(fh, target->page, qbuf);
+    PF_UnfixPage(fh->fd, target->page, TRUE);
+    return error;
+}
+
+/* Replace the record "rid" by "rec", keeping its RID. The record is
+   overwritten in place if it fits in its page. Otherwise it moves to
+   another page and its home slot becomes a forwarding stub; a record
+   that already moved is updated where it lives, moved on again with
+   the stub retargeted, or brought back home once it fits there. A
+   record too big for a page gets a new overflow chain and is handled
+   as its stub; the old chain, if any, is freed.
+
+   RETURN VALUE: PFE_OK, RME_RECTOOBIG for a negative length,
+   RME_NOROOM if the home page cannot even hold a stub, RME_BADFORMAT
+   for a PAX file, or a PF error code. */
+int RM_UpdateRecord(fh, rid, rec)
+RM_FileHandle *fh;
+RID *rid;
+RM_Record *rec;
+{
+    int fd = fh->fd;
+    char *pagebuf, *tbuf;
+    char moved[PF_PAGE_SIZE];
+    char stub[RM_OVFL_STUB_SIZE];
+    struct RM_Slot *slot, *tslot;
+    RM_Record body;     /* what the slot will hold: the record or its stub */
+    RID target, newTarget;
+    int oldLen, oldChain, flags, stored, error;
+
+    if (fh->format == RM_FORMAT_PAX)
+        return RME_BADFORMAT;
+    if (rec->length < 0)
+        return RME_RECTOOBIG;
+    if ((error = rm_FixHome(fh, rid, &pagebuf)) != PFE_OK)
+        return error;
+
+    body = *rec;
+    flags = 0;
+    if (rec->length > RM_INLINE_MAX) {
+        if ((error = rm_OvflWrite(fh, rec->data, rec->length, stub)) != PFE_OK) {
+            PF_UnfixPage(fd, rid->page, FALSE);
+            return error;
+        }
+        body.data = stub;
+        body.length = RM_OVFL_STUB_SIZE;
+        flags = RM_SLOT_OVERFLOW;
+    }
+
+    /* the moved form of the record: home RID, then the record */
+    memcpy(moved, (char *) rid, RM_RID_SIZE);
+    memcpy(moved + RM_RID_SIZE, body.data, body.length);
+
+    slot = rm_GetSlot(pagebuf, rid->slot);
+    tbuf = NULL;
+    oldChain = 0;
+    stored = TRUE;
+    if (!(slot->length & RM_SLOT_FORWARD)) {
+        oldLen = RM_SLOT_LEN(slot);
+        if (slot->length & RM_SLOT_OVERFLOW) {
+            oldLen = rm_OvflLength(pagebuf + slot->offset);
+            oldChain = rm_OvflFirst(pagebuf + slot->offset);
+        }
+        if (rm_HasRoom(pagebuf, rid->slot, body.length)) {
+            rm_RewriteSlot(pagebuf, rid->slot, body.data, body.length, flags);
+        }
+        else if (!rm_HasRoom(pagebuf, rid->slot, RM_RID_SIZE)) {
+            error = RME_NOROOM;
+            stored = FALSE;
+        }
+        else if ((error = rm_MoveRecord(fh, moved, body.length + RM_RID_SIZE,
+                                        flags, &target)) == PFE_OK) {
+            rm_RewriteSlot(pagebuf, rid->slot, (char *) &target, RM_RID_SIZE,
+                           RM_SLOT_FORWARD);
+        }
+        else
+            stored = FALSE;
+    }
+    else {
+        memcpy((char *) &target, pagebuf + slot->offset, RM_RID_SIZE);
+        if ((error = PF_GetThisPage(fd, target.page, &tbuf)) != PFE_OK) {
+            PF_UnfixPage(fd, rid->page, FALSE);
+            if (flags)
+                rm_OvflFree(fh, rm_OvflFirst(stub));
+            return error;
+        }
+        tslot = rm_GetSlot(tbuf, target.slot);
+        oldLen = RM_SLOT_LEN(tslot) - RM_RID_SIZE;
+        if (tslot->length & RM_SLOT_OVERFLOW) {
+            oldLen = rm_OvflLength(tbuf + tslot->offset + RM_RID_SIZE);
+            oldChain = rm_OvflFirst(tbuf + tslot->offset + RM_RID_SIZE);
+        }
+        if (rm_HasRoom(pagebuf, rid->slot, body.length)) {
+            /* fits at home again */
+            rm_RewriteSlot(pagebuf, rid->slot, body.data, body.length, flags);
+            rm_FreeSlot(tbuf, target.slot);
+        }
+        else if (rm_HasRoom(tbuf, target.slot, body.length + RM_RID_SIZE)) {
+            rm_RewriteSlot(tbuf, target.slot, moved, body.length + RM_RID_SIZE,
+                           RM_SLOT_MOVED | flags);
+        }
+        else if ((error = rm_MoveRecord(fh, moved, body.length + RM_RID_SIZE,
+                                        flags, &newTarget)) == PFE_OK) {
+            rm_FreeSlot(tbuf, target.slot);
+            rm_RewriteSlot(pagebuf, rid->slot, (char *) &newTarget, RM_RID_SIZE,
+                           RM_SLOT_FORWARD);
+        }
+        else
+            stored = FALSE;
+        if (error == PFE_OK)
+            error = rm_FsmUpdate(fh, target.page, tbuf);
+        PF_UnfixPage(fd, target.page, TRUE);
+    }
+
+    if (error == PFE_OK) {
+        fh->totalPayloadBytes += rec->length - oldLen;
+        error = rm_FsmUpdate(fh, rid->page, pagebuf);
+    }
+    PF_UnfixPage(fd, rid->page, TRUE);
+    if (stored && oldChain > 0 && rm_OvflFree(fh, oldChain) != PFE_OK
+        && error == PFE_OK)
+        error = PFerrno;
+    if (!stored && flags)
+        rm_OvflFree(fh, rm_OvflFirst(stub));
+    return error;
+}
+
+/*************** SCAN CURSOR ****************/
+
+/* First home slot of a live record at or after slot "from", or -1 if
+   there is none. Moved records are reached through their stubs. */
+static int rm_NextLiveSlot(pagebuf, from)
+char *pagebuf;
+int from;
+{
+    struct RM_PageHdr *hdr = rm_GetHdr(pagebuf);
+    struct RM_Slot *slot;
+    int s;
+
+    for (s = from; s < hdr->numSlots; s++) {
+        slot = rm_GetSlot(pagebuf, s);
+        if (slot->offset != -1 && !(slot->length & RM_SLOT_MOVED))
+            return s;
+    }
+    return -1;
+}
+
+/* Point "rec" at the record of live home slot "s" of "pagebuf". A stub
+   is followed: the page of the moved record is fixed and returned in
+   "*fwdPage" and "*fwdBuf" (NULL if the record is at home). *ovfl is
+   set if "rec" is the overflow stub of the record. */
+static int rm_RecordRef(fd, pagebuf, s, rec, fwdPage, fwdBuf, ovfl)
+int fd;
+char *pagebuf;
+int s;
+RM_Record *rec;
+int *fwdPage;
+char **fwdBuf;
+int *ovfl;
+{
+    struct RM_Slot *slot = rm_GetSlot(pagebuf, s);
+    RID target;
+    int error;
+
+    *fwdBuf = NULL;
+    if (!(slot->length & RM_SLOT_FORWARD)) {
+        rec->length = RM_SLOT_LEN(slot);
+        rec->data = pagebuf + slot->offset;
+        *ovfl = (slot->length & RM_SLOT_OVERFLOW) != 0;
+        return PFE_OK;
+    }
+
+    memcpy((char *) &target, pagebuf + slot->offset, RM_RID_SIZE);
+    if ((error = PF_GetThisPage(fd, target.page, fwdBuf)) != PFE_OK) {
+        *fwdBuf = NULL;
+        return error;
+    }
+    *fwdPage = target.page;
+    slot = rm_GetSlot(*fwdBuf, target.slot);
+    rec->length = RM_SLOT_LEN(slot) - RM_RID_SIZE;
+    rec->data = *fwdBuf + slot->offset + RM_RID_SIZE;
+    *ovfl = (slot->length & RM_SLOT_OVERFLOW) != 0;
+    return PFE_OK;
+}
+
+/* TRUE if "pred" can be decided on the first "len" bytes of a record,
+   that is if its field ends within them */
+static int rm_PredOnPrefix(pred, data, len)
+RM_Predicate *pred;
+char *data;
+int len;
+{
+    unsigned short end;
+    char *p;
+    int n;
+
+    if (pred->schema != NULL) {
+        if (pred->field < 0 || pred->field >= pred->schema->numAttrs)
+            return TRUE;
+        if (pred->schema->dataPos > len)
+            return FALSE;
+        memcpy((char *) &end, data + pred->schema->offsetPos
+               + (pred->field + 1) * sizeof(unsigned short), sizeof(end));
+        return end <= len;
+    }
+    if (pred->delim == 0)
+        return pred->offset + pred->length <= len;
+    for (p = data, n = pred->field; n >= 0; n--) {
+        if ((p = (char *) memchr(p, pred->delim, (data + len) - p)) == NULL)
+            return FALSE;
+        p++;
+    }
+    return TRUE;
+}
+
+/* "rec" is the overflow stub of the cursor's record. A cursor that
+   skips overflow returns the in-page prefix when its predicate can be
+   decided on it (and it has no filter, which sees whole records);
+   otherwise the whole record is assembled in the cursor's buffer. */
+static int rm_ScanOverflow(scan, rec)
+RM_ScanHandle *scan;
+RM_Record *rec;
+{
+    scan->ovflStub = rec->data;
+    rec->data += sizeof(struct RM_OvflStub);
+    rec->length = RM_OVFL_PREFIX;
+    if (scan->skipOverflow && scan->filter == NULL
+        && (scan->pred == NULL || rm_PredOnPrefix(scan->pred, rec->data, rec->length)))
+        return PFE_OK;
+    return RM_ScanFetchOverflow(scan, rec);
+}
+
+/* Point "rec" at record "j" of the PAX page of the cursor, rebuilt as a
+   tuple in the cursor's buffer. */
+static int rm_PaxRecordRef(scan, j, rec)
+RM_ScanHandle *scan;
+int j;
+RM_Record *rec;
+{
+    if (scan->tupleBuf == NULL
+        && (scan->tupleBuf = (char *) malloc(RM_PAX_TUPLE_MAX)) == NULL) {
+        PFerrno = PFE_NOMEM;
+        return PFerrno;
+    }
+    rec->data = scan->tupleBuf;
+    return RMpaxGetTuple(&scan->fh->schema, scan->pagebuf, j, scan->tupleBuf,
+                         RM_PAX_TUPLE_MAX, &rec->length);
+}
+
+/* malloc a private copy of the record "ref" points to */
+static int rm_CopyRecord(ref, rec)
+RM_Record *ref;
+RM_Record *rec;
+{
+    rec->length = ref->length;
+    if (rec->length > 0) {
+        rec->data = (char *) malloc(rec->length);
+        if (rec->data == NULL)
+            return PFE_NOMEM;
+        memcpy(rec->data, ref->data, rec->length);
+    } else {
+        rec->data = NULL;
+    }
+    return PFE_OK;
+}
+
+/* position the cursor on "rid", fixing its page */
+static int rm_ScanSeek(scan, rid)
+RM_ScanHandle *scan;
+RID *rid;
+{
+    int error;
+
+    if ((error = PF_GetThisPage(scan->fh->fd, rid->page, &scan->pagebuf)) != PFE_OK) {
+        scan->pagebuf = NULL;
+        return error;
+    }
+    scan->page = rid->page;
+    scan->slot = rid->slot;
+    return PFE_OK;
+}
+
+int RM_ScanOpen(fh, scan)
+RM_FileHandle *fh;
+RM_ScanHandle *scan;
+{
+    scan->fh = fh;
+    scan->page = -1;
+    scan->pagebuf = NULL;
+    scan->slot = -1;
+    scan->eof = FALSE;
+    scan->fwdBuf = NULL;
+    scan->pred = NULL;
+    scan->filter = NULL;
+    scan->filterArg = NULL;
+    scan->tupleBuf = NULL;
+    scan->skipOverflow = FALSE;
+    scan->ovflStub = NULL;
+    scan->ovflBuf = NULL;
+    scan->ovflSize = 0;
+    return PFE_OK;
+}
+
+/* With "skip", records stored in overflow pages are returned as their
+   first RM_OVFL_PREFIX bytes, kept in the page, and their overflow
+   pages are not read: a scan that only needs leading fields (of a
+   tuple, the header and the fields that end in the prefix) never
+   touches them. RM_ScanFetchOverflow() gets the whole record. */
+int RM_ScanSkipOverflow(scan, skip)
+RM_ScanHandle *scan;
+int skip;
+{
+    scan->skipOverflow = skip;
+    return PFE_OK;
+}
+
+/* Make "rec", the record the cursor last returned, whole: if it was
+   cut to its prefix by RM_ScanSkipOverflow(), read its overflow pages
+   into the cursor's buffer. It stays valid until the next call. */
+int RM_ScanFetchOverflow(scan, rec)
+RM_ScanHandle *scan;
+RM_Record *rec;
+{
+    int error;
+
+    if (scan->ovflStub == NULL)
+        return PFE_OK;
+    if ((error = rm_OvflFetch(scan->fh->fd, scan->ovflStub, &scan->ovflBuf,
+                              &scan->ovflSize, &rec->length, FALSE)) != PFE_OK)
+        return error;
+    rec->data = scan->ovflBuf;
+    scan->ovflStub = NULL;
+    return PFE_OK;
+}
+
+/* Open a scan that only returns records matching "pred" (if not NULL)
+   and passing "filter" (if not NULL). Both are applied to the record
+   bytes in the fixed page, before anything is copied or returned. */
+int RM_ScanOpenFilter(fh, scan, pred, filter, arg)
+RM_FileHandle *fh;
+RM_ScanHandle *scan;
+RM_Predicate *pred;
+RM_FilterFcn filter;
+char *arg;
+{
+    RM_ScanOpen(fh, scan);
+    scan->pred = pred;
+    scan->filter = filter;
+    scan->filterArg = arg;
+    return PFE_OK;
+}
+
+/* The field of "pred" in record "data" of "length" bytes, with its
+   length in *flen; NULL if the record has no such field or it is NULL */
+static char *rm_PredField(pred, data, length, flen)
+RM_Predicate *pred;
+char *data;
+int length;
+int *flen;
+{
+    char *f, *end;
+    int n;
+
+    if (pred->schema != NULL) {
+        if (pred->field < 0 || pred->field >= pred->schema->numAttrs
+            || RM_TupleIsNull(pred->schema, data, pred->field))
+            return NULL;
+        return RM_TupleField(pred->schema, data, pred->field, flen);
+    }
+    if (pred->delim == 0) {
+        if (pred->offset + pred->length > length)
+            return NULL;
+        *flen = pred->length;
+        return data + pred->offset;
+    }
+    f = data;
+    end = data + length;
+    for (n = pred->field; n > 0; n--) {
+        f = (char *) memchr(f, pred->delim, end - f);
+        if (f == NULL)
+            return NULL;
+        f++;
+    }
+    end = (char *) memchr(f, pred->delim, (data + length) - f);
+    *flen = (end == NULL ? (data + length) - f : end - f);
+    return f;
+}
+
+/* TRUE if the record "data" of "length" bytes satisfies "pred". Also
+   usable as an RM_FilterFcn with the predicate as its argument. */
+int RM_PredicateMatch(data, length, pred)
+char *data;
+int length;
+RM_Predicate *pred;
+{
+    char *f;
+    int flen, cmp;
+
+    if ((f = rm_PredField(pred, data, length, &flen)) == NULL)
+        return FALSE;
+
+    switch (pred->op) {
+    case RM_PRED_EQ:
+        return flen == pred->loLen && memcmp(f, pred->lo, flen) == 0;
+    case RM_PRED_PREFIX:
+        return flen >= pred->loLen && memcmp(f, pred->lo, pred->loLen) == 0;
+    case RM_PRED_RANGE:
+        if (pred->lo != NULL) {
+            cmp = memcmp(f, pred->lo, flen < pred->loLen ? flen : pred->loLen);
+            if (cmp < 0 || (cmp == 0 && flen < pred->loLen))
+                return FALSE;
+        }
+        if (pred->hi != NULL) {
+            cmp = memcmp(f, pred->hi, flen < pred->hiLen ? flen : pred->hiLen);
+            if (cmp > 0 || (cmp == 0 && flen > pred->hiLen))
+                return FALSE;
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* Return the next record without copying it: rec->data points into the
+   fixed page and stays valid until the cursor moves to another page or
+   is closed. A moved record is returned under its home RID and stays
+   valid until the next call, as does a record rebuilt from a PAX page
+   or assembled from overflow pages. */
+int RM_ScanNextRef(scan, rid, rec)
+RM_ScanHandle *scan;
+RID *rid;
+RM_Record *rec;
+{
+    int fd = scan->fh->fd;
+    int page, s, ovfl, error;
+    char *pagebuf;
+
+    if (scan->fwdBuf != NULL) {
+        PF_UnfixPage(fd, scan->fwdPage, FALSE);
+        scan->fwdBuf = NULL;
+    }
+    scan->ovflStub = NULL;
+    if (scan->eof)
+        return PFE_EOF;
+
+    if (scan->pagebuf == NULL) {
+        if (scan->page != -1)
+            return PFE_PAGENOTINBUF;   /* an earlier move failed */
+        if ((error = PF_GetFirstPage(fd, &page, &pagebuf)) != PFE_OK) {
+            if (error == PFE_EOF)
+                scan->eof = TRUE;
+            return error;
+        }
+        scan->page = page;
+        scan->pagebuf = pagebuf;
+        scan->slot = -1;
+    }
+
+    while (1) {
+        if (rm_IsPaxPage(scan->pagebuf))
+            s = RMpaxNextLive(scan->pagebuf, scan->slot + 1);
+        else
+            s = rm_IsDataPage(scan->pagebuf)
+                ? rm_NextLiveSlot(scan->pagebuf, scan->slot + 1) : -1;
+        if (s >= 0) {
+            scan->slot = s;
+            scan->ovflStub = NULL;
+            if (rm_IsPaxPage(scan->pagebuf))
+                error = rm_PaxRecordRef(scan, s, rec);
+            else {
+                error = rm_RecordRef(fd, scan->pagebuf, s, rec,
+                                     &scan->fwdPage, &scan->fwdBuf, &ovfl);
+                if (error == PFE_OK && ovfl)
+                    error = rm_ScanOverflow(scan, rec);
+            }
+            if (error != PFE_OK)
+                return error;
+            if ((scan->pred == NULL
+                 || RM_PredicateMatch(rec->data, rec->length, scan->pred))
+                && (scan->filter == NULL
+                    || (*scan->filter)(rec->data, rec->length, scan->filterArg))) {
+                rid->page = scan->page;
+                rid->slot = s;
+                return PFE_OK;
+            }
+            if (scan->fwdBuf != NULL) {
+                PF_UnfixPage(fd, scan->fwdPage, FALSE);
+                scan->fwdBuf = NULL;
+            }
+            continue;
+        }
+
+        /* page exhausted: move on to the next one */
+        page = scan->page;
+        PF_UnfixPage(fd, page, FALSE);
+        scan->pagebuf = NULL;
+        if ((error = PF_GetNextPage(fd, &page, &pagebuf)) != PFE_OK) {
+            if (error == PFE_EOF)
+                scan->eof = TRUE;
+            return error;
+        }
+        scan->page = page;
+        scan->pagebuf = pagebuf;
+        scan->slot = -1;
+    }
+}
+
+/* Copying form of RM_ScanNextRef(): the caller owns rec->data. The
+   page stays fixed between calls all the same. */
+int RM_ScanNext(scan, rid, rec)
+RM_ScanHandle *scan;
+RID *rid;
+RM_Record *rec;
+{
+    RM_Record ref;
+    int error;
+
+    if ((error = RM_ScanNextRef(scan, rid, &ref)) != PFE_OK)
+        return error;
+    return rm_CopyRecord(&ref, rec);
+}
+
+int RM_ScanClose(scan)
+RM_ScanHandle *scan;
+{
+    int error = PFE_OK;
+
+    if (scan->fwdBuf != NULL)
+        PF_UnfixPage(scan->fh->fd, scan->fwdPage, FALSE);
+    scan->fwdBuf = NULL;
+    if (scan->pagebuf != NULL)
+        error = PF_UnfixPage(scan->fh->fd, scan->page, FALSE);
+    scan->pagebuf = NULL;
+    if (scan->tupleBuf != NULL)
+        free(scan->tupleBuf);
+    scan->tupleBuf = NULL;
+    if (scan->ovflBuf != NULL)
+        free(scan->ovflBuf);
+    scan->ovflBuf = NULL;
+    scan->ovflSize = 0;
+    scan->ovflStub = NULL;
+    scan->eof = TRUE;
+    return error;
+}
+
+/*************** PARALLEL SCAN ****************/
+
+/* state shared by the workers of one parallel scan */
+struct rm_ParShared {
+    RM_FileHandle *fh;
+    RM_ParScan *ps;
+    int numPages;
+    int nextPage;           /* first page of the next morsel */
+    int error;              /* first error, stops all workers */
+    pthread_mutex_t lock;   /* protects nextPage and error */
+};
+
+struct rm_ParWorker {
+    struct rm_ParShared *sh;
+    int id;
+    long matched;
+    char *ovflBuf;          /* overflow records are assembled here */
+    int ovflSize;
+    int *heldPages;         /* data pages the worker still holds fixed, */
+    char **heldBufs;        /* read in place when a stub points there */
+    int numHeld;
+};
+
+/* Fix "page" for a worker. Another worker may hold it for a moment
+   (following a stub into it), so wait for it rather than fail. */
+static int rm_ParFix(fd, page, pagebuf)
+int fd;
+int page;
+char **pagebuf;
+{
+    int error;
+
+    while ((error = PF_GetThisPage(fd, page, pagebuf)) == PFE_PAGEFIXED)
+        sched_yield();
+    return error;
+}
+
+/* filter one record and hand it to the callback */
+static int rm_ParEmit(w, rid, rec)
+struct rm_ParWorker *w;
+RID *rid;
+RM_Record *rec;
+{
+    RM_ParScan *ps = w->sh->ps;
+
+    if (ps->pred != NULL && !RM_PredicateMatch(rec->data, rec->length, ps->pred))
+        return PFE_OK;
+    if (ps->filter != NULL && !(*ps->filter)(rec->data, rec->length, ps->filterArg))
+        return PFE_OK;
+    w->matched++;
+    return ps->fcn == NULL ? PFE_OK : (*ps->fcn)(w->id, rid, rec, ps->fcnArg);
 }
 
-/*************** INSERT RECORD ****************/
+/* scan fixed PAX page "page", rebuilding each record, and unfix it */
+static int rm_ParScanPaxPage(w, page, pagebuf)
+struct rm_ParWorker *w;
+int page;
+char *pagebuf;
+{
+    RM_FileHandle *fh = w->sh->fh;
+    char tuple[RM_PAX_TUPLE_MAX];
+    RM_Record rec;
+    RID rid;
+    int j, error = PFE_OK;
+
+    rid.page = page;
+    rec.data = tuple;
+    for (j = RMpaxNextLive(pagebuf, 0); j >= 0 && error == PFE_OK;
+         j = RMpaxNextLive(pagebuf, j + 1)) {
+        rid.slot = j;
+        error = RMpaxGetTuple(&fh->schema, pagebuf, j, tuple, sizeof(tuple),
+                              &rec.length);
+        if (error == PFE_OK)
+            error = rm_ParEmit(w, &rid, &rec);
+    }
+    PF_UnfixPage(fh->fd, page, FALSE);
+    return error;
+}
 
-int RM_InsertRecord(fh, rec, rid)
-RM_FileHandle *fh;
-RM_Record *rec;
+/* hand record "rec" of slot flags "flags" to rm_ParEmit(), assembling
+   it first if it is an overflow stub */
+static int rm_ParRecord(w, rid, rec, flags)
+struct rm_ParWorker *w;
 RID *rid;
+RM_Record *rec;
+int flags;
 {
-    int fd = fh->fd;
-    int page, error;
-    char *pagebuf;
-    struct RM_PageHdr *hdr;
-    struct RM_Slot *slot;
+    int error;
 
-    /* scan existing pages to find free space */
-    error = PF_GetFirstPage(fd, &page, &pagebuf);
-    while (error != PFE_EOF) {
+    if (flags & RM_SLOT_OVERFLOW) {
+        if ((error = rm_OvflFetch(w->sh->fh->fd, rec->data, &w->ovflBuf,
+                                  &w->ovflSize, &rec->length, TRUE)) != PFE_OK)
+            return error;
+        rec->data = w->ovflBuf;
+    }
+    return rm_ParEmit(w, rid, rec);
+}
 
-        hdr = rm_GetHdr(pagebuf);
+/* the buffer of "page" if the worker holds it fixed, else NULL */
+static char *rm_ParHeld(w, page)
+struct rm_ParWorker *w;
+int page;
+{
+    int i;
 
-        /* check free space */
-        if (hdr->freeEnd - hdr->freeStart >= rec->length + RM_SLOT_SIZE) {
-            /* found suitable page */
-            break;
-        }
+    for (i = 0; i < w->numHeld; i++)
+        if (w->heldPages[i] == page)
+            return w->heldBufs[i];
+    return NULL;
+}
 
-        PF_UnfixPage(fd, page, FALSE);
-        error = PF_GetNextPage(fd, &page, &pagebuf);
+/* Scan fixed page "page" and unfix it. Records behind stubs are fetched
+   after the page is unfixed, so a worker never waits for a data page
+   while holding one; the worker's held pages are read in place.
+   Overflow pages belong to a single record and are only held briefly
+   by workers passing over them, so they are read with the page fixed. */
+static int rm_ParScanFixed(w, page, pagebuf)
+struct rm_ParWorker *w;
+int page;
+char *pagebuf;
+{
+    int fd = w->sh->fh->fd;
+    RID home[PF_PAGE_SIZE / sizeof(struct RM_Slot)];
+    RID target[PF_PAGE_SIZE / sizeof(struct RM_Slot)];
+    struct RM_Slot *slot;
+    RM_Record rec;
+    RID rid;
+    char *held;
+    int s, nfwd, i, error;
+
+    if (rm_IsPaxPage(pagebuf))
+        return rm_ParScanPaxPage(w, page, pagebuf);
+    if (!rm_IsDataPage(pagebuf))
+        return PF_UnfixPage(fd, page, FALSE);
+
+    nfwd = 0;
+    error = PFE_OK;
+    rid.page = page;
+    for (s = 0; s < rm_GetHdr(pagebuf)->numSlots && error == PFE_OK; s++) {
+        slot = rm_GetSlot(pagebuf, s);
+        if (slot->offset == -1 || (slot->length & RM_SLOT_MOVED))
+            continue;
+        rid.slot = s;
+        if (slot->length & RM_SLOT_FORWARD) {
+            home[nfwd] = rid;
+            memcpy((char *) &target[nfwd++], pagebuf + slot->offset, RM_RID_SIZE);
+            continue;
+        }
+        rec.length = RM_SLOT_LEN(slot);
+        rec.data = pagebuf + slot->offset;
+        error = rm_ParRecord(w, &rid, &rec, slot->length);
     }
+    PF_UnfixPage(fd, page, FALSE);
 
-    if (error == PFE_EOF) {
-        /* allocate new page */
-        if ((error = PF_AllocPage(fd, &page, &pagebuf)) != PFE_OK)
-            return error;
-        rm_InitSlottedPage(pagebuf);
+    for (i = 0; i < nfwd && error == PFE_OK; i++) {
+        if ((held = rm_ParHeld(w, target[i].page)) != NULL)
+            pagebuf = held;
+        else if ((error = rm_ParFix(fd, target[i].page, &pagebuf)) != PFE_OK)
+            break;
+        slot = rm_GetSlot(pagebuf, target[i].slot);
+        rec.length = RM_SLOT_LEN(slot) - RM_RID_SIZE;
+        rec.data = pagebuf + slot->offset + RM_RID_SIZE;
+        error = rm_ParRecord(w, &home[i], &rec, slot->length);
+        if (held == NULL)
+            PF_UnfixPage(fd, target[i].page, FALSE);
     }
+    return error;
+}
 
-    hdr = rm_GetHdr(pagebuf);
+/* Scan one page. */
+static int rm_ParScanPage(w, page)
+struct rm_ParWorker *w;
+int page;
+{
+    char *pagebuf;
+    int error;
 
-    /* allocate new slot */
-    slot = rm_GetSlot(pagebuf, hdr->numSlots);
-    slot->offset = hdr->freeStart;
-    slot->length = rec->length;
+    if ((error = rm_ParFix(w->sh->fh->fd, page, &pagebuf)) != PFE_OK)
+        return error == PFE_INVALIDPAGE ? PFE_OK : error;   /* free page */
+    return rm_ParScanFixed(w, page, pagebuf);
+}
 
-    /* copy record */
-    memcpy(pagebuf + hdr->freeStart, rec->data, rec->length);
+static void *rm_ParWorkerMain(arg)
+void *arg;
+{
+    struct rm_ParWorker *w = (struct rm_ParWorker *) arg;
+    struct rm_ParShared *sh = w->sh;
+    int lo, hi, page, error;
 
-    /* update header */
-    hdr->freeStart += rec->length;
-    hdr->freeEnd   -= RM_SLOT_SIZE;
-    hdr->numSlots++;
+    while (1) {
+        /* claim the next morsel */
+        pthread_mutex_lock(&sh->lock);
+        lo = sh->nextPage;
+        sh->nextPage += sh->ps->morselPages;
+        if (sh->error != PFE_OK)
+            lo = sh->numPages;
+        pthread_mutex_unlock(&sh->lock);
+        if (lo >= sh->numPages)
+            break;
 
-    /* return RID */
-    rid->page = page;
-    rid->slot = hdr->numSlots - 1;
+        hi = lo + sh->ps->morselPages;
+        if (hi > sh->numPages)
+            hi = sh->numPages;
+        for (page = lo; page < hi; page++) {
+            if ((error = rm_ParScanPage(w, page)) != PFE_OK) {
+                pthread_mutex_lock(&sh->lock);
+                if (sh->error == PFE_OK)
+                    sh->error = error;
+                pthread_mutex_unlock(&sh->lock);
+                break;
+            }
+        }
+    }
+    return NULL;
+}
 
-    /* --- Metrics: update AFTER successful insert --- */
-    fh->totalRecords++;
-    fh->totalPayloadBytes += rec->length;
+/* Scan the file with ps->numThreads worker threads over page morsels,
+   calling ps->fcn on every record that passes ps->pred and ps->filter.
+   The order of records and of callbacks across workers is undefined;
+   moved records are seen once, under their home RID. The buffer pool
+   must have room for one fixed page per worker.
 
-    PF_UnfixPage(fd, page, TRUE);
-    return PFE_OK;
+   RETURN VALUE: PFE_OK, the first error a worker or callback hit, or
+   PFE_NOMEM if the workers cannot be started. */
+int RM_ParallelScan(fh, ps)
+RM_FileHandle *fh;
+RM_ParScan *ps;
+{
+    struct rm_ParShared sh;
+    struct rm_ParWorker w[RM_MAX_WORKERS];
+    pthread_t tid[RM_MAX_WORKERS];
+    int i, started;
+
+    if (ps->numThreads < 1 || ps->numThreads > RM_MAX_WORKERS)
+        return PFE_NOMEM;
+    if (ps->morselPages <= 0)
+        ps->morselPages = RM_MORSEL_PAGES;
+
+    sh.fh = fh;
+    sh.ps = ps;
+    sh.numPages = PF_GetNumPages(fh->fd);
+    sh.nextPage = 0;
+    sh.error = PFE_OK;
+    pthread_mutex_init(&sh.lock, NULL);
+
+    for (started = 0; started < ps->numThreads; started++) {
+        w[started].sh = &sh;
+        w[started].id = started;
+        w[started].matched = 0;
+        w[started].ovflBuf = NULL;
+        w[started].ovflSize = 0;
+        w[started].numHeld = 0;
+        if (pthread_create(&tid[started], NULL, rm_ParWorkerMain,
+                           (void *) &w[started]) != 0) {
+            pthread_mutex_lock(&sh.lock);
+            sh.error = PFE_NOMEM;
+            pthread_mutex_unlock(&sh.lock);
+            break;
+        }
+    }
+
+    ps->matched = 0;
+    for (i = 0; i < started; i++) {
+        pthread_join(tid[i], NULL);
+        ps->workerMatched[i] = w[i].matched;
+        ps->matched += w[i].matched;
+        if (w[i].ovflBuf != NULL)
+            free(w[i].ovflBuf);
+    }
+    pthread_mutex_destroy(&sh.lock);
+    return sh.numPages < 0 ? sh.numPages : sh.error;
 }
 
-/*************** DELETE RECORD ****************/
+/*************** PAGE SAMPLING ****************/
 
-int RM_DeleteRecord(fh, rid)
-RM_FileHandle *fh;
-RID *rid;
+/* next number of a 32-bit xorshift generator; the state is never 0 */
+static unsigned long rm_Random(state)
+unsigned long *state;
 {
-    int fd = fh->fd;
-    char *pagebuf;
-    struct RM_PageHdr *hdr;
-    struct RM_Slot *slot;
-    int error;
+    unsigned long x = *state;
 
-    if ((error = PF_GetThisPage(fd, rid->page, &pagebuf)) != PFE_OK)
-        return error;
+    x ^= (x << 13) & 0xffffffffUL;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xffffffffUL;
+    return *state = x;
+}
 
-    hdr = rm_GetHdr(pagebuf);
-    if (rid->slot < 0 || rid->slot >= hdr->numSlots) {
-        PF_UnfixPage(fd, rid->page, FALSE);
-        PFerrno = PFE_INVALIDPAGE;
-        return PFerrno;
-    }
+/* count a record of a sampled page and pass it on */
+static int rm_SampleRecord(worker, rid, rec, sp)
+int worker;
+RID *rid;
+RM_Record *rec;
+RM_PageSample *sp;
+{
+    sp->records++;
+    sp->bytes += rec->length;
+    return sp->fcn == NULL ? PFE_OK : (*sp->fcn)(worker, rid, rec, sp->fcnArg);
+}
 
-    slot = rm_GetSlot(pagebuf, rid->slot);
-    if (slot->offset == -1) {
-        /* already deleted */
-        PF_UnfixPage(fd, rid->page, FALSE);
-        PFerrno = PFE_PAGEFREE;
-        return PFerrno;
+/* Read sampled pages pages[0..n-1] (ascending) with one PF_GetPages()
+   call, then scan the data pages among them from the buffers it fixed,
+   unfixing each once; free pages count as sampled pages without
+   records. */
+static int rm_SampleBatch(w, pages, n)
+struct rm_ParWorker *w;
+int pages[];
+int n;
+{
+    RM_PageSample *sp = (RM_PageSample *) w->sh->ps->fcnArg;
+    int fd = w->sh->fh->fd;
+    char *bufs[RM_SAMPLE_BATCH];
+    int errors[RM_SAMPLE_BATCH], data[RM_SAMPLE_BATCH];
+    int i, m, error = PFE_OK;
+
+    /* keep the data pages fixed, packed into data[] and bufs[] */
+    PF_GetPages(fd, pages, n, bufs, errors);
+    for (i = 0, m = 0; i < n; i++) {
+        if (errors[i] == PFE_OK) {
+            if (rm_IsDataPage(bufs[i]) || rm_IsPaxPage(bufs[i])) {
+                data[m] = pages[i];
+                bufs[m++] = bufs[i];
+            } else
+                PF_UnfixPage(fd, pages[i], FALSE);
+        } else if (errors[i] != PFE_INVALIDPAGE && error == PFE_OK) {
+            error = errors[i];
+        }
     }
 
-    slot->offset = -1; /* mark deleted */
-    fh->totalDeleted++;
-
-    PF_UnfixPage(fd, rid->page, TRUE);
-    return PFE_OK;
+    if (error == PFE_OK)
+        sp->sampledPages += n;
+    for (i = 0; i < m; i++) {
+        if (error != PFE_OK) {
+            PF_UnfixPage(fd, data[i], FALSE);
+            continue;
+        }
+        sp->dataPages++;
+        w->heldPages = data + i + 1;
+        w->heldBufs = bufs + i + 1;
+        w->numHeld = m - i - 1;
+        error = rm_ParScanFixed(w, data[i], bufs[i]);
+    }
+    w->numHeld = 0;
+    return error;
 }
 
+/* Read a uniform random sample of the pages of the file other than its
+   header and free-space map pages, sp->count of them or else the share
+   sp->fraction, in ascending page order and RM_SAMPLE_BATCH at a time,
+   and call sp->fcn on the records of the data pages among them. Pages
+   are chosen by selection sampling from sp->seed, so a seed always
+   gives the same sample of a file. sp->estRecords scales the records
+   seen to the whole file.
+
+   RETURN VALUE: PFE_OK, the error of a page or callback, or PFE_NOBUF
+   if the buffer pool cannot hold RM_SAMPLE_BATCH pages and the overflow
+   or forwarded-to page of a record on them. */
+int RM_SamplePages(fh, sp)
+RM_FileHandle *fh;
+RM_PageSample *sp;
+{
+    struct rm_ParShared sh;
+    struct rm_ParWorker w;
+    RM_ParScan ps;
+    unsigned long state;
+    int pages[RM_SAMPLE_BATCH];
+    int numPages, page, want, left, n, error = PFE_OK;
+
+    sp->candidatePages = sp->sampledPages = sp->dataPages = 0;
+    sp->records = sp->bytes = 0;
+    sp->estRecords = 0.0;
+    if ((numPages = PF_GetNumPages(fh->fd)) < 0)
+        return numPages;
+    for (page = 1; page < numPages; page++)
+        sp->candidatePages += !rm_IsFsmPageNum(page);
+    want = (sp->count > 0) ? sp->count
+        : (int) (sp->fraction * sp->candidatePages + 0.5);
+    if (want == 0 && sp->count <= 0 && sp->fraction > 0.0)
+        want = 1;
+    if (want > sp->candidatePages)
+        want = sp->candidatePages;
+
+    /* sampled pages are scanned like the morsels of a parallel scan */
+    memset((char *) &ps, 0, sizeof(ps));
+    ps.numThreads = 1;
+    ps.fcn = rm_SampleRecord;
+    ps.fcnArg = (char *) sp;
+    sh.fh = fh;
+    sh.ps = &ps;
+    sh.numPages = numPages;
+    sh.nextPage = 0;
+    sh.error = PFE_OK;
+    w.sh = &sh;
+    w.id = 0;
+    w.matched = 0;
+    w.ovflBuf = NULL;
+    w.ovflSize = 0;
+    w.numHeld = 0;
+
+    state = sp->seed & 0xffffffffUL;
+    if (state == 0)
+        state = 0x9e3779b9UL;
+    left = sp->candidatePages;
+    n = 0;
+    for (page = 1; page < numPages && want > 0 && error == PFE_OK; page++) {
+        if (rm_IsFsmPageNum(page))
+            continue;
+        /* take this page with chance want / left */
+        if (rm_Random(&state) / 4294967296.0 * left < want) {
+            pages[n++] = page;
+            want--;
+        }
+        left--;
+        if (n == RM_SAMPLE_BATCH) {
+            error = rm_SampleBatch(&w, pages, n);
+            n = 0;
+        }
+    }
+    if (n > 0 && error == PFE_OK)
+        error = rm_SampleBatch(&w, pages, n);
+
+    if (w.ovflBuf != NULL)
+        free(w.ovflBuf);
+    if (sp->sampledPages > 0)
+        sp->estRecords = (double) sp->records * sp->candidatePages / sp->sampledPages;
+    return error;
+}
 
 /*************** SCAN FIRST RECORD ****************/
 
+/* Copying wrappers around the cursor: the caller owns rec->data and
+   must free it. */
 int RM_GetFirstRecord(fh, rid, rec)
 RM_FileHandle *fh;
 RID *rid;
 RM_Record *rec;
 {
-    int fd = fh->fd;
-    int page, s, error;
-    char *pagebuf;
-    struct RM_PageHdr *hdr;
-    struct RM_Slot *slot;
-
-    error = PF_GetFirstPage(fd, &page, &pagebuf);
-    while (error != PFE_EOF) {
-
-        hdr = rm_GetHdr(pagebuf);
-
-        for (s = 0; s < hdr->numSlots; s++) {
-            slot = rm_GetSlot(pagebuf, s);
-            if (slot->offset != -1) {
-                rid->page = page;
-                rid->slot = s;
-
-                rec->length = slot->length;
-                if (rec->length > 0) {
-                    rec->data = (char *) malloc(rec->length);
-                    if (rec->data == NULL) {
-                        PF_UnfixPage(fd, page, FALSE);
-                        return PFE_NOMEM;
-                    }
-                    memcpy(rec->data, pagebuf + slot->offset, rec->length);
-                } else {
-                    rec->data = NULL;
-                }
-                PF_UnfixPage(fd, page, FALSE);
-                return PFE_OK;
-            }
-        }
-
-        PF_UnfixPage(fd, page, FALSE);
-        error = PF_GetNextPage(fd, &page, &pagebuf);
-    }
+    RM_ScanHandle scan;
+    RM_Record ref;
+    int error;
 
-    return PFE_EOF;
+    RM_ScanOpen(fh, &scan);
+    if ((error = RM_ScanNextRef(&scan, rid, &ref)) == PFE_OK)
+        error = rm_CopyRecord(&ref, rec);
+    RM_ScanClose(&scan);
+    return error;
 }
 
 /*************** SCAN NEXT RECORD ****************/
@@ -234,79 +2084,282 @@ RM_FileHandle *fh;
 RID *rid;
 RM_Record *rec;
 {
-    int fd = fh->fd;
-    int page = rid->page;
-    int s = rid->slot + 1;
-    char *pagebuf;
-    struct RM_PageHdr *hdr;
-    struct RM_Slot *slot;
+    RM_ScanHandle scan;
+    RM_Record ref;
     int error;
 
-    /* first try same page */
-    if ((error = PF_GetThisPage(fd, page, &pagebuf)) != PFE_OK)
+    RM_ScanOpen(fh, &scan);
+    if ((error = rm_ScanSeek(&scan, rid)) != PFE_OK)
         return error;
+    if ((error = RM_ScanNextRef(&scan, rid, &ref)) == PFE_OK)
+        error = rm_CopyRecord(&ref, rec);
+    RM_ScanClose(&scan);
+    return error;
+}
 
-    hdr = rm_GetHdr(pagebuf);
+/*************** FETCH BY RID ****************/
 
-    for ( ; s < hdr->numSlots; s++) {
-        slot = rm_GetSlot(pagebuf, s);
-        if (slot->offset != -1) {
-            rid->slot = s;
-            rec->length = slot->length;
-            if (rec->length > 0) {
-                rec->data = (char *) malloc(rec->length);
-                if (rec->data == NULL) {
-                    PF_UnfixPage(fd, page, FALSE);
-                    return PFE_NOMEM;
-                }
-                memcpy(rec->data, pagebuf + slot->offset, rec->length);
-            } else {
-                rec->data = NULL;
-            }
-            PF_UnfixPage(fd, page, FALSE);
-            return PFE_OK;
+/* Copy the record "rid" into rec; the caller owns rec->data */
+int RM_GetRecord(fh, rid, rec)
+RM_FileHandle *fh;
+RID *rid;
+RM_Record *rec;
+{
+    RM_Record ref;
+    char *pagebuf, *fwdBuf;
+    char tuple[RM_PAX_TUPLE_MAX];
+    int fwdPage, ovfl, size, error;
+
+    if (fh->format == RM_FORMAT_PAX) {
+        if ((error = rm_PaxFix(fh, rid, &pagebuf)) != PFE_OK)
+            return error;
+        ref.data = tuple;
+        error = RMpaxGetTuple(&fh->schema, pagebuf, rid->slot, tuple,
+                              sizeof(tuple), &ref.length);
+        PF_UnfixPage(fh->fd, rid->page, FALSE);
+        if (error != PFE_OK) {
+            PFerrno = error;
+            return error;
+        }
+        return rm_CopyRecord(&ref, rec);
+    }
+    if ((error = rm_FixHome(fh, rid, &pagebuf)) != PFE_OK)
+        return error;
+    if ((error = rm_RecordRef(fh->fd, pagebuf, rid->slot, &ref,
+                              &fwdPage, &fwdBuf, &ovfl)) == PFE_OK) {
+        if (ovfl) {
+            /* assemble straight into the caller's copy */
+            rec->data = NULL;
+            size = 0;
+            error = rm_OvflFetch(fh->fd, ref.data, &rec->data, &size,
+                                 &rec->length, FALSE);
+            if (error != PFE_OK && rec->data != NULL)
+                free(rec->data);
         }
+        else
+            error = rm_CopyRecord(&ref, rec);
     }
+    if (fwdBuf != NULL)
+        PF_UnfixPage(fh->fd, fwdPage, FALSE);
+    PF_UnfixPage(fh->fd, rid->page, FALSE);
+    return error;
+}
 
-    PF_UnfixPage(fd, page, FALSE);
 
-    /* move to next pages */
-    error = PF_GetNextPage(fd, &page, &pagebuf);
-    while (error != PFE_EOF) {
+/*************** BATCH FETCH BY RID ****************/
 
-        hdr = rm_GetHdr(pagebuf);
+/* a RID to fetch and its position in the caller's array */
+struct rm_FetchEnt {
+    RID rid;
+    int i;
+};
 
-        for (s = 0; s < hdr->numSlots; s++) {
-            slot = rm_GetSlot(pagebuf, s);
-            if (slot->offset != -1) {
+/* home pages fixed together, in ascending order */
+struct rm_FetchBatch {
+    int n;
+    int pages[RM_FETCH_BATCH];
+    char *bufs[RM_FETCH_BATCH];
+    int errors[RM_FETCH_BATCH];
+};
 
-                rid->page = page;
-                rid->slot = s;
+static int rm_FetchCmp(a, b)
+const void *a;
+const void *b;
+{
+    const struct rm_FetchEnt *x = (const struct rm_FetchEnt *) a;
+    const struct rm_FetchEnt *y = (const struct rm_FetchEnt *) b;
+
+    if (x->rid.page != y->rid.page)
+        return (x->rid.page < y->rid.page) ? -1 : 1;
+    if (x->rid.slot != y->rid.slot)
+        return (x->rid.slot < y->rid.slot) ? -1 : 1;
+    return x->i - y->i;
+}
+
+/* Point "rec" at the record of "rid", whose home page "pagebuf" is
+   fixed in batch "b". A moved record is read from its page in the
+   batch, or from a page fixed in *fwdBuf (page *fwdPage; NULL if none
+   was fixed). Overflow records are assembled in *obuf, PAX records
+   rebuilt in "tuple". */
+static int rm_FetchRef(fh, rid, pagebuf, b, rec, fwdPage, fwdBuf, tuple, obuf, osize)
+RM_FileHandle *fh;
+RID *rid;
+char *pagebuf;
+struct rm_FetchBatch *b;
+RM_Record *rec;
+int *fwdPage;
+char **fwdBuf;
+char *tuple;
+char **obuf;
+int *osize;
+{
+    struct RM_Slot *slot;
+    RID target;
+    char *tbuf;
+    int k, error;
+
+    *fwdBuf = NULL;
+    if (fh->format == RM_FORMAT_PAX) {
+        if (!rm_IsPaxPage(pagebuf)) {
+            PFerrno = PFE_INVALIDPAGE;
+            return PFerrno;
+        }
+        rec->data = tuple;
+        if ((error = RMpaxGetTuple(&fh->schema, pagebuf, rid->slot, tuple,
+                                   RM_PAX_TUPLE_MAX, &rec->length)) != PFE_OK)
+            PFerrno = error;
+        return error;
+    }
+    if ((error = rm_CheckHome(pagebuf, rid)) != PFE_OK)
+        return error;
+
+    slot = rm_GetSlot(pagebuf, rid->slot);
+    if (slot->length & RM_SLOT_FORWARD) {
+        memcpy((char *) &target, pagebuf + slot->offset, RM_RID_SIZE);
+        for (k = 0; k < b->n && b->pages[k] != target.page; k++)
+            ;
+        if (k < b->n && b->errors[k] == PFE_OK) {
+            tbuf = b->bufs[k];
+        } else {
+            if ((error = PF_GetThisPage(fh->fd, target.page, fwdBuf)) != PFE_OK) {
+                *fwdBuf = NULL;
+                return error;
+            }
+            *fwdPage = target.page;
+            tbuf = *fwdBuf;
+        }
+        slot = rm_GetSlot(tbuf, target.slot);
+        rec->length = RM_SLOT_LEN(slot) - RM_RID_SIZE;
+        rec->data = tbuf + slot->offset + RM_RID_SIZE;
+    } else {
+        rec->length = RM_SLOT_LEN(slot);
+        rec->data = pagebuf + slot->offset;
+    }
+    if (slot->length & RM_SLOT_OVERFLOW) {
+        if ((error = rm_OvflFetch(fh->fd, rec->data, obuf, osize, &rec->length,
+                                  FALSE)) != PFE_OK)
+            return error;
+        rec->data = *obuf;
+    }
+    return PFE_OK;
+}
 
-                rec->length = slot->length;
-                if (rec->length > 0) {
-                    rec->data = (char *) malloc(rec->length);
-                    if (rec->data == NULL) {
-                        PF_UnfixPage(fd, page, FALSE);
-                        return PFE_NOMEM;
+/* Fetch the records of rids[0..n-1], calling fcn(i, &rids[i], rec, arg)
+   on each. The RIDs are sorted by (page, slot) and their home pages
+   read RM_FETCH_BATCH at a time with PF_GetPages(), so every page is
+   fixed once however many of the RIDs it holds, and runs of
+   consecutive pages are read together. With "inOrder" FALSE the calls
+   come in page order and rec->data points into the fixed page, valid
+   during the call only. With "inOrder" TRUE the records are copied
+   and the calls then come in the order of rids[]. Anything but PFE_OK
+   from fcn stops the fetch with that code. None of the pages may be
+   fixed by the caller.
+
+   RETURN VALUE: PFE_OK, the error of the first RID (in page order)
+   that names no record, as RM_GetRecord() gives it, fcn's code, or
+   PFE_NOMEM. */
+int RM_FetchRIDs(fh, rids, n, inOrder, fcn, arg)
+RM_FileHandle *fh;
+RID rids[];
+int n;
+int inOrder;
+RM_RecordFcn fcn;
+char *arg;
+{
+    struct rm_FetchEnt *ents;
+    struct rm_FetchBatch b;
+    RM_Record rec;
+    char tuple[RM_PAX_TUPLE_MAX];
+    char *copy = NULL, *obuf = NULL, *fwdBuf;
+    long *offs = NULL, used = 0, size = 0;
+    int *lens = NULL;
+    int osize = 0, fwdPage, k, end, p, i, error = PFE_OK;
+    void *q;
+
+    if (n <= 0)
+        return PFE_OK;
+    ents = (struct rm_FetchEnt *) malloc(n * sizeof(struct rm_FetchEnt));
+    if (inOrder) {
+        offs = (long *) malloc(n * sizeof(long));
+        lens = (int *) malloc(n * sizeof(int));
+    }
+    if (ents == NULL || (inOrder && (offs == NULL || lens == NULL))) {
+        PFerrno = PFE_NOMEM;
+        error = PFE_NOMEM;
+        n = 0;
+    }
+    for (i = 0; i < n; i++) {
+        ents[i].rid = rids[i];
+        ents[i].i = i;
+    }
+    qsort((char *) ents, n, sizeof(struct rm_FetchEnt), rm_FetchCmp);
+
+    for (k = 0; k < n && error == PFE_OK; k = end) {
+        /* the records on the next RM_FETCH_BATCH pages */
+        b.n = 0;
+        for (end = k; end < n; end++) {
+            if (b.n > 0 && ents[end].rid.page == b.pages[b.n - 1])
+                continue;
+            if (b.n == RM_FETCH_BATCH)
+                break;
+            b.pages[b.n++] = ents[end].rid.page;
+        }
+        PF_GetPages(fh->fd, b.pages, b.n, b.bufs, b.errors);
+
+        for (i = k, p = 0; i < end && error == PFE_OK; i++) {
+            while (b.pages[p] != ents[i].rid.page)
+                p++;
+            if ((error = b.errors[p]) != PFE_OK)
+                break;
+            error = rm_FetchRef(fh, &ents[i].rid, b.bufs[p], &b, &rec,
+                                &fwdPage, &fwdBuf, tuple, &obuf, &osize);
+            if (error == PFE_OK && !inOrder)
+                error = (*fcn)(ents[i].i, &rids[ents[i].i], &rec, arg);
+            if (error == PFE_OK && inOrder) {
+                if (used + rec.length > size) {
+                    while (used + rec.length > size)
+                        size = (size == 0) ? 65536 : 2 * size;
+                    if ((q = realloc(copy, (unsigned) size)) == NULL) {
+                        PFerrno = PFE_NOMEM;
+                        error = PFE_NOMEM;
+                    } else {
+                        copy = (char *) q;
                     }
-                    memcpy(rec->data, pagebuf + slot->offset, rec->length);
-                } else {
-                    rec->data = NULL;
                 }
-                PF_UnfixPage(fd, page, FALSE);
-                return PFE_OK;
+                if (error == PFE_OK) {
+                    memcpy(copy + used, rec.data, rec.length);
+                    offs[ents[i].i] = used;
+                    lens[ents[i].i] = rec.length;
+                    used += rec.length;
+                }
             }
+            if (fwdBuf != NULL)
+                PF_UnfixPage(fh->fd, fwdPage, FALSE);
         }
+        for (p = 0; p < b.n; p++)
+            if (b.errors[p] == PFE_OK)
+                PF_UnfixPage(fh->fd, b.pages[p], FALSE);
+    }
 
-        PF_UnfixPage(fd, page, FALSE);
-        error = PF_GetNextPage(fd, &page, &pagebuf);
+    for (i = 0; inOrder && i < n && error == PFE_OK; i++) {
+        rec.data = copy + offs[i];
+        rec.length = lens[i];
+        error = (*fcn)(i, &rids[i], &rec, arg);
     }
 
-    return PFE_EOF;
+    if (ents != NULL)
+        free((char *) ents);
+    if (offs != NULL)
+        free((char *) offs);
+    if (lens != NULL)
+        free((char *) lens);
+    if (copy != NULL)
+        free(copy);
+    if (obuf != NULL)
+        free(obuf);
+    return error;
 }
 
-
 int RM_AnalyzePage(fh, pageNum, usedBytes, numSlots, numDeleted)
 RM_FileHandle *fh;
 int pageNum;
@@ -331,15 +2384,28 @@ int *numDeleted;
 
     hdr = (struct RM_PageHdr *) pagebuf;
 
-    *numSlots = hdr->numSlots;
+    *numSlots = 0;
     *numDeleted = 0;
+    *usedBytes = 0;
+    if (rm_IsPaxPage(pagebuf)) {
+        /* minipage bytes, deleted records included */
+        RMpaxPageStats(&fh->schema, pagebuf, usedBytes, numSlots, numDeleted);
+        PF_UnfixPage(fh->fd, pageNum, FALSE);
+        return PFE_OK;
+    }
+    if (!rm_IsDataPage(pagebuf)) {
+        /* header and FSM pages hold no records */
+        PF_UnfixPage(fh->fd, pageNum, FALSE);
+        return PFE_OK;
+    }
+    *numSlots = hdr->numSlots;
 
     for (s = 0; s < hdr->numSlots; s++) {
         slot = rm_GetSlot(pagebuf, s);
         if (slot->offset == -1)
             (*numDeleted)++;
         else
-            payload += slot->length;
+            payload += RM_SLOT_LEN(slot);
     }
 
     *usedBytes = payload;
@@ -352,17 +2418,26 @@ int *numDeleted;
 }
 
 
-int RM_ComputeFileStats(fh, totalPages, totalPayload, slottedUtil, totalSlots, deletedSlots)
+/* File-wide statistics. slottedUtil is live payload over data page
+   bytes. usedUtil is the share of data page bytes taken by headers,
+   slots and records, deleted records included, and compactUtil the same
+   share once every page is compacted (RM_CompactFile()). */
+int RM_ComputeFileStats(fh, totalPages, totalPayload, slottedUtil, totalSlots, deletedSlots,
+                        usedUtil, compactUtil)
 RM_FileHandle *fh;
 int *totalPages;
 int *totalPayload;
 double *slottedUtil;
 int *totalSlots;
 int *deletedSlots;
+double *usedUtil;
+double *compactUtil;
 {
     int error, page = -1;
     char *pagebuf;
+    struct RM_PageHdr *hdr;
     int used, slots, deleted;
+    double usedBytes = 0.0, deadBytes = 0.0, pageBytes;
 
     *totalPages = 0;
     *totalPayload = 0;
@@ -376,6 +2451,17 @@ int *deletedSlots;
         if (error != PFE_OK)
             return error;
 
+        if (rm_IsPaxPage(pagebuf)) {
+            RMpaxPageStats(&fh->schema, pagebuf, &used, &slots, &deleted);
+            usedBytes += used;
+        } else if (rm_IsDataPage(pagebuf)) {
+            hdr = rm_GetHdr(pagebuf);
+            usedBytes += PF_PAGE_SIZE - (hdr->freeEnd - hdr->freeStart);
+            deadBytes += hdr->deadBytes;
+        } else {
+            PF_UnfixPage(fh->fd, page, FALSE);
+            continue;
+        }
         RM_AnalyzePage(fh, page, &used, &slots, &deleted);
 
         *totalPages += 1;
@@ -384,6 +2470,363 @@ int *deletedSlots;
         *deletedSlots += deleted;
     }
 
-    *slottedUtil = 100.0 * ((double)*totalPayload) / (*totalPages * PF_PAGE_SIZE);
+    pageBytes = (double)*totalPages * PF_PAGE_SIZE;
+    *slottedUtil = (*totalPages == 0) ? 0.0
+        : 100.0 * ((double)*totalPayload) / pageBytes;
+    *usedUtil = (*totalPages == 0) ? 0.0 : 100.0 * usedBytes / pageBytes;
+    *compactUtil = (*totalPages == 0) ? 0.0
+        : 100.0 * (usedBytes - deadBytes) / pageBytes;
+    return PFE_OK;
+}
+
+/* Compact every data page that holds space of deleted records. RIDs
+   are unchanged; the free-space map already counts that space. */
+int RM_CompactFile(fh)
+RM_FileHandle *fh;
+{
+    int error, page = -1;
+    char *pagebuf;
+
+    while ((error = PF_GetNextPage(fh->fd, &page, &pagebuf)) == PFE_OK) {
+        if (rm_IsDataPage(pagebuf) && rm_GetHdr(pagebuf)->deadBytes > 0) {
+            rm_CompactPage(pagebuf);
+            error = PF_UnfixPage(fh->fd, page, TRUE);
+        } else {
+            error = PF_UnfixPage(fh->fd, page, FALSE);
+        }
+        if (error != PFE_OK)
+            return error;
+    }
+    return (error == PFE_EOF) ? PFE_OK : error;
+}
+
+/*************** CLUSTERING ****************/
+
+/* a record of a file being clustered */
+struct rm_ClustRec {
+    RID rid;            /* RID in the old file */
+    long off;           /* record bytes at this offset of the copy buffer */
+    int length;
+    char *key;          /* sort key, compared bytewise */
+    int keyLen;         /* -1 if the record has no key */
+    unsigned char num[4];   /* int or float key in bytewise order */
+};
+
+/* Set the sort key of "r", whose bytes are "data": the field "key"
+   locates, with schema ints and floats turned into bytes that compare
+   like the numbers and dictionary codes into their strings. */
+static void rm_ClusterKey(fh, key, r, data)
+RM_FileHandle *fh;
+RM_Predicate *key;
+struct rm_ClustRec *r;
+char *data;
+{
+    unsigned int u;
+    float fv;
+    char type;
+
+    if ((r->key = rm_PredField(key, data, r->length, &r->keyLen)) == NULL) {
+        r->keyLen = -1;
+        return;
+    }
+    if (key->schema == NULL)
+        return;
+    type = key->schema->attrs[key->field].type;
+    if (type == RM_TYPE_DICT) {
+        r->key = RM_DictValue(fh, key->field,
+                              RM_TupleGetCode(key->schema, data, key->field), &r->keyLen);
+        if (r->key == NULL)
+            r->keyLen = -1;
+        return;
+    }
+    if (type == RM_TYPE_INT) {
+        u = (unsigned int) RM_TupleGetInt(key->schema, data, key->field) ^ 0x80000000u;
+    } else if (type == RM_TYPE_FLOAT) {
+        fv = RM_TupleGetFloat(key->schema, data, key->field);
+        memcpy((char *) &u, (char *) &fv, sizeof(u));
+        u = (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+    } else {
+        return;
+    }
+    r->num[0] = (unsigned char) (u >> 24);
+    r->num[1] = (unsigned char) (u >> 16);
+    r->num[2] = (unsigned char) (u >> 8);
+    r->num[3] = (unsigned char) u;
+    r->key = (char *) r->num;
+    r->keyLen = 4;
+}
+
+/* key order; records without a key first, ties in old RID order */
+static int rm_ClusterCmp(a, b)
+const void *a;
+const void *b;
+{
+    const struct rm_ClustRec *x = (const struct rm_ClustRec *) a;
+    const struct rm_ClustRec *y = (const struct rm_ClustRec *) b;
+    int cmp;
+
+    if (x->keyLen < 0 || y->keyLen < 0)
+        cmp = (x->keyLen >= 0) - (y->keyLen >= 0);
+    else if ((cmp = memcmp(x->key, y->key,
+                           x->keyLen < y->keyLen ? x->keyLen : y->keyLen)) == 0)
+        cmp = x->keyLen - y->keyLen;
+    if (cmp != 0)
+        return cmp;
+    if (x->rid.page != y->rid.page)
+        return (x->rid.page < y->rid.page) ? -1 : 1;
+    return x->rid.slot - y->rid.slot;
+}
+
+static int rm_RidMapCmp(a, b)
+const void *a;
+const void *b;
+{
+    const RM_RidMapEnt *x = (const RM_RidMapEnt *) a;
+    const RM_RidMapEnt *y = (const RM_RidMapEnt *) b;
+
+    if (x->oldRid.page != y->oldRid.page)
+        return (x->oldRid.page < y->oldRid.page) ? -1 : 1;
+    return x->oldRid.slot - y->oldRid.slot;
+}
+
+/* Copy every record of "fh" into *buf and describe it in (*recs)[i],
+   with its sort key. */
+static int rm_ClusterRead(fh, key, recs, n, buf)
+RM_FileHandle *fh;
+RM_Predicate *key;
+struct rm_ClustRec **recs;
+int *n;
+char **buf;
+{
+    RM_ScanHandle scan;
+    RM_Record rec;
+    RID rid;
+    struct rm_ClustRec *r = NULL;
+    char *b = NULL;
+    long used = 0, size = 0;
+    int cap = 0, i, error;
+    void *p;
+
+    *n = 0;
+    RM_ScanOpen(fh, &scan);
+    while ((error = RM_ScanNextRef(&scan, &rid, &rec)) == PFE_OK) {
+        if (*n == cap) {
+            cap = (cap == 0) ? 1024 : 2 * cap;
+            if ((p = realloc((char *) r, cap * sizeof(*r))) == NULL)
+                break;
+            r = (struct rm_ClustRec *) p;
+        }
+        if (used + rec.length > size) {
+            while (used + rec.length > size)
+                size = (size == 0) ? 65536 : 2 * size;
+            if ((p = realloc(b, (unsigned) size)) == NULL)
+                break;
+            b = (char *) p;
+        }
+        r[*n].rid = rid;
+        r[*n].off = used;
+        r[*n].length = rec.length;
+        memcpy(b + used, rec.data, rec.length);
+        used += rec.length;
+        (*n)++;
+    }
+    RM_ScanClose(&scan);
+    if (error == PFE_OK) {
+        PFerrno = PFE_NOMEM;
+        error = PFE_NOMEM;
+    }
+    if (error != PFE_EOF) {
+        if (r != NULL)
+            free((char *) r);
+        if (b != NULL)
+            free(b);
+        return error;
+    }
+
+    for (i = 0; i < *n; i++)
+        rm_ClusterKey(fh, key, &r[i], b + r[i].off);
+    *recs = r;
+    *buf = b;
     return PFE_OK;
 }
+
+/* Create file "fname" like "src" (schema, dictionaries, format) and
+   insert recs[0..n-1] into it in that order; their RIDs go to rids[]. */
+static int rm_ClusterWrite(src, fname, recs, n, buf, rids)
+RM_FileHandle *src;
+char *fname;
+struct rm_ClustRec *recs;
+int n;
+char *buf;
+RID rids[];
+{
+    RM_FileHandle dst;
+    RM_Record *body;
+    char *v;
+    int i, attr, code, len, error;
+
+    if ((body = (RM_Record *) malloc((n > 0 ? n : 1) * sizeof(RM_Record))) == NULL) {
+        PFerrno = PFE_NOMEM;
+        return PFE_NOMEM;
+    }
+    for (i = 0; i < n; i++) {
+        body[i].data = buf + recs[i].off;
+        body[i].length = recs[i].length;
+    }
+    if ((error = RM_CreateFile(fname)) != PFE_OK) {
+        free((char *) body);
+        return error;
+    }
+    if ((error = RM_OpenFile(fname, &dst)) != PFE_OK) {
+        free((char *) body);
+        RM_DestroyFile(fname);
+        return error;
+    }
+
+    if (src->schema.numAttrs > 0)
+        error = RM_SetSchema(&dst, &src->schema);
+    /* codes are handed out in order, so each dictionary keeps its codes */
+    for (attr = 0; attr < src->schema.numAttrs && error == PFE_OK; attr++) {
+        if (src->schema.attrs[attr].type != RM_TYPE_DICT)
+            continue;
+        for (i = 0; i < RM_DictSize(src, attr) && error == PFE_OK; i++) {
+            v = RM_DictValue(src, attr, i, &len);
+            error = RM_DictEncode(&dst, attr, v, len, &code);
+        }
+    }
+    if (error == PFE_OK && src->format != RM_FORMAT_SLOTTED)
+        error = RM_SetFormat(&dst, src->format);
+    if (error == PFE_OK)
+        error = rm_InsertBatch(&dst, body, n, rids, 0);
+
+    free((char *) body);
+    if (RM_CloseFile(&dst) != PFE_OK && error == PFE_OK)
+        error = PFerrno;
+    if (error != PFE_OK)
+        RM_DestroyFile(fname);
+    return error;
+}
+
+/* Rewrite file "fname" with its records in the order of the field
+   "key" locates (its op and values are not used; with a schema the
+   field is an attribute of the file's schema). Schema ints and floats
+   order by value, dictionary attributes by their strings and other
+   fields bytewise; records without the field come first and ties keep
+   file order. The records are read into memory, sorted, and packed
+   with RM_InsertRecords() into a new file with the same schema,
+   dictionaries and format, which then replaces "fname". The file must
+   not be open. If "map" is not NULL it gets the new RID of every
+   record, for rebuilding indexes; release it with RM_RidMapFree().
+
+   RETURN VALUE: PFE_OK, RME_NOSCHEMA for a schema key on a file
+   without one, or an RM or PF error code. After an error the file is
+   unchanged. */
+int RM_ClusterFile(fname, key, map)
+char *fname;
+RM_Predicate *key;
+RM_RidMap *map;
+{
+    RM_FileHandle fh;
+    RM_Predicate k;
+    struct rm_ClustRec *recs = NULL;
+    RID *rids = NULL;
+    char *buf = NULL, *tmpname;
+    int n, i, error;
+
+    if (map != NULL) {
+        map->n = 0;
+        map->ents = NULL;
+    }
+    if ((tmpname = (char *) malloc(strlen(fname) + 5)) == NULL) {
+        PFerrno = PFE_NOMEM;
+        return PFE_NOMEM;
+    }
+    sprintf(tmpname, "%s.clu", fname);
+    if ((error = RM_OpenFile(fname, &fh)) != PFE_OK) {
+        free(tmpname);
+        return error;
+    }
+
+    k = *key;
+    if (k.schema != NULL)
+        k.schema = &fh.schema;
+    if (k.schema != NULL && fh.schema.numAttrs == 0)
+        error = RME_NOSCHEMA;
+    if (error == PFE_OK)
+        error = rm_ClusterRead(&fh, &k, &recs, &n, &buf);
+    /* everything that can run out of memory comes before the rename */
+    if (error == PFE_OK) {
+        qsort((char *) recs, n, sizeof(*recs), rm_ClusterCmp);
+        rids = (RID *) malloc((n > 0 ? n : 1) * sizeof(RID));
+        if (rids != NULL && map != NULL)
+            map->ents = (RM_RidMapEnt *) malloc((n > 0 ? n : 1) * sizeof(RM_RidMapEnt));
+        if (rids == NULL || (map != NULL && map->ents == NULL)) {
+            PFerrno = PFE_NOMEM;
+            error = PFE_NOMEM;
+        }
+    }
+    if (error == PFE_OK)
+        error = rm_ClusterWrite(&fh, tmpname, recs, n, buf, rids);
+    if (RM_CloseFile(&fh) != PFE_OK && error == PFE_OK) {
+        error = PFerrno;
+        RM_DestroyFile(tmpname);
+    }
+
+    if (error == PFE_OK && map != NULL) {
+        for (i = 0; i < n; i++) {
+            map->ents[i].oldRid = recs[i].rid;
+            map->ents[i].newRid = rids[i];
+        }
+        map->n = n;
+        qsort((char *) map->ents, n, sizeof(RM_RidMapEnt), rm_RidMapCmp);
+    }
+    if (error == PFE_OK && rename(tmpname, fname) != 0) {
+        PFerrno = PFE_UNIX;
+        error = PFE_UNIX;
+        RM_DestroyFile(tmpname);
+    }
+    if (error != PFE_OK && map != NULL)
+        RM_RidMapFree(map);
+    if (recs != NULL)
+        free((char *) recs);
+    if (buf != NULL)
+        free(buf);
+    if (rids != NULL)
+        free((char *) rids);
+    free(tmpname);
+    return error;
+}
+
+/* New RID of the record that had RID "oldRid", from the map of
+   RM_ClusterFile(). RETURN VALUE: TRUE if the map has it, else FALSE. */
+int RM_RidMapLookup(map, oldRid, newRid)
+RM_RidMap *map;
+RID *oldRid;
+RID *newRid;
+{
+    RM_RidMapEnt e;
+    int lo = 0, hi = map->n - 1, mid, cmp;
+
+    e.oldRid = *oldRid;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if ((cmp = rm_RidMapCmp((char *) &e, (char *) &map->ents[mid])) == 0) {
+            *newRid = map->ents[mid].newRid;
+            return TRUE;
+        }
+        if (cmp < 0)
+            hi = mid - 1;
+        else
+            lo = mid + 1;
+    }
+    return FALSE;
+}
+
+void RM_RidMapFree(map)
+RM_RidMap *map;
+{
+    if (map->ents != NULL)
+        free((char *) map->ents);
+    map->ents = NULL;
+    map->n = 0;
+}
@@ -9,11 +9,88 @@ typedef struct RID {
     int slot;
 } RID;
 
+/************** RM Error Codes *************/
+/* RM functions also return PF error codes unchanged. RM codes are kept
+   out of PFerrno, which PF_PrintError() uses as a message index. */
+#define RME_NOTRMFILE   -101    /* file has no RM header page */
+#define RME_RECTOOBIG   -102    /* record does not fit in a page */
+#define RME_NOROOM      -103    /* no room left for a forwarding stub */
+#define RME_BADSCHEMA   -104    /* invalid schema or attribute */
+#define RME_BADVALUE    -105    /* value does not fit its attribute */
+#define RME_NOSCHEMA    -106    /* file has no schema */
+#define RME_BADFORMAT   -107    /* operation not supported by the page format */
+#define RME_NOTEMPTY    -108    /* file already holds records */
+#define RME_DICTFULL    -109    /* dictionary has no code left */
+
+/*
+ * Table schema and binary tuple format (rmtuple.c). A tuple is
+ *
+ *     null bitmap | offset array | field data
+ *
+ * The null bitmap has one bit per attribute (set = NULL). The offset
+ * array holds numAttrs+1 unsigned shorts: field i occupies bytes
+ * [off[i], off[i+1]) of the tuple, so any field is found in O(1) without
+ * looking at the others. Ints and floats are stored as 4 native bytes,
+ * fixed chars as exactly "length" bytes (NUL padded), varchars as their
+ * bytes only. Fields need not be aligned; accessors copy them out.
+ *
+ * A dictionary attribute is a string stored as a 2-byte code into a
+ * per-file dictionary of its distinct values (rmdict.c). Without the
+ * file, the tuple routines see the code: as text it is the code number.
+ */
+#define RM_TYPE_INT     'i'
+#define RM_TYPE_FLOAT   'f'
+#define RM_TYPE_CHAR    'c'     /* fixed length */
+#define RM_TYPE_VARCHAR 'v'     /* up to length bytes, 0 = unbounded */
+#define RM_TYPE_DICT    'd'     /* dictionary-encoded string */
+
+#define RM_DICT_MAXLEN  255     /* longest dictionary value */
+#define RM_DICT_CODES   65536   /* codes per dictionary */
+
+#define RM_MAX_ATTRS    32
+#define RM_MAX_ATTRNAME 24
+
+typedef struct RM_Attr {
+    char name[RM_MAX_ATTRNAME];
+    char type;          /* RM_TYPE_* */
+    int length;         /* bytes for char, max bytes for varchar,
+                           stored bytes otherwise */
+} RM_Attr;
+
+typedef struct RM_Schema {
+    int numAttrs;
+    int offsetPos;      /* byte position of the offset array */
+    int dataPos;        /* byte position of the first field */
+    RM_Attr attrs[RM_MAX_ATTRS];
+} RM_Schema;
+
+/* a field value to encode; sval/slen for char and varchar, ival for
+   int and dictionary codes */
+typedef struct RM_Value {
+    int isNull;
+    int ival;
+    float fval;
+    char *sval;
+    int slen;
+} RM_Value;
+
+/* Record layouts of a file (RM_SetFormat()). Slotted pages store whole
+   records; PAX pages (rmpax.c) store the tuples of a schema column by
+   column. */
+#define RM_FORMAT_SLOTTED 0
+#define RM_FORMAT_PAX     1
+
+struct RM_Dict;         /* in-memory dictionary, private to rmdict.c */
+
 typedef struct RM_FileHandle {
     int fd;
     int totalRecords;         /* total inserted */
     int totalDeleted;         /* total deleted (slot offset = -1) */
     int totalPayloadBytes;    /* total payload bytes */
+    int lastPage;             /* page of the last insert, tried first */
+    int format;               /* RM_FORMAT_*, from the file header */
+    RM_Schema schema;         /* copy of the file schema, if it has one */
+    struct RM_Dict *dict;     /* dictionaries of RM_TYPE_DICT attributes */
 } RM_FileHandle;
 
 typedef struct RM_Record {
@@ -21,18 +98,284 @@ typedef struct RM_Record {
     char *data;
 } RM_Record;
 
+/* Filter callback for scans: filter(data, length, arg) returns TRUE to
+   keep the record. It sees the record bytes inside the fixed page. */
+typedef int (*RM_FilterFcn)();
+
+/*
+ * Compiled predicate on one field of a record, evaluated in the page.
+ * With a schema the records are its tuples and the field is attribute
+ * "field" (NULL never matches); otherwise, with a delimiter the field
+ * is the "field"-th (from 0) run of bytes between delimiters, as in the
+ * ';'-separated tables under data/, and with delim 0 it is "length"
+ * bytes at byte "offset". Values are compared bytewise (memcmp order).
+ */
+#define RM_PRED_EQ      1       /* field == lo */
+#define RM_PRED_RANGE   2       /* lo <= field <= hi; NULL bound is open */
+#define RM_PRED_PREFIX  3       /* field starts with lo */
+
+typedef struct RM_Predicate {
+    int op;             /* RM_PRED_* */
+    RM_Schema *schema;  /* records are tuples of it, or NULL */
+    char delim;         /* field separator, or 0 for a fixed position */
+    int field;          /* field number when delim != 0 */
+    int offset;         /* field position when delim == 0 */
+    int length;
+    char *lo;           /* value (EQ, PREFIX) or lower bound (RANGE) */
+    int loLen;
+    char *hi;           /* upper bound (RANGE) */
+    int hiLen;
+    char code[2];       /* dictionary code, see RM_DictPredicate() */
+} RM_Predicate;
+
+/* Per-record callback of a parallel scan: fcn(worker, rid, rec, arg),
+   called in worker thread "worker" (0 .. numThreads-1). Returning
+   anything but PFE_OK stops the scan with that code. RM_FetchRIDs()
+   passes the position of the RID in its array instead of a worker. */
+typedef int (*RM_RecordFcn)();
+
+#define RM_MAX_WORKERS  64
+
+/* Parallel scan request. The file is cut into morsels of morselPages
+   pages that worker threads claim one at a time; each worker fixes its
+   own pages and calls fcn on every matching record. Per-worker state
+   is kept by the caller, indexed by worker, and merged afterwards. */
+typedef struct RM_ParScan {
+    int numThreads;     /* 1 .. RM_MAX_WORKERS */
+    int morselPages;    /* pages per morsel, <= 0 for the default */
+    RM_Predicate *pred; /* optional, as in RM_ScanOpenFilter() */
+    RM_FilterFcn filter;
+    char *filterArg;
+    RM_RecordFcn fcn;   /* optional per-record callback */
+    char *fcnArg;
+    long matched;       /* out: records that matched */
+    long workerMatched[RM_MAX_WORKERS];  /* out: the same, per worker */
+} RM_ParScan;
+
+/* Page sample request for RM_SamplePages(). The sample is drawn from
+   the pages of the file other than its header and free-space map
+   pages; fcn is called on every record whose home slot is on a sampled
+   data page, as by a parallel scan with one worker (worker 0). Counts
+   scaled by candidatePages / sampledPages estimate the whole file. */
+typedef struct RM_PageSample {
+    double fraction;    /* share of the pages to read, if count <= 0 */
+    int count;          /* number of pages to read, if > 0 */
+    unsigned int seed;  /* the same seed draws the same pages */
+    RM_RecordFcn fcn;   /* optional per-record callback */
+    char *fcnArg;
+    int candidatePages; /* out: pages the sample was drawn from */
+    int sampledPages;   /* out: pages read */
+    int dataPages;      /* out: data pages among them */
+    long records;       /* out: records on the sampled pages */
+    long bytes;         /* out: their length in bytes */
+    double estRecords;  /* out: estimated records in the file */
+} RM_PageSample;
+
+/* Scan cursor over the records of an RM file. The page holding the
+   current record stays fixed until the cursor moves off it, so records
+   returned by RM_ScanNextRef() can be read in place until then. */
+typedef struct RM_ScanHandle {
+    RM_FileHandle *fh;
+    int page;           /* current page, -1 before the first call */
+    char *pagebuf;      /* data of the current page, NULL if not fixed */
+    int slot;           /* slot last returned on the current page */
+    int eof;            /* TRUE once the scan has run off the file */
+    int fwdPage;        /* page of a moved record last returned */
+    char *fwdBuf;       /* its data, NULL if no such page is fixed */
+    RM_Predicate *pred; /* records must match it, if not NULL */
+    RM_FilterFcn filter;/* records must pass it, if not NULL */
+    char *filterArg;    /* passed to filter */
+    char *tupleBuf;     /* record rebuilt from a PAX page, or NULL */
+    int skipOverflow;   /* TRUE: overflow records come back as their prefix */
+    char *ovflStub;     /* stub of such a prefix last returned, or NULL */
+    char *ovflBuf;      /* overflow record assembled by the cursor, or NULL */
+    int ovflSize;       /* bytes allocated for ovflBuf */
+} RM_ScanHandle;
+
+/*
+ * File layout: page 0 holds the RM file header. Free-space map (FSM)
+ * pages sit at fixed positions, one every RM_FSM_SPAN+1 pages starting
+ * at page 1, each one covering the RM_FSM_SPAN pages that follow it.
+ * Every other page is a data page, slotted or PAX according to the
+ * file format. The first byte of every
+ * page is its page type.
+ */
+#define RM_PAGE_FILEHDR 'h'
+#define RM_PAGE_FSM     'f'
+#define RM_PAGE_DATA    'd'
+#define RM_PAGE_PAX     'p'
+#define RM_PAGE_DICT    'x'
+#define RM_PAGE_OVERFLOW 'o'
+
+#define RM_FILE_MAGIC   0x524d4631      /* "RMF1" */
+
+/* File header stored in page 0 */
+struct RM_FileHdr {
+    char pageType;      /* RM_PAGE_FILEHDR */
+    int magic;          /* RM_FILE_MAGIC */
+    int hasSchema;      /* TRUE if "schema" describes the records */
+    RM_Schema schema;
+    int format;         /* RM_FORMAT_* */
+    int dictPage[RM_MAX_ATTRS]; /* first dictionary page, 0 if none */
+};
+
+/* Dictionary pages hold the values of one dictionary attribute as
+   (length byte, bytes) entries; value k of the chain has code k. */
+struct RM_DictPageHdr {
+    char pageType;      /* RM_PAGE_DICT */
+    short numEntries;
+    int used;           /* bytes used, header included */
+    int next;           /* next page of the chain, 0 at the end */
+};
+
+/* FSM pages keep one 4-bit free-space class per data page; each class
+   stands for a lower bound on the bytes free in the page (see rm.c). */
+#define RM_FSM_HDR_SIZE 8
+#define RM_FSM_SPAN     ((PF_PAGE_SIZE - RM_FSM_HDR_SIZE) * 2)
+#define RM_FSM_CLASSES  16
+
 /* Page header stored in each slotted page */
 struct RM_PageHdr {
+    char pageType;      /* RM_PAGE_DATA */
     int freeStart;      /* offset where free space begins (grows upward) */
     int freeEnd;        /* offset where free space ends (grows downward) */
     int numSlots;       /* number of slots */
+    int freeSlots;      /* deleted slots, reused by later inserts */
+    int deadBytes;      /* bytes of deleted records not yet compacted away */
 };
 
 struct RM_Slot {
     short offset;       /* -1 means deleted */
-    short length;       /* length of record */
+    short length;       /* length of record, 0 once deleted, plus flags */
 };
 
+/*
+ * Slot flags, kept in the high bits of the slot length. A record that
+ * outgrows its page on update moves to another page and leaves a
+ * forwarding stub holding the RID it moved to; the moved copy starts
+ * with the RID of its stub (its home). RIDs handed out are always home
+ * RIDs, and a record is at most one hop away from its home.
+ */
+#define RM_SLOT_FORWARD 0x4000  /* stub: data is the RID of the record */
+#define RM_SLOT_MOVED   0x2000  /* moved record: data is home RID + record */
+#define RM_SLOT_OVERFLOW 0x1000 /* data is an overflow stub (may be moved) */
+#define RM_SLOT_LENMASK 0x0fff
+
+/*
+ * A record too big for an empty page, less the home RID a moved record
+ * carries (so that any record can still be moved), is kept as a stub in
+ * its slot: the record length, the first page of an overflow chain and
+ * the first RM_OVFL_PREFIX bytes of the record. The rest follows in
+ * order on the pages of the chain, which go back to the PF free list
+ * when the record is deleted or updated. Slotted files only.
+ */
+#define RM_OVFL_PREFIX  256
+
+struct RM_OvflStub {
+    int length;         /* bytes of the whole record */
+    int first;          /* first page of the chain */
+};
+
+struct RM_OvflPageHdr {
+    char pageType;      /* RM_PAGE_OVERFLOW */
+    int next;           /* next page of the chain, 0 at the end */
+    int used;           /* record bytes on this page */
+};
+
+/*
+ * PAX page: the records of the page are split into one minipage per
+ * attribute, laid out back to back after the header and a bitmap of
+ * deleted records:
+ *
+ *     header | deleted bits | minipage 0 | minipage 1 | ...
+ *
+ * A minipage holds a bitmap of NULL values, then (4-byte aligned) the
+ * values: numRecs fixed-size values for int, float and char, or for a
+ * varchar numRecs+1 unsigned short offsets followed by the bytes, value
+ * j being bytes [off[j], off[j+1]) after the offsets. mini[i] is where
+ * minipage i starts and mini[numAttrs] where the used space ends. The
+ * RID of a record is (page, position on the page); deleted records keep
+ * their position and their space.
+ */
+struct RM_PaxHdr {
+    char pageType;      /* RM_PAGE_PAX */
+    short numRecs;      /* records on the page, deleted ones included */
+    short numDeleted;
+    unsigned short mini[RM_MAX_ATTRS + 1];
+};
+
+/* One column of a PAX page as handed to an RM_ColumnFcn */
+typedef struct RM_Column {
+    int type;           /* RM_TYPE_* */
+    int length;         /* value size for int, float and char */
+    unsigned char *nulls;   /* bit j set: value j is NULL */
+    char *values;       /* n fixed-size values, or the varchar bytes */
+    unsigned short *offsets; /* varchar value j is values[off[j] .. off[j+1]) */
+} RM_Column;
+
+/* Columns of one PAX page, for RM_ColumnScan() */
+typedef struct RM_ColumnBatch {
+    int page;           /* record j has RID (page, j) */
+    int n;              /* records on the page */
+    unsigned char *deleted; /* bit j set: record j is deleted */
+    RM_Column cols[RM_MAX_ATTRS];   /* the requested attributes, in order */
+} RM_ColumnBatch;
+
+/* Column scan callback: fcn(batch, arg); anything but PFE_OK stops the
+   scan with that code. */
+typedef int (*RM_ColumnFcn)();
+
+/* RID remapping left by RM_ClusterFile(): one entry per record, sorted
+   by old RID */
+typedef struct RM_RidMapEnt {
+    RID oldRid;
+    RID newRid;
+} RM_RidMapEnt;
+
+typedef struct RM_RidMap {
+    int n;
+    RM_RidMapEnt *ents;
+} RM_RidMap;
+
+/* Record order for RM_SortOpen(): cmp(a, alen, b, blen, arg) is < 0,
+   0 or > 0 as record a sorts before, with or after record b. */
+typedef int (*RM_CompareFcn)();
+
+/*
+ * External sort of records (rmsort.c). Records are put one at a time
+ * into memBytes of memory; each time it fills they are sorted and
+ * written out as a run, a chain of pages of a temporary PF file. Then
+ * the runs are merged with a loser tree, as many at a time as memory
+ * holds a page of each, in passes until one merge is left, which
+ * RM_SortNext() reads. Input that fits in memory is never written.
+ * Equal records come out in the order they were put.
+ */
+typedef struct RM_SortHandle {
+    int recLen;         /* length of every record, or 0: variable */
+    RM_CompareFcn cmp;  /* NULL: bytewise, a prefix first */
+    char *cmpArg;
+    int memBytes;
+    char *mem;          /* record bytes upward, their entries downward */
+    int used;           /* record bytes in mem */
+    int n;              /* records in mem */
+    int next;           /* next record of mem for RM_SortNext() */
+    int fd;             /* temporary file, -1 until the first run */
+    char fname[40];
+    struct RM_SortRun *runs;
+    int nRuns;
+    int maxRuns;
+    int fanIn;          /* runs merged at a time */
+    int *tree;          /* loser tree of the final merge */
+    int last;           /* run of the record last returned, or -1 */
+    int done;           /* TRUE after RM_SortDone() */
+    long records;       /* out: records put */
+    int runsWritten;    /* out: runs written, merge passes included */
+    int mergePasses;    /* out: passes before the final merge */
+    long pagesWritten;  /* out: run pages written */
+} RM_SortHandle;
+
+#define RM_SORT_MINMEM  (4 * PF_PAGE_SIZE)
+
 /*********** RM Interface *************/
 int RM_CreateFile();     /* RM_CreateFile(char *fname) */
 int RM_DestroyFile();    /* RM_DestroyFile(char *fname) */
@@ -40,13 +383,84 @@ int RM_OpenFile();       /* RM_OpenFile(char *fname, RM_FileHandle *fh) */
 int RM_CloseFile();      /* RM_CloseFile(RM_FileHandle *fh) */
 
 int RM_InsertRecord();   /* RM_InsertRecord(fh, record, rid) */
+int RM_InsertRecords();  /* RM_InsertRecords(fh, recs, n, rids): bulk */
 int RM_DeleteRecord();   /* RM_DeleteRecord(fh, rid) */
+int RM_UpdateRecord();   /* RM_UpdateRecord(fh, rid, record) */
+int RM_GetRecord();      /* RM_GetRecord(fh, rid, record): copy by RID */
+int RM_FetchRIDs();      /* RM_FetchRIDs(fh, rids, n, inOrder, fcn, arg) */
 
 int RM_GetFirstRecord(); /* RM_GetFirstRecord(fh, rid, record) */
 int RM_GetNextRecord();  /* RM_GetNextRecord(fh, rid, record) */
 
+int RM_ScanOpen();       /* RM_ScanOpen(fh, scan) */
+int RM_ScanNext();       /* RM_ScanNext(scan, rid, record): copying */
+int RM_ScanNextRef();    /* RM_ScanNextRef(scan, rid, record): zero-copy */
+int RM_ScanClose();      /* RM_ScanClose(scan) */
+int RM_ScanSkipOverflow(); /* RM_ScanSkipOverflow(scan, skip) */
+int RM_ScanFetchOverflow();/* RM_ScanFetchOverflow(scan, record) */
+int RM_ScanOpenFilter(); /* RM_ScanOpenFilter(fh, scan, pred, filter, arg) */
+int RM_PredicateMatch(); /* RM_PredicateMatch(data, length, pred) */
+int RM_ParallelScan();   /* RM_ParallelScan(fh, parscan) */
+int RM_SamplePages();    /* RM_SamplePages(fh, sample): random pages */
+
+int RM_SetSchema();      /* RM_SetSchema(fh, schema): store in the header */
+int RM_GetSchema();      /* RM_GetSchema(fh, schema) */
+int RM_SetFormat();      /* RM_SetFormat(fh, format): on an empty file */
+
+/*********** Schema and Tuples (rmtuple.c) *************/
+int RM_SchemaInit();     /* RM_SchemaInit(schema) */
+int RM_SchemaAddAttr();  /* RM_SchemaAddAttr(schema, name, type, length) */
+int RM_TupleEncode();    /* RM_TupleEncode(schema, vals, buf, bufsize, &len) */
+int RM_TupleFromText();  /* RM_TupleFromText(schema, text, textlen, delim,
+                                            buf, bufsize, &len) */
+int RM_TupleToText();    /* RM_TupleToText(schema, tuple, delim, buf, bufsize) */
+int RM_TextIsInt();      /* RM_TextIsInt(field, len): a plain int? */
+int RM_TupleIsNull();    /* RM_TupleIsNull(schema, tuple, i) */
+char *RM_TupleField();   /* RM_TupleField(schema, tuple, i, &len) */
+int RM_TupleGetInt();    /* RM_TupleGetInt(schema, tuple, i) */
+float RM_TupleGetFloat();/* RM_TupleGetFloat(schema, tuple, i) */
+int RM_TupleGetCode();   /* RM_TupleGetCode(schema, tuple, i): -1 if NULL */
+int RM_DictTupleFromText(); /* RM_DictTupleFromText(fh, text, textlen, delim,
+                                                   buf, bufsize, &len) */
+int RM_DictTupleToText();   /* RM_DictTupleToText(fh, tuple, delim, buf, bufsize) */
+
+/*********** Dictionaries (rmdict.c) *************/
+int RM_DictEncode();     /* RM_DictEncode(fh, attr, value, len, &code) */
+int RM_DictLookup();     /* RM_DictLookup(fh, attr, value, len): code or -1 */
+char *RM_DictValue();    /* RM_DictValue(fh, attr, code, &len) */
+int RM_DictSize();       /* RM_DictSize(fh, attr): number of values */
+int RM_DictPredicate();  /* RM_DictPredicate(fh, attr, value, len, pred) */
+
+/* used by rm.c */
+int RMdictLoad();        /* RMdictLoad(fh): read the dictionaries */
+void RMdictFree();       /* RMdictFree(fh) */
+int RMallocPage();       /* RMallocPage(fh, &page, &pagebuf): in rm.c */
+
+/*********** External Sort (rmsort.c) *************/
+int RM_SortOpen();       /* RM_SortOpen(sort, recLen, memBytes, cmp, arg) */
+int RM_SortPut();        /* RM_SortPut(sort, rec, len) */
+int RM_SortDone();       /* RM_SortDone(sort): end of input */
+int RM_SortNext();       /* RM_SortNext(sort, &rec, &len): PFE_EOF at end */
+int RM_SortClose();      /* RM_SortClose(sort) */
+
+/*********** PAX Pages (rmpax.c) *************/
+int RM_ColumnScan();     /* RM_ColumnScan(fh, attrs, nattrs, fcn, arg) */
+
+/* page routines used by rm.c */
+void RMpaxInitPage();    /* RMpaxInitPage(schema, pagebuf) */
+int RMpaxAppend();       /* RMpaxAppend(schema, pagebuf, tuple, len) */
+int RMpaxDelete();       /* RMpaxDelete(pagebuf, j) */
+int RMpaxNextLive();     /* RMpaxNextLive(pagebuf, from) */
+int RMpaxGetTuple();     /* RMpaxGetTuple(schema, pagebuf, j, buf, bufsize, &len) */
+void RMpaxPageStats();   /* RMpaxPageStats(schema, pagebuf, &used, &recs, &deleted) */
+
 int RM_AnalyzePage(); /* RM_AnalyzePage(fh, pageNum) */
 
-int RM_ComputeFileStats();
+int RM_ComputeFileStats(); /* RM_ComputeFileStats(fh, &pages, &payload, &util,
+                               &slots, &deleted, &usedUtil, &compactUtil) */
+int RM_CompactFile();    /* RM_CompactFile(fh) */
+int RM_ClusterFile();    /* RM_ClusterFile(fname, key, map): rewrite in key order */
+int RM_RidMapLookup();   /* RM_RidMapLookup(map, oldrid, &newrid) */
+void RM_RidMapFree();    /* RM_RidMapFree(map) */
 
 #endif
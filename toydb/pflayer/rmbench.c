@@ -0,0 +1,553 @@
+/* rmbench.c: benchmark driver for RM layer scans.
+ *
+ * Loads every table of the data directory (the ';'-separated
+ * .txt files, title line skipped) into its own RM file with
+ * RM_InsertRecords(), then runs RM_ParallelScan() over all the tables
+ * on 1, 2, 4, ... threads and reports time, rows/sec and speedup
+ * against one thread.  The per-record callback splits the record into
+ * fields and folds every byte into a per-worker checksum; the merged
+ * checksums must agree across thread counts.
+ *
+ * Then the tables named with -P are stored again as schema tuples, once
+ * in slotted pages and once in PAX pages, with a schema inferred from
+ * the data (a column whose values are all plain integers is an int,
+ * every other column a varchar). Scans that read one column, two
+ * columns and whole records are timed on both layouts: slotted pages
+ * are read through RM_ScanNextRef() and the tuple accessors, PAX pages
+ * through RM_ColumnScan() for columns and RM_ScanNextRef() for records.
+ *
+ * Options (defaults in brackets):
+ *     -D dir    data directory                                 [../../data]
+ *     -b n      buffer pool size in pages                      [8192]
+ *     -t n      largest thread count                           [16]
+ *     -m n      pages per morsel                               [16]
+ *     -r n      scans per thread count, best one is reported   [3]
+ *     -w n      extra hash rounds per record (CPU work)        [0]
+ *     -P list   comma-separated tables for the layout scans    [student,studinfo]
+ *
+ * The pool should hold all loaded pages so that scans run from memory;
+ * every PF call is serialized on the PF latch, while the callback work
+ * runs in parallel.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include "rm.h"
+#include "pf.h"
+#include "pftypes.h"
+
+#define BENCH_MAX_TABLES 64
+
+/* benchmark configuration */
+static char *cfgDir     = "../../data";
+static int   cfgBuffers = 8192;
+static int   cfgThreads = 16;
+static int   cfgMorsel  = 16;
+static int   cfgReps    = 3;
+static int   cfgWork    = 0;
+static char *cfgPax     = "student,studinfo";
+
+/* loaded tables */
+static char  tabName[BENCH_MAX_TABLES][64];
+static RM_FileHandle tabFh[BENCH_MAX_TABLES];
+static int   tabRows[BENCH_MAX_TABLES];
+static int   numTables = 0;
+
+/* per-worker accumulators, padded apart to avoid false sharing */
+typedef struct BenchAcc {
+    unsigned long checksum;
+    long fields;
+    char pad[64 - sizeof(unsigned long) - sizeof(long)];
+} BenchAcc;
+
+static BenchAcc acc[RM_MAX_WORKERS];
+
+/* timestamp in milliseconds */
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/* per-record work: count fields and hash the bytes */
+static int scan_record(worker, rid, rec, arg)
+int worker;
+RID *rid;
+RM_Record *rec;
+char *arg;
+{
+    BenchAcc *a = &acc[worker];
+    unsigned long h = 5381;
+    int i, k;
+
+    for (i = 0; i < rec->length; i++) {
+        if (rec->data[i] == ';')
+            a->fields++;
+        h = h * 33 + (unsigned char) rec->data[i];
+    }
+    for (k = 0; k < cfgWork; k++)
+        h = (h ^ (h >> 13)) * 2654435761UL;
+    a->checksum += h & 0xffffffffUL;
+    return PFE_OK;
+}
+
+/* Load the table in "path" into RM file "rmname"; returns rows or -1.
+   With a schema the lines are stored as its tuples, in pages of the
+   given format; lines that do not fit the schema are left out. */
+static int load_table(path, rmname, fh, schema, format)
+char *path;
+char *rmname;
+RM_FileHandle *fh;
+RM_Schema *schema;
+int format;
+{
+    FILE *fp;
+    RM_Record *recs;
+    RID *rids;
+    char *buf, *p, *end, *eol, *arena;
+    long size;
+    int n, i, k, cap, extra, error;
+
+    if ((fp = fopen(path, "r")) == NULL)
+        return -1;
+    fseek(fp, 0L, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0L, SEEK_SET);
+    if ((buf = (char *) malloc(size + 1)) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    size = fread(buf, 1, size, fp);
+    fclose(fp);
+
+    /* one record per line; at most one line per two bytes */
+    cap = size / 2 + 1;
+    recs = (RM_Record *) malloc(cap * sizeof(RM_Record));
+    rids = (RID *) malloc(cap * sizeof(RID));
+    if (recs == NULL || rids == NULL) {
+        free(buf);
+        return -1;
+    }
+    n = 0;
+    end = buf + size;
+    p = memchr(buf, '\n', size);                /* skip the title line */
+    p = (p == NULL) ? end : p + 1;
+    while (p < end) {
+        eol = memchr(p, '\n', end - p);
+        if (eol == NULL)
+            eol = end;
+        recs[n].data = p;
+        recs[n].length = eol - p;
+        if (recs[n].length > 0 && p[recs[n].length - 1] == '\r')
+            recs[n].length--;
+        if (recs[n].length > 0)
+            n++;
+        p = eol + 1;
+    }
+
+    /* encode the lines as tuples; an int takes at most 3 bytes more
+       than its text */
+    arena = NULL;
+    extra = (schema == NULL) ? 0 : schema->dataPos + 3 * schema->numAttrs;
+    if (schema != NULL) {
+        if ((arena = (char *) malloc(size + (long) n * extra + 1)) == NULL) {
+            free(rids);
+            free(recs);
+            free(buf);
+            return -1;
+        }
+        p = arena;
+        for (i = k = 0; i < n; i++) {
+            if (RM_TupleFromText(schema, recs[i].data, recs[i].length, ';', p,
+                                 recs[i].length + extra,
+                                 &recs[k].length) != PFE_OK)
+                continue;
+            recs[k].data = p;
+            p += recs[k++].length;
+        }
+        n = k;
+    }
+
+    PF_DestroyFile(rmname);
+    error = RM_CreateFile(rmname);
+    if (error == PFE_OK)
+        error = RM_OpenFile(rmname, fh);
+    if (error == PFE_OK && schema != NULL) {
+        if ((error = RM_SetSchema(fh, schema)) == PFE_OK)
+            error = RM_SetFormat(fh, format);
+    }
+    if (error == PFE_OK)
+        error = RM_InsertRecords(fh, recs, n, rids);
+    if (arena != NULL)
+        free(arena);
+    free(rids);
+    free(recs);
+    free(buf);
+    return error == PFE_OK ? n : -1;
+}
+
+static int load_all()
+{
+    DIR *dir;
+    struct dirent *de;
+    char path[512], rmname[128];
+    int len, rows;
+
+    if ((dir = opendir(cfgDir)) == NULL) {
+        fprintf(stderr, "rmbench: cannot open %s\n", cfgDir);
+        return -1;
+    }
+    while ((de = readdir(dir)) != NULL && numTables < BENCH_MAX_TABLES) {
+        len = strlen(de->d_name);
+        if (len < 5 || len > 60 || strcmp(de->d_name + len - 4, ".txt") != 0)
+            continue;
+        sprintf(path, "%s/%s", cfgDir, de->d_name);
+        strcpy(tabName[numTables], de->d_name);
+        tabName[numTables][len - 4] = '\0';
+        sprintf(rmname, "rmbench_%s.rm", tabName[numTables]);
+        if ((rows = load_table(path, rmname, &tabFh[numTables],
+                               (RM_Schema *) NULL, RM_FORMAT_SLOTTED)) < 0) {
+            fprintf(stderr, "rmbench: cannot load %s\n", path);
+            continue;
+        }
+        tabRows[numTables++] = rows;
+    }
+    closedir(dir);
+    return numTables;
+}
+
+/* one parallel scan over every table; returns ms, sets rows and sum */
+static double scan_all(threads, rows, sum)
+int threads;
+long *rows;
+unsigned long *sum;
+{
+    RM_ParScan ps;
+    double t0, t1;
+    int i, error;
+
+    memset((char *) acc, 0, sizeof(acc));
+    memset((char *) &ps, 0, sizeof(ps));
+    ps.numThreads = threads;
+    ps.morselPages = cfgMorsel;
+    ps.fcn = scan_record;
+
+    *rows = 0;
+    t0 = now_ms();
+    for (i = 0; i < numTables; i++) {
+        if ((error = RM_ParallelScan(&tabFh[i], &ps)) != PFE_OK)
+            fprintf(stderr, "rmbench: scan of %s failed: %d\n", tabName[i], error);
+        *rows += ps.matched;
+    }
+    t1 = now_ms();
+
+    /* merge the per-worker results */
+    *sum = 0;
+    for (i = 0; i < threads; i++)
+        *sum += acc[i].checksum + (unsigned long) acc[i].fields;
+    return t1 - t0;
+}
+
+/*************** LAYOUT SCANS ****************/
+
+/* Infer a schema for the table in "path": as many columns as fields on
+   the first row, ints where every value is an int, varchars elsewhere */
+static int infer_schema(path, schema)
+char *path;
+RM_Schema *schema;
+{
+    FILE *fp;
+    char line[4096];
+    int isInt[RM_MAX_ATTRS];
+    int numFields, i, len, flen;
+    char *f, *end;
+
+    if ((fp = fopen(path, "r")) == NULL)
+        return -1;
+    fgets(line, sizeof(line), fp);              /* title */
+    numFields = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        len = strlen(line);
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+            len--;
+        if (len == 0)
+            continue;
+        if (numFields == 0) {
+            for (i = numFields = 1; i < len; i++)
+                numFields += (line[i] == ';');
+            if (line[0] == ';')
+                numFields++;
+            if (numFields > RM_MAX_ATTRS)
+                numFields = RM_MAX_ATTRS;
+            for (i = 0; i < numFields; i++)
+                isInt[i] = TRUE;
+        }
+        f = line;
+        end = line + len;
+        for (i = 0; i < numFields && f <= end; i++) {
+            flen = 0;
+            while (f + flen < end && f[flen] != ';')
+                flen++;
+            if (flen > 0 && !RM_TextIsInt(f, flen))
+                isInt[i] = FALSE;
+            f += flen + 1;
+        }
+    }
+    fclose(fp);
+
+    RM_SchemaInit(schema);
+    for (i = 0; i < numFields; i++) {
+        sprintf(line, "c%d", i);
+        RM_SchemaAddAttr(schema, line,
+                         isInt[i] ? RM_TYPE_INT : RM_TYPE_VARCHAR, 0);
+    }
+    return numFields;
+}
+
+/* fold column value "v" (an int, or a varchar length) into a checksum
+   that does not depend on the order of the records */
+#define BENCH_FOLD(sum, v)  ((sum) += ((unsigned long) (v) + 1) * 2654435761UL)
+
+/* read the first "ncols" columns of every record through the cursor;
+   ncols 0 touches whole records instead */
+static unsigned long slotted_scan(fh, schema, ncols)
+RM_FileHandle *fh;
+RM_Schema *schema;
+int ncols;
+{
+    RM_ScanHandle scan;
+    RM_Record rec;
+    RID rid;
+    unsigned long sum = 0;
+    int i, len;
+
+    RM_ScanOpen(fh, &scan);
+    while (RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK) {
+        if (ncols == 0)
+            BENCH_FOLD(sum, rec.length);
+        for (i = 0; i < ncols; i++) {
+            if (RM_TupleIsNull(schema, rec.data, i))
+                continue;
+            if (schema->attrs[i].type == RM_TYPE_INT)
+                BENCH_FOLD(sum, RM_TupleGetInt(schema, rec.data, i));
+            else {
+                RM_TupleField(schema, rec.data, i, &len);
+                BENCH_FOLD(sum, len);
+            }
+        }
+    }
+    RM_ScanClose(&scan);
+    return sum;
+}
+
+/* column callback: the same fold over the columns of a PAX page */
+static int pax_batch(batch, arg)
+RM_ColumnBatch *batch;
+char *arg;
+{
+    struct PaxArg { int ncols; unsigned long sum; } *pa;
+    RM_Column *col;
+    int i, j;
+
+    pa = (struct PaxArg *) arg;
+    for (j = 0; j < batch->n; j++) {
+        if ((batch->deleted[j / 8] >> (j % 8)) & 1)
+            continue;
+        for (i = 0; i < pa->ncols; i++) {
+            col = &batch->cols[i];
+            if ((col->nulls[j / 8] >> (j % 8)) & 1)
+                continue;
+            if (col->type == RM_TYPE_INT)
+                BENCH_FOLD(pa->sum, ((int *) col->values)[j]);
+            else
+                BENCH_FOLD(pa->sum, col->offsets[j + 1] - col->offsets[j]);
+        }
+    }
+    return PFE_OK;
+}
+
+static unsigned long pax_scan(fh, ncols)
+RM_FileHandle *fh;
+int ncols;
+{
+    struct PaxArg { int ncols; unsigned long sum; } pa;
+    int attrs[RM_MAX_ATTRS];
+    int i;
+
+    if (ncols == 0)
+        return slotted_scan(fh, &fh->schema, 0);
+    for (i = 0; i < ncols; i++)
+        attrs[i] = i;
+    pa.ncols = ncols;
+    pa.sum = 0;
+    RM_ColumnScan(fh, attrs, ncols, pax_batch, (char *) &pa);
+    return pa.sum;
+}
+
+/* Store table "name" in both layouts and time its scans on each */
+static void layout_scans(name)
+char *name;
+{
+    static int ncols[3] = { 1, 2, 0 };
+    RM_FileHandle fh[2];
+    RM_Schema schema;
+    char path[512], rmname[2][128], types[16];
+    double t0, ms[3], best;
+    unsigned long sum[2][3];
+    int fmt, q, rep, rows, pages, numInts, i;
+
+    sprintf(path, "%s/%s.txt", cfgDir, name);
+    if (infer_schema(path, &schema) <= 0) {
+        fprintf(stderr, "rmbench: cannot read %s\n", path);
+        return;
+    }
+    for (i = numInts = 0; i < schema.numAttrs; i++)
+        numInts += (schema.attrs[i].type == RM_TYPE_INT);
+
+    for (fmt = 0; fmt < 2; fmt++) {
+        sprintf(rmname[fmt], "rmbench_%s.%s", name, fmt == 0 ? "slot" : "pax");
+        rows = load_table(path, rmname[fmt], &fh[fmt], &schema,
+                          fmt == 0 ? RM_FORMAT_SLOTTED : RM_FORMAT_PAX);
+        if (rows < 0) {
+            fprintf(stderr, "rmbench: cannot load %s\n", path);
+            if (fmt == 1)
+                RM_CloseFile(&fh[0]);
+            return;
+        }
+        pages = PF_GetNumPages(fh[fmt].fd);
+        for (q = 0; q < 3; q++) {
+            best = -1.0;
+            for (rep = 0; rep < cfgReps; rep++) {
+                t0 = now_ms();
+                sum[fmt][q] = (fmt == 0) ? slotted_scan(&fh[fmt], &schema, ncols[q])
+                                         : pax_scan(&fh[fmt], ncols[q]);
+                t0 = now_ms() - t0;
+                if (best < 0 || t0 < best)
+                    best = t0;
+            }
+            ms[q] = best;
+        }
+        sprintf(types, "%d/%d", numInts, schema.numAttrs);
+        printf("| %-9s | %-7s | %5s | %5d | %6d | %8.2f | %9.2f | %8.2f | %8s |\n",
+               name, fmt == 0 ? "slotted" : "PAX", types, rows, pages,
+               ms[0], ms[1], ms[2],
+               fmt == 0 ? "" : (sum[0][0] == sum[1][0] && sum[0][1] == sum[1][1]
+                                && sum[0][2] == sum[1][2]) ? "ok" : "MISMATCH");
+    }
+    for (fmt = 0; fmt < 2; fmt++) {
+        RM_CloseFile(&fh[fmt]);
+        PF_DestroyFile(rmname[fmt]);
+    }
+}
+
+static void usage(prog)
+char *prog;
+{
+    fprintf(stderr,
+        "usage: %s [-D datadir] [-b bufs] [-t maxthreads] [-m morsel]\n"
+        "          [-r reps] [-w work] [-P table,table...]\n", prog);
+    exit(2);
+}
+
+int main(argc, argv)
+int argc;
+char **argv;
+{
+    char rmname[128], name[64];
+    char *p, *end;
+    double ms, best, base;
+    long rows, totalRows;
+    unsigned long sum, sum1;
+    int i, t, rep, pages;
+
+    for (i = 1; i < argc; i++) {
+        char *opt = argv[i];
+
+        if (opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0' || i + 1 >= argc)
+            usage(argv[0]);
+        ++i;
+        switch (opt[1]) {
+        case 'D': cfgDir = argv[i]; break;
+        case 'b': cfgBuffers = atoi(argv[i]); break;
+        case 't': cfgThreads = atoi(argv[i]); break;
+        case 'm': cfgMorsel = atoi(argv[i]); break;
+        case 'r': cfgReps = atoi(argv[i]); break;
+        case 'w': cfgWork = atoi(argv[i]); break;
+        case 'P': cfgPax = argv[i]; break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (cfgBuffers < 1 || cfgThreads < 1 || cfgThreads > RM_MAX_WORKERS
+        || cfgMorsel < 1 || cfgReps < 1 || cfgWork < 0)
+        usage(argv[0]);
+
+    PF_Init(cfgBuffers);
+    if (load_all() <= 0)
+        return 1;
+
+    totalRows = 0;
+    pages = 0;
+    for (i = 0; i < numTables; i++) {
+        totalRows += tabRows[i];
+        pages += PF_GetNumPages(tabFh[i].fd);
+    }
+    printf("Loaded %d tables, %ld rows, %d pages\n", numTables, totalRows, pages);
+    printf("Parallel scan, morsel %d pages, %d extra hash rounds per row:\n",
+           cfgMorsel, cfgWork);
+    printf("------------------------------------------------------------\n");
+    printf("| %7s | %10s | %12s | %7s | %10s |\n",
+           "threads", "time (ms)", "rows/sec", "speedup", "checksum");
+    printf("------------------------------------------------------------\n");
+
+    base = 0.0;
+    sum1 = 0;
+    for (t = 1; t <= cfgThreads; t *= 2) {
+        best = -1.0;
+        for (rep = 0; rep < cfgReps; rep++) {
+            ms = scan_all(t, &rows, &sum);
+            if (best < 0 || ms < best)
+                best = ms;
+        }
+        if (t == 1) {
+            base = best;
+            sum1 = sum;
+        }
+        printf("| %7d | %10.2f | %12.0f | %7.2f | %10s |\n", t, best,
+               best > 0 ? rows / (best / 1000.0) : 0.0,
+               best > 0 ? base / best : 0.0,
+               (rows == totalRows && sum == sum1) ? "ok" : "MISMATCH");
+    }
+    printf("------------------------------------------------------------\n");
+
+    for (i = 0; i < numTables; i++) {
+        RM_CloseFile(&tabFh[i]);
+        sprintf(rmname, "rmbench_%s.rm", tabName[i]);
+        PF_DestroyFile(rmname);
+    }
+
+    /* slotted against PAX pages */
+    printf("\nSchema tuples in slotted and PAX pages, best of %d scans:\n", cfgReps);
+    printf("------------------------------------------------------------------------------------------\n");
+    printf("| %-9s | %-7s | %5s | %5s | %6s | %8s | %9s | %8s | %8s |\n", "table", "layout",
+           "int/n", "rows", "pages", "1 col ms", "2 cols ms", "rows ms", "checksum");
+    printf("------------------------------------------------------------------------------------------\n");
+    for (p = cfgPax; *p != '\0'; p = (*end == ',') ? end + 1 : end) {
+        end = strchr(p, ',');
+        if (end == NULL)
+            end = p + strlen(p);
+        if (end - p > 0 && end - p < (int) sizeof(name)) {
+            memcpy(name, p, end - p);
+            name[end - p] = '\0';
+            layout_scans(name);
+        }
+    }
+    printf("------------------------------------------------------------------------------------------\n");
+    return 0;
+}
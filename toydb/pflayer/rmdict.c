@@ -0,0 +1,359 @@
+/* rmdict.c: dictionaries of the RM layer. The distinct values of each
+   RM_TYPE_DICT attribute of a file are numbered in order of arrival and
+   kept in a chain of dictionary pages; tuples store the 2-byte codes.
+   The dictionaries of an open file are also kept in memory: an array
+   from code to value and a hash table from value to code. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rm.h"
+#include "pf.h"
+#include "pftypes.h"
+
+/*************** INTERNAL CONSTANTS *****************/
+
+#define RM_DICT_HDR_SIZE  ((int) sizeof(struct RM_DictPageHdr))
+#define RM_DICT_HASH0     64      /* initial hash table size */
+
+/* in-memory dictionary of one attribute */
+struct RM_Dict {
+    int n;              /* values, codes 0 .. n-1 */
+    int cap;            /* size of vals[] and lens[] */
+    char **vals;
+    unsigned char *lens;
+    int *hash;          /* code + 1 per bucket, 0 if empty */
+    int hashSize;       /* a power of two, at least 2n */
+    int lastPage;       /* last page of the chain, 0 if none */
+};
+
+/*************** INTERNAL FUNCTIONS *****************/
+
+static unsigned int rm_DictHash(value, len)
+char *value;
+int len;
+{
+    unsigned int h = 2166136261U;   /* FNV-1a */
+    int i;
+
+    for (i = 0; i < len; i++)
+        h = (h ^ (unsigned char) value[i]) * 16777619U;
+    return h;
+}
+
+/* bucket of "value": the one holding it, or the empty one it would go to */
+static int rm_DictFind(d, value, len)
+struct RM_Dict *d;
+char *value;
+int len;
+{
+    int b, c;
+
+    b = rm_DictHash(value, len) & (d->hashSize - 1);
+    while ((c = d->hash[b]) != 0) {
+        c--;
+        if (d->lens[c] == len && memcmp(d->vals[c], value, len) == 0)
+            break;
+        b = (b + 1) & (d->hashSize - 1);
+    }
+    return b;
+}
+
+/* add "value" to the in-memory dictionary with the next code */
+static int rm_DictAddMem(d, value, len)
+struct RM_Dict *d;
+char *value;
+int len;
+{
+    char **vals;
+    unsigned char *lens;
+    int *hash;
+    int i, size;
+
+    if (d->n == d->cap) {
+        size = d->cap == 0 ? 64 : 2 * d->cap;
+        vals = (char **) realloc((char *) d->vals, size * sizeof(char *));
+        if (vals == NULL)
+            return PFE_NOMEM;
+        d->vals = vals;
+        lens = (unsigned char *) realloc((char *) d->lens, size);
+        if (lens == NULL)
+            return PFE_NOMEM;
+        d->lens = lens;
+        d->cap = size;
+    }
+    if (2 * (d->n + 1) > d->hashSize) {
+        /* grow the hash table and rehash */
+        size = d->hashSize == 0 ? RM_DICT_HASH0 : 2 * d->hashSize;
+        if ((hash = (int *) calloc(size, sizeof(int))) == NULL)
+            return PFE_NOMEM;
+        if (d->hash != NULL)
+            free((char *) d->hash);
+        d->hash = hash;
+        d->hashSize = size;
+        for (i = 0; i < d->n; i++)
+            d->hash[rm_DictFind(d, d->vals[i], d->lens[i])] = i + 1;
+    }
+    if ((d->vals[d->n] = (char *) malloc(len > 0 ? len : 1)) == NULL)
+        return PFE_NOMEM;
+    memcpy(d->vals[d->n], value, len);
+    d->lens[d->n] = len;
+    d->hash[rm_DictFind(d, value, len)] = d->n + 1;
+    d->n++;
+    return PFE_OK;
+}
+
+/* Append "value" to the page chain of attribute "attr", starting a new
+   page when the last one is full. */
+static int rm_DictAddPage(fh, attr, value, len)
+RM_FileHandle *fh;
+int attr;
+char *value;
+int len;
+{
+    struct RM_Dict *d = &fh->dict[attr];
+    struct RM_DictPageHdr *dhdr;
+    struct RM_FileHdr *fhdr;
+    char *pagebuf, *prevbuf;
+    int page, error;
+
+    if (d->lastPage != 0) {
+        if ((error = PF_GetThisPage(fh->fd, d->lastPage, &pagebuf)) != PFE_OK)
+            return error;
+        dhdr = (struct RM_DictPageHdr *) pagebuf;
+        if (dhdr->used + 1 + len <= PF_PAGE_SIZE) {
+            pagebuf[dhdr->used] = (char) len;
+            memcpy(pagebuf + dhdr->used + 1, value, len);
+            dhdr->used += 1 + len;
+            dhdr->numEntries++;
+            return PF_UnfixPage(fh->fd, d->lastPage, TRUE);
+        }
+        PF_UnfixPage(fh->fd, d->lastPage, FALSE);
+    }
+
+    /* start a new page and link it in */
+    if ((error = RMallocPage(fh, &page, &pagebuf)) != PFE_OK)
+        return error;
+    memset(pagebuf, 0, PF_PAGE_SIZE);
+    dhdr = (struct RM_DictPageHdr *) pagebuf;
+    dhdr->pageType = RM_PAGE_DICT;
+    dhdr->numEntries = 1;
+    dhdr->used = RM_DICT_HDR_SIZE + 1 + len;
+    dhdr->next = 0;
+    pagebuf[RM_DICT_HDR_SIZE] = (char) len;
+    memcpy(pagebuf + RM_DICT_HDR_SIZE + 1, value, len);
+    if ((error = PF_UnfixPage(fh->fd, page, TRUE)) != PFE_OK)
+        return error;
+
+    if (d->lastPage != 0) {
+        if ((error = PF_GetThisPage(fh->fd, d->lastPage, &prevbuf)) != PFE_OK)
+            return error;
+        ((struct RM_DictPageHdr *) prevbuf)->next = page;
+        error = PF_UnfixPage(fh->fd, d->lastPage, TRUE);
+    } else {
+        if ((error = PF_GetThisPage(fh->fd, 0, &prevbuf)) != PFE_OK)
+            return error;
+        fhdr = (struct RM_FileHdr *) prevbuf;
+        fhdr->dictPage[attr] = page;
+        error = PF_UnfixPage(fh->fd, 0, TRUE);
+    }
+    d->lastPage = page;
+    return error;
+}
+
+/*************** LOAD AND FREE ****************/
+
+/* Set up the dictionaries of the file schema, reading the values of
+   each from its page chain. A schema without dictionary attributes
+   needs none. */
+int RMdictLoad(fh)
+RM_FileHandle *fh;
+{
+    struct RM_DictPageHdr *dhdr;
+    int first[RM_MAX_ATTRS];
+    char *pagebuf;
+    int i, k, pos, page, next, error;
+
+    fh->dict = NULL;
+    for (i = 0; i < fh->schema.numAttrs; i++)
+        if (fh->schema.attrs[i].type == RM_TYPE_DICT)
+            break;
+    if (i == fh->schema.numAttrs)
+        return PFE_OK;
+
+    if ((fh->dict = (struct RM_Dict *) calloc(fh->schema.numAttrs,
+                                              sizeof(struct RM_Dict))) == NULL)
+        return PFE_NOMEM;
+    if ((error = PF_GetThisPage(fh->fd, 0, &pagebuf)) != PFE_OK)
+        return error;
+    memcpy((char *) first, (char *) ((struct RM_FileHdr *) pagebuf)->dictPage,
+           sizeof(first));
+    PF_UnfixPage(fh->fd, 0, FALSE);
+
+    for (i = 0; i < fh->schema.numAttrs; i++) {
+        for (page = first[i]; page != 0; page = next) {
+            if ((error = PF_GetThisPage(fh->fd, page, &pagebuf)) != PFE_OK)
+                return error;
+            dhdr = (struct RM_DictPageHdr *) pagebuf;
+            if (dhdr->pageType != RM_PAGE_DICT) {
+                PF_UnfixPage(fh->fd, page, FALSE);
+                return RME_NOTRMFILE;
+            }
+            pos = RM_DICT_HDR_SIZE;
+            error = PFE_OK;
+            for (k = 0; k < dhdr->numEntries && error == PFE_OK; k++) {
+                error = rm_DictAddMem(&fh->dict[i], pagebuf + pos + 1,
+                                      (unsigned char) pagebuf[pos]);
+                pos += 1 + (unsigned char) pagebuf[pos];
+            }
+            fh->dict[i].lastPage = page;
+            next = dhdr->next;
+            PF_UnfixPage(fh->fd, page, FALSE);
+            if (error != PFE_OK)
+                return error;
+        }
+    }
+    return PFE_OK;
+}
+
+void RMdictFree(fh)
+RM_FileHandle *fh;
+{
+    struct RM_Dict *d;
+    int i, k;
+
+    if (fh->dict == NULL)
+        return;
+    for (i = 0; i < fh->schema.numAttrs; i++) {
+        d = &fh->dict[i];
+        for (k = 0; k < d->n; k++)
+            free(d->vals[k]);
+        if (d->vals != NULL)
+            free((char *) d->vals);
+        if (d->lens != NULL)
+            free((char *) d->lens);
+        if (d->hash != NULL)
+            free((char *) d->hash);
+    }
+    free((char *) fh->dict);
+    fh->dict = NULL;
+}
+
+/*************** DICTIONARY INTERFACE ****************/
+
+/* Code of "value" in the dictionary of attribute "attr", which gets
+   the value with a new code if it does not have it yet.
+
+   RETURN VALUE: PFE_OK, RME_BADSCHEMA if "attr" is not a dictionary
+   attribute, RME_BADVALUE for a value longer than RM_DICT_MAXLEN,
+   RME_DICTFULL, or a PF error code. */
+int RM_DictEncode(fh, attr, value, len, code)
+RM_FileHandle *fh;
+int attr;
+char *value;
+int len;
+int *code;
+{
+    struct RM_Dict *d;
+    int b, error;
+
+    if (fh->dict == NULL || attr < 0 || attr >= fh->schema.numAttrs
+        || fh->schema.attrs[attr].type != RM_TYPE_DICT)
+        return RME_BADSCHEMA;
+    if (len < 0 || len > RM_DICT_MAXLEN)
+        return RME_BADVALUE;
+    d = &fh->dict[attr];
+    if (d->hashSize > 0 && d->hash[b = rm_DictFind(d, value, len)] != 0) {
+        *code = d->hash[b] - 1;
+        return PFE_OK;
+    }
+    if (d->n >= RM_DICT_CODES)
+        return RME_DICTFULL;
+
+    if ((error = rm_DictAddPage(fh, attr, value, len)) != PFE_OK)
+        return error;
+    if ((error = rm_DictAddMem(d, value, len)) != PFE_OK)
+        return error;
+    *code = d->n - 1;
+    return PFE_OK;
+}
+
+/* code of "value" for attribute "attr", or -1 if it has none */
+int RM_DictLookup(fh, attr, value, len)
+RM_FileHandle *fh;
+int attr;
+char *value;
+int len;
+{
+    struct RM_Dict *d;
+    int b;
+
+    if (fh->dict == NULL || attr < 0 || attr >= fh->schema.numAttrs
+        || fh->schema.attrs[attr].type != RM_TYPE_DICT)
+        return -1;
+    d = &fh->dict[attr];
+    if (d->hashSize == 0 || d->hash[b = rm_DictFind(d, value, len)] == 0)
+        return -1;
+    return d->hash[b] - 1;
+}
+
+/* value of "code" for attribute "attr" and its length in *len, or NULL */
+char *RM_DictValue(fh, attr, code, len)
+RM_FileHandle *fh;
+int attr;
+int code;
+int *len;
+{
+    struct RM_Dict *d;
+
+    if (fh->dict == NULL || attr < 0 || attr >= fh->schema.numAttrs
+        || fh->schema.attrs[attr].type != RM_TYPE_DICT)
+        return NULL;
+    d = &fh->dict[attr];
+    if (code < 0 || code >= d->n)
+        return NULL;
+    *len = d->lens[code];
+    return d->vals[code];
+}
+
+/* number of values in the dictionary of attribute "attr" */
+int RM_DictSize(fh, attr)
+RM_FileHandle *fh;
+int attr;
+{
+    if (fh->dict == NULL || attr < 0 || attr >= fh->schema.numAttrs
+        || fh->schema.attrs[attr].type != RM_TYPE_DICT)
+        return 0;
+    return fh->dict[attr].n;
+}
+
+/* Compile "attr == value" into "pred" as a comparison of codes, for
+   scans of the file's tuples. A value not in the dictionary gives a
+   predicate no record matches. "pred" keeps the code itself and must
+   not be copied while in use.
+
+   RETURN VALUE: TRUE if the value is in the dictionary, else FALSE. */
+int RM_DictPredicate(fh, attr, value, len, pred)
+RM_FileHandle *fh;
+int attr;
+char *value;
+int len;
+RM_Predicate *pred;
+{
+    unsigned short c;
+    int code = RM_DictLookup(fh, attr, value, len);
+
+    memset((char *) pred, 0, sizeof(RM_Predicate));
+    pred->op = RM_PRED_EQ;
+    pred->schema = &fh->schema;
+    pred->field = attr;
+    pred->lo = pred->code;
+    pred->loLen = 0;            /* matches no 2-byte code */
+    if (code < 0)
+        return FALSE;
+    c = code;
+    memcpy(pred->code, (char *) &c, 2);
+    pred->loLen = 2;
+    return TRUE;
+}
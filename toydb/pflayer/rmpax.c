@@ -0,0 +1,356 @@
+/* rmpax.c: PAX data pages of the RM layer. The records of a page are
+   stored column by column, one minipage per attribute; see rm.h for the
+   page layout. Records come in and go out as schema tuples (rmtuple.c). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rm.h"
+#include "pf.h"
+#include "pftypes.h"
+
+/*************** INTERNAL CONSTANTS *****************/
+
+#define RM_PAX_HDR_SIZE   ((int) sizeof(struct RM_PaxHdr))
+#define RM_PAX_BITS(n)    (((n) + 7) / 8)        /* bytes of an n-bit map */
+#define RM_PAX_ALIGN(pos) (((pos) + 3) & ~3)
+#define RM_PAX_OFFSIZE    ((int) sizeof(unsigned short))
+
+#define RM_PAX_BIT(map, j)    (((map)[(j) / 8] >> ((j) % 8)) & 1)
+#define RM_PAX_SETBIT(map, j) ((map)[(j) / 8] |= 1 << ((j) % 8))
+
+/*************** INTERNAL FUNCTIONS *****************/
+
+static struct RM_PaxHdr *rm_PaxHdr(pagebuf)
+char *pagebuf;
+{
+    return (struct RM_PaxHdr *) pagebuf;
+}
+
+/* position of the values of minipage "i" on a page of "n" records */
+static int rm_PaxVals(mini, i, n)
+unsigned short *mini;
+int i;
+int n;
+{
+    return RM_PAX_ALIGN(mini[i] + RM_PAX_BITS(n));
+}
+
+/* bytes of varchar data held by minipage "i" of "pagebuf" */
+static int rm_PaxVarBytes(pagebuf, i)
+char *pagebuf;
+int i;
+{
+    struct RM_PaxHdr *hdr = rm_PaxHdr(pagebuf);
+    unsigned short off;
+
+    memcpy((char *) &off, pagebuf + rm_PaxVals(hdr->mini, i, hdr->numRecs)
+           + hdr->numRecs * RM_PAX_OFFSIZE, RM_PAX_OFFSIZE);
+    return off;
+}
+
+/* Lay out a page of "n" records whose varchar attributes hold
+   varBytes[i] bytes: fill in mini[] and return the end of used space. */
+static int rm_PaxLayout(schema, n, varBytes, mini)
+RM_Schema *schema;
+int n;
+int varBytes[];
+unsigned short mini[];
+{
+    RM_Attr *attr;
+    int i, pos;
+
+    pos = RM_PAX_HDR_SIZE + RM_PAX_BITS(n);
+    for (i = 0; i < schema->numAttrs; i++) {
+        attr = &schema->attrs[i];
+        mini[i] = pos;
+        pos = RM_PAX_ALIGN(pos + RM_PAX_BITS(n));
+        if (attr->type == RM_TYPE_VARCHAR)
+            pos += (n + 1) * RM_PAX_OFFSIZE + varBytes[i];
+        else
+            pos += n * attr->length;
+        if (pos > PF_PAGE_SIZE)
+            return pos;         /* mini[] entries must not overflow */
+    }
+    mini[schema->numAttrs] = pos;
+    return pos;
+}
+
+/*************** PAGE ROUTINES ****************/
+
+/* Initialize an empty PAX page for records of "schema" */
+void RMpaxInitPage(schema, pagebuf)
+RM_Schema *schema;
+char *pagebuf;
+{
+    struct RM_PaxHdr *hdr = rm_PaxHdr(pagebuf);
+    int varBytes[RM_MAX_ATTRS];
+
+    memset(pagebuf, 0, PF_PAGE_SIZE);
+    memset((char *) varBytes, 0, sizeof(varBytes));
+    hdr->pageType = RM_PAGE_PAX;
+    hdr->numRecs = 0;
+    hdr->numDeleted = 0;
+    rm_PaxLayout(schema, 0, varBytes, hdr->mini);     /* offsets are 0 */
+}
+
+/* Append the tuple "tuple" of "len" bytes to the page. Every minipage
+   is shifted up to make room for one more value, starting with the
+   highest, then the values are written at the end of each.
+
+   RETURN VALUE: the position of the record on the page, RME_NOROOM if
+   it does not fit, or RME_BADVALUE if "tuple" is not a tuple of
+   "schema". */
+int RMpaxAppend(schema, pagebuf, tuple, len)
+RM_Schema *schema;
+char *pagebuf;
+char *tuple;
+int len;
+{
+    struct RM_PaxHdr *hdr = rm_PaxHdr(pagebuf);
+    RM_Attr *attr;
+    unsigned short newMini[RM_MAX_ATTRS + 1];
+    unsigned short off;
+    int oldVar[RM_MAX_ATTRS], newVar[RM_MAX_ATTRS];
+    int n = hdr->numRecs;
+    int i, flen, oldVals, newVals;
+    char *f;
+
+    if (len < schema->dataPos)
+        return RME_BADVALUE;
+    memcpy((char *) &off, tuple + schema->offsetPos
+           + schema->numAttrs * RM_PAX_OFFSIZE, RM_PAX_OFFSIZE);
+    if (off != len)
+        return RME_BADVALUE;
+
+    /* size of the page with the record added */
+    memset((char *) oldVar, 0, sizeof(oldVar));
+    memset((char *) newVar, 0, sizeof(newVar));
+    memset((char *) newMini, 0, sizeof(newMini));
+    for (i = 0; i < schema->numAttrs; i++) {
+        if (schema->attrs[i].type != RM_TYPE_VARCHAR)
+            continue;
+        oldVar[i] = rm_PaxVarBytes(pagebuf, i);
+        newVar[i] = oldVar[i];
+        if (!RM_TupleIsNull(schema, tuple, i)) {
+            RM_TupleField(schema, tuple, i, &flen);
+            newVar[i] += flen;
+        }
+    }
+    if (rm_PaxLayout(schema, n + 1, newVar, newMini) > PF_PAGE_SIZE)
+        return RME_NOROOM;
+
+    /* move the minipages up, highest bytes first */
+    for (i = schema->numAttrs - 1; i >= 0; i--) {
+        attr = &schema->attrs[i];
+        oldVals = rm_PaxVals(hdr->mini, i, n);
+        newVals = rm_PaxVals(newMini, i, n + 1);
+        if (attr->type == RM_TYPE_VARCHAR) {
+            memmove(pagebuf + newVals + (n + 2) * RM_PAX_OFFSIZE,
+                    pagebuf + oldVals + (n + 1) * RM_PAX_OFFSIZE, oldVar[i]);
+            memmove(pagebuf + newVals, pagebuf + oldVals, (n + 1) * RM_PAX_OFFSIZE);
+        } else {
+            memmove(pagebuf + newVals, pagebuf + oldVals, n * attr->length);
+        }
+        memmove(pagebuf + newMini[i], pagebuf + hdr->mini[i], RM_PAX_BITS(n));
+        if (RM_PAX_BITS(n + 1) > RM_PAX_BITS(n))
+            pagebuf[newMini[i] + RM_PAX_BITS(n)] = 0;
+    }
+    if (RM_PAX_BITS(n + 1) > RM_PAX_BITS(n))
+        pagebuf[RM_PAX_HDR_SIZE + RM_PAX_BITS(n)] = 0;
+    memcpy((char *) hdr->mini, (char *) newMini, sizeof(newMini));
+
+    /* write the values of record n */
+    for (i = 0; i < schema->numAttrs; i++) {
+        attr = &schema->attrs[i];
+        newVals = rm_PaxVals(hdr->mini, i, n + 1);
+        flen = 0;
+        f = NULL;
+        if (RM_TupleIsNull(schema, tuple, i))
+            RM_PAX_SETBIT((unsigned char *) pagebuf + hdr->mini[i], n);
+        else
+            f = RM_TupleField(schema, tuple, i, &flen);
+        if (attr->type == RM_TYPE_VARCHAR) {
+            off = oldVar[i] + flen;
+            memcpy(pagebuf + newVals + (n + 1) * RM_PAX_OFFSIZE,
+                   (char *) &off, RM_PAX_OFFSIZE);
+            if (flen > 0)
+                memcpy(pagebuf + newVals + (n + 2) * RM_PAX_OFFSIZE + oldVar[i],
+                       f, flen);
+        } else {
+            memset(pagebuf + newVals + n * attr->length, 0, attr->length);
+            if (flen > 0)
+                memcpy(pagebuf + newVals + n * attr->length, f,
+                       flen < attr->length ? flen : attr->length);
+        }
+    }
+    hdr->numRecs = n + 1;
+    return n;
+}
+
+/* Delete record "j". Its position and bytes stay taken.
+   RETURN VALUE: PFE_OK, PFE_INVALIDPAGE if there is no such record or
+   PFE_PAGEFREE if it is already deleted. */
+int RMpaxDelete(pagebuf, j)
+char *pagebuf;
+int j;
+{
+    struct RM_PaxHdr *hdr = rm_PaxHdr(pagebuf);
+    unsigned char *deleted = (unsigned char *) pagebuf + RM_PAX_HDR_SIZE;
+
+    if (j < 0 || j >= hdr->numRecs)
+        return PFE_INVALIDPAGE;
+    if (RM_PAX_BIT(deleted, j))
+        return PFE_PAGEFREE;
+    RM_PAX_SETBIT(deleted, j);
+    hdr->numDeleted++;
+    return PFE_OK;
+}
+
+/* first live record at or after position "from", or -1 */
+int RMpaxNextLive(pagebuf, from)
+char *pagebuf;
+int from;
+{
+    struct RM_PaxHdr *hdr = rm_PaxHdr(pagebuf);
+    unsigned char *deleted = (unsigned char *) pagebuf + RM_PAX_HDR_SIZE;
+    int j;
+
+    for (j = from; j < hdr->numRecs; j++)
+        if (!RM_PAX_BIT(deleted, j))
+            return j;
+    return -1;
+}
+
+/* Rebuild the tuple of record "j" into "buf" of "bufsize" bytes.
+   RETURN VALUE: as RMpaxDelete(), or an RM_TupleEncode() error. */
+int RMpaxGetTuple(schema, pagebuf, j, buf, bufsize, len)
+RM_Schema *schema;
+char *pagebuf;
+int j;
+char *buf;
+int bufsize;
+int *len;
+{
+    struct RM_PaxHdr *hdr = rm_PaxHdr(pagebuf);
+    RM_Value vals[RM_MAX_ATTRS];
+    RM_Attr *attr;
+    unsigned short off[2];
+    int i, n = hdr->numRecs;
+    char *v;
+
+    if (j < 0 || j >= n)
+        return PFE_INVALIDPAGE;
+    if (RM_PAX_BIT((unsigned char *) pagebuf + RM_PAX_HDR_SIZE, j))
+        return PFE_PAGEFREE;
+
+    for (i = 0; i < schema->numAttrs; i++) {
+        attr = &schema->attrs[i];
+        vals[i].isNull = RM_PAX_BIT((unsigned char *) pagebuf + hdr->mini[i], j);
+        if (vals[i].isNull)
+            continue;
+        v = pagebuf + rm_PaxVals(hdr->mini, i, n);
+        switch (attr->type) {
+        case RM_TYPE_INT:
+            memcpy((char *) &vals[i].ival, v + j * 4, 4);
+            break;
+        case RM_TYPE_FLOAT:
+            memcpy((char *) &vals[i].fval, v + j * 4, 4);
+            break;
+        case RM_TYPE_CHAR:
+            vals[i].sval = v + j * attr->length;
+            vals[i].slen = attr->length;
+            break;
+        case RM_TYPE_DICT:
+            memcpy((char *) off, v + j * 2, 2);
+            vals[i].ival = off[0];
+            break;
+        default:
+            memcpy((char *) off, v + j * RM_PAX_OFFSIZE, sizeof(off));
+            vals[i].sval = v + (n + 1) * RM_PAX_OFFSIZE + off[0];
+            vals[i].slen = off[1] - off[0];
+        }
+    }
+    return RM_TupleEncode(schema, vals, buf, bufsize, len);
+}
+
+/* bytes used past the header, records and deleted records of a page */
+void RMpaxPageStats(schema, pagebuf, used, recs, deleted)
+RM_Schema *schema;
+char *pagebuf;
+int *used;
+int *recs;
+int *deleted;
+{
+    struct RM_PaxHdr *hdr = rm_PaxHdr(pagebuf);
+
+    *used = hdr->mini[schema->numAttrs] - RM_PAX_HDR_SIZE;
+    *recs = hdr->numRecs;
+    *deleted = hdr->numDeleted;
+}
+
+/*************** COLUMN SCAN ****************/
+
+/* Call fcn(batch, arg) once for every PAX page of the file with the
+   columns of attributes attrs[0..nattrs-1] of its records. Values are
+   read in place from the fixed page, which is unfixed when fcn returns;
+   deleted records are flagged in batch->deleted, not skipped.
+
+   RETURN VALUE: PFE_OK, RME_BADFORMAT if the file is not a PAX file,
+   RME_BADSCHEMA for a bad attribute number, the first code other than
+   PFE_OK returned by fcn, or a PF error code. */
+int RM_ColumnScan(fh, attrs, nattrs, fcn, arg)
+RM_FileHandle *fh;
+int attrs[];
+int nattrs;
+RM_ColumnFcn fcn;
+char *arg;
+{
+    RM_ColumnBatch batch;
+    struct RM_PaxHdr *hdr;
+    RM_Attr *attr;
+    RM_Column *col;
+    char *pagebuf, *v;
+    int page = -1;
+    int i, error;
+
+    if (fh->format != RM_FORMAT_PAX)
+        return RME_BADFORMAT;
+    if (nattrs < 0 || nattrs > RM_MAX_ATTRS)
+        return RME_BADSCHEMA;
+    for (i = 0; i < nattrs; i++)
+        if (attrs[i] < 0 || attrs[i] >= fh->schema.numAttrs)
+            return RME_BADSCHEMA;
+
+    while ((error = PF_GetNextPage(fh->fd, &page, &pagebuf)) == PFE_OK) {
+        if (pagebuf[0] != RM_PAGE_PAX) {
+            PF_UnfixPage(fh->fd, page, FALSE);
+            continue;
+        }
+        hdr = rm_PaxHdr(pagebuf);
+        batch.page = page;
+        batch.n = hdr->numRecs;
+        batch.deleted = (unsigned char *) pagebuf + RM_PAX_HDR_SIZE;
+        for (i = 0; i < nattrs; i++) {
+            attr = &fh->schema.attrs[attrs[i]];
+            col = &batch.cols[i];
+            v = pagebuf + rm_PaxVals(hdr->mini, attrs[i], batch.n);
+            col->type = attr->type;
+            col->length = attr->length;
+            col->nulls = (unsigned char *) pagebuf + hdr->mini[attrs[i]];
+            if (attr->type == RM_TYPE_VARCHAR) {
+                col->offsets = (unsigned short *) v;
+                col->values = v + (batch.n + 1) * RM_PAX_OFFSIZE;
+            } else {
+                col->offsets = NULL;
+                col->values = v;
+            }
+        }
+        error = (*fcn)(&batch, arg);
+        PF_UnfixPage(fh->fd, page, FALSE);
+        if (error != PFE_OK)
+            return error;
+    }
+    return (error == PFE_EOF) ? PFE_OK : error;
+}
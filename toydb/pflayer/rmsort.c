@@ -0,0 +1,524 @@
+/* rmsort.c: external merge sort of records for the RM layer. Records
+   are gathered in a fixed amount of memory and sorted there; what does
+   not fit is written out in sorted runs to a temporary PF file and the
+   runs are merged k at a time with a loser tree. Index builds sort
+   (key, recid) pairs with it; any ordering of byte strings will do. */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rm.h"
+#include "pf.h"
+#include "pftypes.h"
+
+/*************** INTERNAL CONSTANTS *****************/
+
+/* Run pages: this header, then the records back to back, each one
+   after its 2-byte length unless all records have the same length. */
+struct RM_SortPageHdr {
+    int next;           /* next page of the run, -1 at the end */
+    int used;           /* bytes used, header included */
+};
+
+#define RM_SORT_HDR_SIZE  ((int) sizeof(struct RM_SortPageHdr))
+#define RM_SORT_MAXREC    (PF_PAGE_SIZE - RM_SORT_HDR_SIZE - (int) sizeof(unsigned short))
+
+/* a record in memory */
+struct rm_SortEnt {
+    char *rec;
+    int len;
+};
+
+/* a run being read: its current page is copied out of the buffer pool */
+struct RM_SortRun {
+    int first;          /* first page of the run */
+    int next;           /* next page to read, -1 at the end */
+    char *buf;          /* PF_PAGE_SIZE bytes: the current page */
+    int off;            /* offset of the next record in buf */
+    int used;
+    char *rec;          /* current record, NULL once the run is over */
+    int len;
+};
+
+/* a run being written; its last page stays fixed */
+struct rm_SortOut {
+    int first;
+    int page;
+    char *buf;          /* NULL until the first record */
+    int used;
+};
+
+/*************** INTERNAL FUNCTIONS *****************/
+
+static int rm_SortCmp(sh, a, alen, b, blen)
+RM_SortHandle *sh;
+char *a;
+int alen;
+char *b;
+int blen;
+{
+    int c;
+
+    if (sh->cmp != NULL)
+        return (*sh->cmp)(a, alen, b, blen, sh->cmpArg);
+    c = memcmp(a, b, alen < blen ? alen : blen);
+    return (c != 0) ? c : alen - blen;
+}
+
+/* entries of the records in memory: entry i is ents[-1-i] */
+#define RM_SORT_TOP(sh)  ((struct rm_SortEnt *) ((sh)->mem + (sh)->memBytes))
+
+/* sort the n records in memory, stably; the space below their entries
+   (reserved by RM_SortPut()) is the merge buffer. Leaves the entries in
+   input-then-sorted order at RM_SORT_TOP(sh) - n. */
+static void rm_SortMem(sh)
+RM_SortHandle *sh;
+{
+    int n = sh->n;
+    struct rm_SortEnt *ents = RM_SORT_TOP(sh) - n;
+    struct rm_SortEnt *a = ents, *b = ents - n, *t, e;
+    int w, lo, mid, hi, i, j, k;
+
+    /* entries were pushed downward: put them in input order */
+    for (i = 0, j = n - 1; i < j; i++, j--) {
+        e = ents[i];
+        ents[i] = ents[j];
+        ents[j] = e;
+    }
+
+    /* bottom-up merge sort between a and b */
+    for (w = 1; w < n; w *= 2) {
+        for (lo = 0; lo < n; lo += 2 * w) {
+            mid = (lo + w < n) ? lo + w : n;
+            hi = (lo + 2 * w < n) ? lo + 2 * w : n;
+            i = lo;
+            j = mid;
+            k = lo;
+            while (i < mid && j < hi) {
+                if (rm_SortCmp(sh, a[j].rec, a[j].len, a[i].rec, a[i].len) < 0)
+                    b[k++] = a[j++];
+                else
+                    b[k++] = a[i++];
+            }
+            while (i < mid)
+                b[k++] = a[i++];
+            while (j < hi)
+                b[k++] = a[j++];
+        }
+        t = a;
+        a = b;
+        b = t;
+    }
+    if (a != ents)
+        memcpy(ents, a, n * sizeof(struct rm_SortEnt));
+}
+
+/* create the temporary file of the runs */
+static int rm_SortTempFile(sh)
+RM_SortHandle *sh;
+{
+    static int seq = 0;
+    int tries, error = PFE_OK;
+
+    for (tries = 0; tries < 100; tries++) {
+        sprintf(sh->fname, "rmsort.%d.%d.tmp", (int) getpid(), seq++);
+        if ((error = PF_CreateFile(sh->fname)) == PFE_OK)
+            break;
+    }
+    if (error != PFE_OK)
+        return error;
+    if ((sh->fd = PF_OpenFile(sh->fname, PF_REPLACE_LRU)) < 0) {
+        PF_DestroyFile(sh->fname);
+        return sh->fd;
+    }
+    return PFE_OK;
+}
+
+/* append a record to a run being written */
+static int rm_SortOutPut(sh, out, rec, len)
+RM_SortHandle *sh;
+struct rm_SortOut *out;
+char *rec;
+int len;
+{
+    int size = len + (sh->recLen > 0 ? 0 : (int) sizeof(unsigned short));
+    int error, page;
+    char *buf;
+    unsigned short l;
+
+    if (out->buf == NULL || out->used + size > PF_PAGE_SIZE) {
+        if ((error = PF_AllocPage(sh->fd, &page, &buf)) != PFE_OK)
+            return error;
+        if (out->buf == NULL)
+            out->first = page;
+        else {
+            ((struct RM_SortPageHdr *) out->buf)->next = page;
+            ((struct RM_SortPageHdr *) out->buf)->used = out->used;
+            if ((error = PF_UnfixPage(sh->fd, out->page, TRUE)) != PFE_OK) {
+                PF_UnfixPage(sh->fd, page, FALSE);
+                out->buf = NULL;
+                return error;
+            }
+        }
+        out->page = page;
+        out->buf = buf;
+        out->used = RM_SORT_HDR_SIZE;
+        sh->pagesWritten++;
+    }
+    if (sh->recLen <= 0) {
+        l = (unsigned short) len;
+        memcpy(out->buf + out->used, (char *) &l, sizeof(l));
+        out->used += sizeof(l);
+    }
+    memcpy(out->buf + out->used, rec, len);
+    out->used += len;
+    return PFE_OK;
+}
+
+/* finish a run being written */
+static int rm_SortOutClose(sh, out)
+RM_SortHandle *sh;
+struct rm_SortOut *out;
+{
+    ((struct RM_SortPageHdr *) out->buf)->next = -1;
+    ((struct RM_SortPageHdr *) out->buf)->used = out->used;
+    out->buf = NULL;
+    sh->runsWritten++;
+    return PF_UnfixPage(sh->fd, out->page, TRUE);
+}
+
+/* sort the records in memory out to a new run and empty the memory */
+static int rm_SortSpill(sh)
+RM_SortHandle *sh;
+{
+    struct rm_SortEnt *ents;
+    struct rm_SortOut out;
+    int i, error = PFE_OK;
+
+    if (sh->fd < 0 && (error = rm_SortTempFile(sh)) != PFE_OK)
+        return error;
+    if (sh->nRuns == sh->maxRuns) {
+        struct RM_SortRun *runs;
+        int max = (sh->maxRuns == 0) ? 16 : 2 * sh->maxRuns;
+
+        runs = (struct RM_SortRun *) realloc(sh->runs, max * sizeof(struct RM_SortRun));
+        if (runs == NULL)
+            return PFE_NOMEM;
+        sh->runs = runs;
+        sh->maxRuns = max;
+    }
+
+    rm_SortMem(sh);
+    ents = RM_SORT_TOP(sh) - sh->n;
+    out.buf = NULL;
+    for (i = 0; i < sh->n && error == PFE_OK; i++)
+        error = rm_SortOutPut(sh, &out, ents[i].rec, ents[i].len);
+    if (out.buf != NULL) {
+        if (error == PFE_OK)
+            error = rm_SortOutClose(sh, &out);
+        else
+            PF_UnfixPage(sh->fd, out.page, TRUE);
+    }
+    if (error != PFE_OK)
+        return error;
+
+    sh->runs[sh->nRuns++].first = out.first;
+    sh->n = 0;
+    sh->used = 0;
+    return PFE_OK;
+}
+
+/* move a run being read to its next record */
+static int rm_SortRunNext(sh, run)
+RM_SortHandle *sh;
+struct RM_SortRun *run;
+{
+    struct RM_SortPageHdr *hdr;
+    unsigned short l;
+    char *pagebuf;
+    int error;
+
+    if (run->off >= run->used) {
+        if (run->next < 0) {
+            run->rec = NULL;
+            return PFE_OK;
+        }
+        if ((error = PF_GetThisPage(sh->fd, run->next, &pagebuf)) != PFE_OK)
+            return error;
+        memcpy(run->buf, pagebuf, PF_PAGE_SIZE);
+        if ((error = PF_UnfixPage(sh->fd, run->next, FALSE)) != PFE_OK)
+            return error;
+        hdr = (struct RM_SortPageHdr *) run->buf;
+        run->next = hdr->next;
+        run->used = hdr->used;
+        run->off = RM_SORT_HDR_SIZE;
+    }
+    if (sh->recLen > 0)
+        run->len = sh->recLen;
+    else {
+        memcpy((char *) &l, run->buf + run->off, sizeof(l));
+        run->off += sizeof(l);
+        run->len = l;
+    }
+    run->rec = run->buf + run->off;
+    run->off += run->len;
+    return PFE_OK;
+}
+
+/* does the record of run a go out before that of run b? A finished run
+   goes after every other, -1 stands for a run before every other, and
+   between equal records the earlier run goes first. */
+static int rm_SortBeats(sh, r, a, b)
+RM_SortHandle *sh;
+struct RM_SortRun *r;
+int a;
+int b;
+{
+    int c;
+
+    if (a < 0)
+        return TRUE;
+    if (b < 0)
+        return FALSE;
+    if (r[a].rec == NULL)
+        return r[b].rec == NULL && a < b;
+    if (r[b].rec == NULL)
+        return TRUE;
+    c = rm_SortCmp(sh, r[a].rec, r[a].len, r[b].rec, r[b].len);
+    return c < 0 || (c == 0 && a < b);
+}
+
+/* replay the matches of run s up the loser tree of k runs: tree[1..k-1]
+   hold the losers, tree[0] the winner */
+static void rm_SortAdjust(sh, r, tree, k, s)
+RM_SortHandle *sh;
+struct RM_SortRun *r;
+int *tree;
+int k;
+int s;
+{
+    int t, w = s, x;
+
+    for (t = (s + k) / 2; t > 0; t /= 2) {
+        if (rm_SortBeats(sh, r, tree[t], w)) {
+            x = tree[t];
+            tree[t] = w;
+            w = x;
+        }
+    }
+    tree[0] = w;
+}
+
+/* start reading k runs into the page buffers in memory, and build their
+   loser tree */
+static int rm_SortMergeStart(sh, r, k, tree)
+RM_SortHandle *sh;
+struct RM_SortRun *r;
+int k;
+int *tree;
+{
+    int i, error;
+
+    for (i = 0; i < k; i++) {
+        r[i].buf = sh->mem + i * PF_PAGE_SIZE;
+        r[i].next = r[i].first;
+        r[i].off = r[i].used = 0;
+        if ((error = rm_SortRunNext(sh, &r[i])) != PFE_OK)
+            return error;
+    }
+    for (i = 0; i < k; i++)
+        tree[i] = -1;
+    for (i = k - 1; i >= 0; i--)
+        rm_SortAdjust(sh, r, tree, k, i);
+    return PFE_OK;
+}
+
+/* merge the runs in groups of fanIn, each group into one run in its
+   place */
+static int rm_SortPass(sh)
+RM_SortHandle *sh;
+{
+    struct rm_SortOut out;
+    struct RM_SortRun *r;
+    int i, k, w, nOut = 0, error = PFE_OK;
+
+    for (i = 0; i < sh->nRuns; i += k) {
+        k = (sh->nRuns - i < sh->fanIn) ? sh->nRuns - i : sh->fanIn;
+        r = sh->runs + i;
+        if (k == 1) {
+            sh->runs[nOut++] = *r;
+            continue;
+        }
+        if ((error = rm_SortMergeStart(sh, r, k, sh->tree)) != PFE_OK)
+            return error;
+        out.buf = NULL;
+        while (error == PFE_OK && r[w = sh->tree[0]].rec != NULL) {
+            if ((error = rm_SortOutPut(sh, &out, r[w].rec, r[w].len)) == PFE_OK &&
+                (error = rm_SortRunNext(sh, &r[w])) == PFE_OK)
+                rm_SortAdjust(sh, r, sh->tree, k, w);
+        }
+        if (out.buf != NULL) {
+            if (error == PFE_OK)
+                error = rm_SortOutClose(sh, &out);
+            else
+                PF_UnfixPage(sh->fd, out.page, TRUE);
+        }
+        if (error != PFE_OK)
+            return error;
+        sh->runs[nOut++].first = out.first;
+    }
+    sh->nRuns = nOut;
+    sh->mergePasses++;
+    return PFE_OK;
+}
+
+/****************** INTERFACE FUNCTIONS ********************/
+
+/* Start a sort of records of recLen bytes each (0: of any length up to
+   a page) within about memBytes of memory, in the order of cmp. */
+int RM_SortOpen(sh, recLen, memBytes, cmp, cmpArg)
+RM_SortHandle *sh;
+int recLen;
+int memBytes;
+RM_CompareFcn cmp;
+char *cmpArg;
+{
+    if (recLen < 0 || recLen > RM_SORT_MAXREC)
+        return RME_RECTOOBIG;
+    if (memBytes < RM_SORT_MINMEM)
+        memBytes = RM_SORT_MINMEM;
+    memBytes -= memBytes % (int) sizeof(struct rm_SortEnt);
+
+    memset((char *) sh, 0, sizeof(*sh));
+    sh->recLen = recLen;
+    sh->cmp = cmp;
+    sh->cmpArg = cmpArg;
+    sh->memBytes = memBytes;
+    sh->fd = -1;
+    sh->last = -1;
+    sh->fanIn = memBytes / PF_PAGE_SIZE;
+    if ((sh->mem = malloc(memBytes)) == NULL)
+        return PFE_NOMEM;
+    if ((sh->tree = (int *) malloc(sh->fanIn * sizeof(int))) == NULL) {
+        free(sh->mem);
+        return PFE_NOMEM;
+    }
+    return PFE_OK;
+}
+
+/* Add a record; it is copied. */
+int RM_SortPut(sh, rec, len)
+RM_SortHandle *sh;
+char *rec;
+int len;
+{
+    struct rm_SortEnt *e;
+    int error;
+
+    if (sh->recLen > 0 && len != sh->recLen)
+        return RME_BADVALUE;
+    if (len < 0 || len > RM_SORT_MAXREC)
+        return RME_RECTOOBIG;
+
+    /* a record costs its bytes, its entry and one more entry to merge */
+    if (sh->used + len + 2 * (sh->n + 1) * (int) sizeof(struct rm_SortEnt) > sh->memBytes)
+        if ((error = rm_SortSpill(sh)) != PFE_OK)
+            return error;
+
+    memcpy(sh->mem + sh->used, rec, len);
+    e = RM_SORT_TOP(sh) - 1 - sh->n;
+    e->rec = sh->mem + sh->used;
+    e->len = len;
+    sh->used += len;
+    sh->n++;
+    sh->records++;
+    return PFE_OK;
+}
+
+/* End of input: sort what is in memory, or write it out and merge the
+   runs until one merge of at most fanIn runs is left. */
+int RM_SortDone(sh)
+RM_SortHandle *sh;
+{
+    int error;
+
+    if (sh->done)
+        return PFE_OK;
+    sh->done = TRUE;
+    if (sh->fd < 0) {
+        rm_SortMem(sh);
+        sh->next = 0;
+        return PFE_OK;
+    }
+    if (sh->n > 0 && (error = rm_SortSpill(sh)) != PFE_OK)
+        return error;
+    while (sh->nRuns > sh->fanIn)
+        if ((error = rm_SortPass(sh)) != PFE_OK)
+            return error;
+    return rm_SortMergeStart(sh, sh->runs, sh->nRuns, sh->tree);
+}
+
+/* Next record in order. It can be read until the next call. Returns
+   PFE_EOF after the last record. */
+int RM_SortNext(sh, rec, len)
+RM_SortHandle *sh;
+char **rec;
+int *len;
+{
+    struct rm_SortEnt *e;
+    struct RM_SortRun *r;
+    int w, error;
+
+    if (!sh->done && (error = RM_SortDone(sh)) != PFE_OK)
+        return error;
+
+    if (sh->fd < 0) {
+        if (sh->next >= sh->n)
+            return PFE_EOF;
+        e = RM_SORT_TOP(sh) - sh->n + sh->next++;
+        *rec = e->rec;
+        *len = e->len;
+        return PFE_OK;
+    }
+
+    r = sh->runs;
+    if (sh->last >= 0) {
+        if ((error = rm_SortRunNext(sh, &r[sh->last])) != PFE_OK)
+            return error;
+        rm_SortAdjust(sh, r, sh->tree, sh->nRuns, sh->last);
+    }
+    w = sh->tree[0];
+    if (r[w].rec == NULL)
+        return PFE_EOF;
+    sh->last = w;
+    *rec = r[w].rec;
+    *len = r[w].len;
+    return PFE_OK;
+}
+
+/* Free the memory and remove the temporary file. */
+int RM_SortClose(sh)
+RM_SortHandle *sh;
+{
+    int error = PFE_OK;
+
+    if (sh->fd >= 0) {
+        error = PF_CloseFile(sh->fd);
+        if (error == PFE_OK)
+            error = PF_DestroyFile(sh->fname);
+        else
+            PF_DestroyFile(sh->fname);
+        sh->fd = -1;
+    }
+    free(sh->mem);
+    free(sh->runs);
+    free(sh->tree);
+    sh->mem = NULL;
+    sh->runs = NULL;
+    sh->tree = NULL;
+    return error;
+}
@@ -4,11 +4,33 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <sys/time.h>
 #include "rm.h"
 #include "pf.h"
+#include "pftypes.h"
 
 #define TEST_FILE "students.rm"
+#define BULK_FILE "students_bulk.rm"
+#define REGN_FILE "studregn.rm"
+#define REGN_DATA "../../data/studregn.txt"
+#define REGN_COURSE "CH 831"
+#define REGN_PASSES 5
+#define STUD_TEXT "student_text.rm"
+#define STUD_TUPLE "student_tuple.rm"
+#define STUD_PAX "student_pax.rm"
+#define DICT_FILE "dict.rm"
+#define OVFL_FILE "overflow.rm"
+#define OVFL_RECORDS 400
+#define SAMPLE_FILE "gradsum.rm"
+#define SAMPLE_DATA "../../data/gradsum.txt"
+#define SAMPLE_YEAR "1995"
+#define SAMPLE_SEED 42
+#define SORT_DATA SAMPLE_DATA
+#define STUD_DATA "../../data/student.txt"
+#define ID_LO 960000
+#define ID_HI 969999
 #define NUM_RECORDS 5000
+#define SCAN_PASSES 20
 
 /* create synthetic student record */
 static void make_student_record(buf, len, recno)
@@ -32,6 +54,1401 @@ int recSize;
     return 100.0 * (double)bytes / (double)PF_PAGE_SIZE;
 }
 
+static double elapsed_ms(t0, t1)
+struct timeval *t0;
+struct timeval *t1;
+{
+    return (double)(t1->tv_sec - t0->tv_sec) * 1000.0 +
+           (double)(t1->tv_usec - t0->tv_usec) / 1000.0;
+}
+
+static void scan_row(api, records, mallocs, fixes, ms)
+char *api;
+long records;
+long mallocs;
+long fixes;
+double ms;
+{
+    printf("| %-14s | %8ld | %8ld | %10.2f | %10.2f | %10.0f |\n", api,
+           records, mallocs, records > 0 ? (double)fixes / records : 0.0,
+           ms, ms > 0 ? records / (ms / 1000.0) : 0.0);
+}
+
+/* full scans through the copying API, the copying cursor and the
+   zero-copy cursor */
+static void scan_compare(fh)
+RM_FileHandle *fh;
+{
+    struct timeval t0, t1;
+    RID rid;
+    RM_Record rec;
+    RM_ScanHandle scan;
+    long records, mallocs, sum[3];
+    int pass, error;
+
+    printf("\nScan comparison (%d full scans):\n", SCAN_PASSES);
+    printf("--------------------------------------------------------------------------\n");
+    printf("| %-14s | %8s | %8s | %10s | %10s | %10s |\n",
+           "API", "records", "mallocs", "fixes/rec", "time (ms)", "rec/sec");
+    printf("--------------------------------------------------------------------------\n");
+
+    /* copying API: the page is fixed again for every record */
+    records = mallocs = 0;
+    sum[0] = sum[1] = sum[2] = 0;
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    for (pass = 0; pass < SCAN_PASSES; pass++) {
+        error = RM_GetFirstRecord(fh, &rid, &rec);
+        while (error == PFE_OK) {
+            records++;
+            if (rec.data != NULL) {
+                mallocs++;
+                sum[0] += rec.data[0];
+                free(rec.data);
+            }
+            error = RM_GetNextRecord(fh, &rid, &rec);
+        }
+    }
+    gettimeofday(&t1, NULL);
+    scan_row("GetNextRecord", records, mallocs, (long) PF_logicalReads,
+             elapsed_ms(&t0, &t1));
+
+    /* copying cursor: one fix per page, one malloc per record */
+    records = mallocs = 0;
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    for (pass = 0; pass < SCAN_PASSES; pass++) {
+        RM_ScanOpen(fh, &scan);
+        while (RM_ScanNext(&scan, &rid, &rec) == PFE_OK) {
+            records++;
+            if (rec.data != NULL) {
+                mallocs++;
+                sum[1] += rec.data[0];
+                free(rec.data);
+            }
+        }
+        RM_ScanClose(&scan);
+    }
+    gettimeofday(&t1, NULL);
+    scan_row("ScanNext", records, mallocs, (long) PF_logicalReads,
+             elapsed_ms(&t0, &t1));
+
+    /* zero-copy cursor: records are read in place */
+    records = mallocs = 0;
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    for (pass = 0; pass < SCAN_PASSES; pass++) {
+        RM_ScanOpen(fh, &scan);
+        while (RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK) {
+            records++;
+            if (rec.length > 0)
+                sum[2] += rec.data[0];
+        }
+        RM_ScanClose(&scan);
+    }
+    gettimeofday(&t1, NULL);
+    scan_row("ScanNextRef", records, mallocs, (long) PF_logicalReads,
+             elapsed_ms(&t0, &t1));
+    printf("--------------------------------------------------------------------------\n");
+
+    if (sum[0] != sum[1] || sum[0] != sum[2])
+        printf("Scan mismatch: checksums %ld %ld %ld\n", sum[0], sum[1], sum[2]);
+}
+
+/* load the same records through RM_InsertRecords() and compare with the
+   one-by-one path */
+static void bulk_compare(seed, insertMs, insertFixes, onePages, oneUtil)
+unsigned seed;
+double insertMs;
+int insertFixes;
+int onePages;
+double oneUtil;
+{
+    RM_FileHandle fh;
+    RM_Record *recs;
+    RID *rids;
+    char *data;
+    struct timeval t0, t1;
+    int i, len, error, pages, payload, slots, deleted;
+    double util, ms, usedUtil, compactUtil;
+
+    recs = (RM_Record *) malloc(NUM_RECORDS * sizeof(RM_Record));
+    rids = (RID *) malloc(NUM_RECORDS * sizeof(RID));
+    data = (char *) malloc(NUM_RECORDS * 600);
+    if (recs == NULL || rids == NULL || data == NULL) {
+        printf("malloc failed\n");
+        return;
+    }
+
+    /* same record stream as the one-by-one load */
+    srand(seed);
+    for (i = 0; i < NUM_RECORDS; i++) {
+        len = 16 + (rand() % 497);
+        recs[i].data = data + i * 600;
+        make_student_record(recs[i].data, len, i);
+        recs[i].length = strlen(recs[i].data) + 1;
+    }
+
+    PF_DestroyFile(BULK_FILE);
+    RM_CreateFile(BULK_FILE);
+    if ((error = RM_OpenFile(BULK_FILE, &fh)) != PFE_OK) {
+        printf("RM_OpenFile failed: %d\n", error);
+        return;
+    }
+
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    error = RM_InsertRecords(&fh, recs, NUM_RECORDS, rids);
+    gettimeofday(&t1, NULL);
+    ms = elapsed_ms(&t0, &t1);
+    if (error != PFE_OK)
+        printf("RM_InsertRecords failed: %d\n", error);
+
+    RM_ComputeFileStats(&fh, &pages, &payload, &util, &slots, &deleted,
+                        &usedUtil, &compactUtil);
+
+    printf("\nBulk insert comparison (%d records):\n", NUM_RECORDS);
+    printf("---------------------------------------------------------------\n");
+    printf("| %-16s | %10s | %11s | %6s | %8s |\n",
+           "API", "time (ms)", "page fixes", "pages", "util %");
+    printf("---------------------------------------------------------------\n");
+    printf("| %-16s | %10.2f | %11d | %6d | %8.2f |\n",
+           "RM_InsertRecord", insertMs, insertFixes, onePages, oneUtil);
+    printf("| %-16s | %10.2f | %11d | %6d | %8.2f |\n",
+           "RM_InsertRecords", ms, PF_logicalReads, pages, util);
+    printf("---------------------------------------------------------------\n");
+
+    RM_CloseFile(&fh);
+    PF_DestroyFile(BULK_FILE);
+    free(data);
+    free(rids);
+    free(recs);
+}
+
+static void churn_row(fh, phase)
+RM_FileHandle *fh;
+char *phase;
+{
+    int pages, payload, slots, deleted;
+    double util, usedUtil, compactUtil;
+
+    RM_ComputeFileStats(fh, &pages, &payload, &util, &slots, &deleted,
+                        &usedUtil, &compactUtil);
+    printf("| %-16s | %6d | %7d | %9.2f | %9.2f | %9.2f |\n",
+           phase, pages, deleted, util, usedUtil, compactUtil);
+}
+
+/* Delete half of the records, compact, then insert as many new ones.
+   Inserts should reuse the freed space and slots, and the surviving
+   records must keep their RIDs throughout. */
+static void churn_test(fh)
+RM_FileHandle *fh;
+{
+    RM_ScanHandle scan;
+    RM_Record rec;
+    RID *rids;
+    RID rid;
+    char *buf;
+    int n, i, id, len, found, moved, error;
+
+    rids = (RID *) malloc(NUM_RECORDS * sizeof(RID));
+    buf = (char *) malloc(600);
+    if (rids == NULL || buf == NULL) {
+        printf("malloc failed\n");
+        return;
+    }
+
+    /* RID of every record, by record id */
+    RM_ScanOpen(fh, &scan);
+    while (RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK) {
+        id = atoi(rec.data + 3);
+        if (id >= 0 && id < NUM_RECORDS)
+            rids[id] = rid;
+    }
+    RM_ScanClose(&scan);
+
+    printf("\nChurn (delete every other record, compact, insert as many):\n");
+    printf("--------------------------------------------------------------------------\n");
+    printf("| %-16s | %6s | %7s | %9s | %9s | %9s |\n",
+           "phase", "pages", "deleted", "live %", "used %", "compact %");
+    printf("--------------------------------------------------------------------------\n");
+    churn_row(fh, "loaded");
+
+    n = 0;
+    for (i = 0; i < NUM_RECORDS; i += 2)
+        if (RM_DeleteRecord(fh, &rids[i]) == PFE_OK)
+            n++;
+    churn_row(fh, "after delete");
+
+    RM_CompactFile(fh);
+    churn_row(fh, "after compact");
+
+    for (i = 0; i < n; i++) {
+        len = 16 + (rand() % 497);
+        make_student_record(buf, len, NUM_RECORDS + i);
+        rec.length = strlen(buf) + 1;
+        rec.data = buf;
+        if ((error = RM_InsertRecord(fh, &rec, &rid)) != PFE_OK) {
+            printf("Insert failed: %d\n", error);
+            break;
+        }
+    }
+    churn_row(fh, "after reinsert");
+    printf("--------------------------------------------------------------------------\n");
+
+    /* survivors must still be where their RID says */
+    found = moved = 0;
+    RM_ScanOpen(fh, &scan);
+    while (RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK) {
+        id = atoi(rec.data + 3);
+        if (id >= NUM_RECORDS)
+            continue;
+        if (id % 2 == 1 && rids[id].page == rid.page && rids[id].slot == rid.slot)
+            found++;
+        else
+            moved++;
+    }
+    RM_ScanClose(&scan);
+    printf("Survivors at their RID: %d of %d, elsewhere: %d\n",
+           found, NUM_RECORDS / 2, moved);
+
+    free(buf);
+    free(rids);
+}
+
+/* number of forwarding stubs in the file */
+static int count_stubs(fh)
+RM_FileHandle *fh;
+{
+    struct RM_PageHdr *hdr;
+    struct RM_Slot *slot;
+    char *pagebuf;
+    int page = -1, stubs = 0, s;
+
+    while (PF_GetNextPage(fh->fd, &page, &pagebuf) == PFE_OK) {
+        if (pagebuf[0] == RM_PAGE_DATA) {
+            hdr = (struct RM_PageHdr *) pagebuf;
+            for (s = 0; s < hdr->numSlots; s++) {
+                slot = (struct RM_Slot *)
+                    (pagebuf + PF_PAGE_SIZE - (s + 1) * sizeof(struct RM_Slot));
+                if (slot->offset != -1 && (slot->length & RM_SLOT_FORWARD))
+                    stubs++;
+            }
+        }
+        PF_UnfixPage(fh->fd, page, FALSE);
+    }
+    return stubs;
+}
+
+/* Grow every record by "grow" bytes (shrink if negative) through
+   RM_UpdateRecord, then check every record by RID and by a full scan */
+static void update_pass(fh, rids, lens, n, grow, phase)
+RM_FileHandle *fh;
+RID *rids;
+int *lens;
+int n;
+int grow;
+char *phase;
+{
+    RM_ScanHandle scan;
+    RM_Record rec;
+    RID rid;
+    char buf[1200];
+    char want[32];
+    int i, error, bad, seen;
+
+    bad = 0;
+    for (i = 0; i < n; i++) {
+        if (RM_GetRecord(fh, &rids[i], &rec) != PFE_OK) {
+            bad++;
+            continue;
+        }
+        memcpy(buf, rec.data, rec.length);
+        free(rec.data);
+        if (grow > 0)
+            memset(buf + rec.length, 'u', grow);
+        rec.data = buf;
+        rec.length += grow;
+        if ((error = RM_UpdateRecord(fh, &rids[i], &rec)) != PFE_OK) {
+            printf("RM_UpdateRecord failed: %d\n", error);
+            bad++;
+            continue;
+        }
+        lens[i] = rec.length;
+    }
+
+    /* every record is still found through its original RID */
+    for (i = 0; i < n; i++) {
+        sprintf(want, "id:%d,", i);
+        if (RM_GetRecord(fh, &rids[i], &rec) != PFE_OK) {
+            bad++;
+            continue;
+        }
+        if (rec.length != lens[i] || strncmp(rec.data, want, strlen(want)) != 0)
+            bad++;
+        free(rec.data);
+    }
+
+    /* and a scan returns each one once, under that RID */
+    seen = 0;
+    RM_ScanOpen(fh, &scan);
+    while (RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK) {
+        i = atoi(rec.data + 3);
+        if (i < 0 || i >= n || rids[i].page != rid.page || rids[i].slot != rid.slot
+            || rec.length != lens[i])
+            bad++;
+        seen++;
+    }
+    RM_ScanClose(&scan);
+    if (seen != n)
+        bad++;
+
+    printf("| %-18s | %8d | %7d | %6d |\n", phase, n, count_stubs(fh), bad);
+}
+
+/* Updates that grow records past their page move them behind a stub;
+   shrinking them brings them home. RIDs never change. */
+static void update_test()
+{
+    RM_FileHandle fh;
+    RM_Record rec;
+    RID *rids;
+    int *lens;
+    char buf[600];
+    int i, len;
+
+    rids = (RID *) malloc(NUM_RECORDS * sizeof(RID));
+    lens = (int *) malloc(NUM_RECORDS * sizeof(int));
+    if (rids == NULL || lens == NULL) {
+        printf("malloc failed\n");
+        return;
+    }
+
+    PF_DestroyFile(BULK_FILE);
+    RM_CreateFile(BULK_FILE);
+    if (RM_OpenFile(BULK_FILE, &fh) != PFE_OK) {
+        printf("RM_OpenFile failed\n");
+        return;
+    }
+    for (i = 0; i < NUM_RECORDS; i++) {
+        len = 16 + (rand() % 497);
+        make_student_record(buf, len, i);
+        rec.length = strlen(buf) + 1;
+        rec.data = buf;
+        RM_InsertRecord(&fh, &rec, &rids[i]);
+        lens[i] = rec.length;
+    }
+
+    printf("\nUpdates (grow every record by 300 bytes, then shrink back):\n");
+    printf("-----------------------------------------------------\n");
+    printf("| %-18s | %8s | %7s | %6s |\n", "phase", "updated", "stubs", "errors");
+    printf("-----------------------------------------------------\n");
+    update_pass(&fh, rids, lens, NUM_RECORDS, 300, "grow");
+    update_pass(&fh, rids, lens, NUM_RECORDS, 0, "same size");
+    update_pass(&fh, rids, lens, NUM_RECORDS, -300, "shrink");
+    printf("-----------------------------------------------------\n");
+
+    RM_CloseFile(&fh);
+    PF_DestroyFile(BULK_FILE);
+    free(lens);
+    free(rids);
+}
+
+/* callback form of the course filter */
+static int course_filter(data, length, course)
+char *data;
+int length;
+char *course;
+{
+    char *f, *end = data + length;
+    int n;
+
+    /* third ';'-separated field */
+    f = data;
+    for (n = 0; n < 2; n++) {
+        while (f < end && *f != ';')
+            f++;
+        if (f++ >= end)
+            return FALSE;
+    }
+    n = strlen(course);
+    return end - f > n && memcmp(f, course, n) == 0 && f[n] == ';';
+}
+
+static void pushdown_row(method, hits, mallocs, rows, t0, t1)
+char *method;
+long hits;
+long mallocs;
+long rows;
+struct timeval *t0;
+struct timeval *t1;
+{
+    double ms = elapsed_ms(t0, t1);
+
+    printf("| %-18s | %8ld | %8ld | %10.2f | %10.0f |\n", method,
+           hits / REGN_PASSES, mallocs, ms, ms > 0 ? rows / (ms / 1000.0) : 0.0);
+}
+
+/* Load data/studregn.txt and select the registrations for one course:
+   filtering copies returned by RM_GetNextRecord against pushing the
+   predicate down into the scan. */
+static void pushdown_test()
+{
+    FILE *fp;
+    RM_FileHandle fh;
+    RM_ScanHandle scan;
+    RM_Predicate pred;
+    RM_Record *recs, rec;
+    RID *rids, rid;
+    struct timeval t0, t1;
+    char line[256];
+    char *data;
+    int n, cap, used, len, pass, error;
+    long hits, mallocs;
+
+    if ((fp = fopen(REGN_DATA, "r")) == NULL) {
+        printf("\n%s not found, skipping predicate pushdown test\n", REGN_DATA);
+        return;
+    }
+    cap = 70000;
+    recs = (RM_Record *) malloc(cap * sizeof(RM_Record));
+    rids = (RID *) malloc(cap * sizeof(RID));
+    data = (char *) malloc(cap * 64);
+    if (recs == NULL || rids == NULL || data == NULL) {
+        printf("malloc failed\n");
+        fclose(fp);
+        return;
+    }
+
+    /* first line is the table title */
+    n = used = 0;
+    fgets(line, sizeof(line), fp);
+    while (n < cap && fgets(line, sizeof(line), fp) != NULL) {
+        len = strlen(line);
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+            len--;
+        if (len == 0 || used + len > cap * 64)
+            continue;
+        memcpy(data + used, line, len);
+        recs[n].data = data + used;
+        recs[n].length = len;
+        used += len;
+        n++;
+    }
+    fclose(fp);
+
+    PF_DestroyFile(REGN_FILE);
+    RM_CreateFile(REGN_FILE);
+    if (RM_OpenFile(REGN_FILE, &fh) != PFE_OK
+        || (error = RM_InsertRecords(&fh, recs, n, rids)) != PFE_OK) {
+        printf("loading %s failed\n", REGN_FILE);
+        return;
+    }
+
+    pred.op = RM_PRED_EQ;
+    pred.schema = NULL;
+    pred.delim = ';';
+    pred.field = 2;
+    pred.lo = REGN_COURSE;
+    pred.loLen = strlen(REGN_COURSE);
+    pred.hi = NULL;
+    pred.hiLen = 0;
+
+    printf("\nPredicate pushdown: course = '%s' over %d studregn rows (%d scans):\n",
+           REGN_COURSE, n, REGN_PASSES);
+    printf("-----------------------------------------------------------------\n");
+    printf("| %-18s | %8s | %8s | %10s | %10s |\n",
+           "method", "matches", "mallocs", "time (ms)", "rows/sec");
+    printf("-----------------------------------------------------------------\n");
+
+    /* copy every record out, then test it */
+    hits = mallocs = 0;
+    gettimeofday(&t0, NULL);
+    for (pass = 0; pass < REGN_PASSES; pass++) {
+        error = RM_GetFirstRecord(&fh, &rid, &rec);
+        while (error == PFE_OK) {
+            mallocs++;
+            if (RM_PredicateMatch(rec.data, rec.length, &pred))
+                hits++;
+            free(rec.data);
+            error = RM_GetNextRecord(&fh, &rid, &rec);
+        }
+    }
+    gettimeofday(&t1, NULL);
+    pushdown_row("GetNextRecord", hits, mallocs, (long) n * REGN_PASSES, &t0, &t1);
+
+    /* compiled predicate evaluated in the page */
+    hits = mallocs = 0;
+    gettimeofday(&t0, NULL);
+    for (pass = 0; pass < REGN_PASSES; pass++) {
+        RM_ScanOpenFilter(&fh, &scan, &pred, NULL, NULL);
+        while (RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK)
+            hits++;
+        RM_ScanClose(&scan);
+    }
+    gettimeofday(&t1, NULL);
+    pushdown_row("pushdown predicate", hits, mallocs, (long) n * REGN_PASSES, &t0, &t1);
+
+    /* callback filter, copying only the matches */
+    hits = mallocs = 0;
+    gettimeofday(&t0, NULL);
+    for (pass = 0; pass < REGN_PASSES; pass++) {
+        RM_ScanOpenFilter(&fh, &scan, NULL, course_filter, REGN_COURSE);
+        while (RM_ScanNext(&scan, &rid, &rec) == PFE_OK) {
+            hits++;
+            mallocs++;
+            free(rec.data);
+        }
+        RM_ScanClose(&scan);
+    }
+    gettimeofday(&t1, NULL);
+    pushdown_row("pushdown callback", hits, mallocs, (long) n * REGN_PASSES, &t0, &t1);
+    printf("-----------------------------------------------------------------\n");
+
+    RM_CloseFile(&fh);
+    PF_DestroyFile(REGN_FILE);
+    free(data);
+    free(rids);
+    free(recs);
+}
+
+/* load the lines of a data/ table (title skipped) into "fh", as text
+   or as tuples of the file schema; returns the number of rows and
+   counts in *bad the tuples that do not print back as their line */
+static int load_lines(path, fh, tuples, bad)
+char *path;
+RM_FileHandle *fh;
+int tuples;
+int *bad;
+{
+    FILE *fp;
+    RM_Record rec;
+    RID rid;
+    char line[512], tuple[1024], text[512];
+    int len, tlen, n;
+
+    if ((fp = fopen(path, "r")) == NULL)
+        return -1;
+    n = 0;
+    fgets(line, sizeof(line), fp);
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        len = strlen(line);
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+            len--;
+        if (len == 0)
+            continue;
+        rec.data = line;
+        rec.length = len;
+        if (tuples) {
+            if (RM_DictTupleFromText(fh, line, len, ';', tuple, sizeof(tuple),
+                                     &rec.length) != PFE_OK)
+                continue;
+            rec.data = tuple;
+        }
+        if (RM_InsertRecord(fh, &rec, &rid) == PFE_OK)
+            n++;
+        if (bad != NULL) {
+            /* a short line prints back with its missing fields empty */
+            tlen = RM_DictTupleToText(fh, tuple, ';', text, sizeof(text));
+            while (tlen > len && text[tlen - 1] == ';')
+                tlen--;
+            if (tlen != len || memcmp(text, line, len) != 0)
+                (*bad)++;
+        }
+    }
+    fclose(fp);
+    return n;
+}
+
+/* student id (first field) of a text student record, parsed the way
+   ambuild.c parses its keys */
+static int text_id(data, length)
+char *data;
+int length;
+{
+    char buf[32];
+    int n = 0;
+
+    while (n < length && data[n] != ';' && n < (int) sizeof(buf) - 1) {
+        buf[n] = data[n];
+        n++;
+    }
+    buf[n] = '\0';
+    return atoi(buf);
+}
+
+/* schema of data/student.txt: int id, char(8) roll, char(1) sex and
+   varchars for the rest, or dictionary strings for the columns of few
+   distinct values if "dict" is set */
+static void student_schema(schema, dict)
+RM_Schema *schema;
+int dict;
+{
+    static char *names[16] = {
+        "id", "roll", "name", "sex", "f4", "f5", "f6", "f7",
+        "f8", "f9", "f10", "f11", "program", "f13", "f14", "f15"
+    };
+    int i;
+
+    RM_SchemaInit(schema);
+    for (i = 0; i < 16; i++)
+        RM_SchemaAddAttr(schema, names[i],
+                         i == 0 ? RM_TYPE_INT : (i == 1 || i == 3 ? RM_TYPE_CHAR
+                                : (dict && i != 10 ? RM_TYPE_DICT : RM_TYPE_VARCHAR)),
+                         i == 1 ? 8 : (i == 3 ? 1 : 0));
+}
+
+/* schema of data/studregn.txt: year, semester and student id are ints,
+   the rest strings, in dictionaries if "dict" is set */
+static void studregn_schema(schema, dict)
+RM_Schema *schema;
+int dict;
+{
+    static char *names[10] = {
+        "year", "sem", "course", "grade", "type", "status", "id", "credits",
+        "f8", "f9"
+    };
+    int i;
+
+    RM_SchemaInit(schema);
+    for (i = 0; i < 10; i++)
+        RM_SchemaAddAttr(schema, names[i],
+                         i < 2 || i == 6 ? RM_TYPE_INT
+                                         : (dict ? RM_TYPE_DICT : RM_TYPE_VARCHAR), 0);
+}
+
+/* Store data/student.txt as text and as schema tuples, then compare a
+   student-id range selection reading the field by parsing against
+   reading it by index from the tuple. */
+static void tuple_test()
+{
+    RM_FileHandle tfh, bfh;
+    RM_ScanHandle scan;
+    RM_Schema schema, stored;
+    RM_Record rec;
+    RID rid;
+    struct timeval t0, t1;
+    int i, rows, id, pages, payload, slots, deleted, bad;
+    double util, usedUtil, compactUtil, ms;
+    long hits;
+
+    student_schema(&schema, FALSE);
+
+    PF_DestroyFile(STUD_TEXT);
+    PF_DestroyFile(STUD_TUPLE);
+    RM_CreateFile(STUD_TEXT);
+    RM_CreateFile(STUD_TUPLE);
+    if (RM_OpenFile(STUD_TEXT, &tfh) != PFE_OK || RM_OpenFile(STUD_TUPLE, &bfh) != PFE_OK) {
+        printf("RM_OpenFile failed\n");
+        return;
+    }
+    if ((rows = load_lines(STUD_DATA, &tfh, FALSE, (int *) NULL)) < 0) {
+        printf("\n%s not found, skipping tuple test\n", STUD_DATA);
+        RM_CloseFile(&tfh);
+        RM_CloseFile(&bfh);
+        return;
+    }
+    RM_SetSchema(&bfh, &schema);
+    bad = 0;
+    load_lines(STUD_DATA, &bfh, TRUE, &bad);
+
+    /* the schema comes back from the file header */
+    RM_GetSchema(&bfh, &stored);
+
+    printf("\nSchema tuples: id in [%d, %d] over %d student rows:\n",
+           ID_LO, ID_HI, rows);
+    printf("-------------------------------------------------------\n");
+    printf("| %-12s | %6s | %8s | %10s | %7s |\n",
+           "format", "pages", "matches", "time (ms)", "util %");
+    printf("-------------------------------------------------------\n");
+
+    for (i = 0; i < 2; i++) {
+        hits = 0;
+        gettimeofday(&t0, NULL);
+        RM_ScanOpen(i == 0 ? &tfh : &bfh, &scan);
+        while (RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK) {
+            id = (i == 0) ? text_id(rec.data, rec.length)
+                          : RM_TupleGetInt(&stored, rec.data, 0);
+            if (id >= ID_LO && id <= ID_HI)
+                hits++;
+        }
+        RM_ScanClose(&scan);
+        gettimeofday(&t1, NULL);
+        ms = elapsed_ms(&t0, &t1);
+        RM_ComputeFileStats(i == 0 ? &tfh : &bfh, &pages, &payload, &util,
+                            &slots, &deleted, &usedUtil, &compactUtil);
+        printf("| %-12s | %6d | %8ld | %10.2f | %7.2f |\n",
+               i == 0 ? "text" : "tuple", pages, hits, ms, util);
+    }
+    printf("-------------------------------------------------------\n");
+    printf("Tuples not matching their text form: %d\n", bad);
+
+    RM_CloseFile(&tfh);
+    RM_CloseFile(&bfh);
+    PF_DestroyFile(STUD_TEXT);
+    PF_DestroyFile(STUD_TUPLE);
+}
+
+/* Store data/student.txt in PAX pages, delete every third record and
+   check the survivors by scan and by RID. */
+static void pax_test()
+{
+    RM_FileHandle fh;
+    RM_ScanHandle scan;
+    RM_Schema schema;
+    RM_Record rec, copy, *recs;
+    RID rid, *rids, *live;
+    int i, n, rows, bad, pages, payload, slots, deleted;
+    double util, usedUtil, compactUtil;
+
+    student_schema(&schema, FALSE);
+    PF_DestroyFile(STUD_PAX);
+    RM_CreateFile(STUD_PAX);
+    if (RM_OpenFile(STUD_PAX, &fh) != PFE_OK) {
+        printf("RM_OpenFile failed\n");
+        return;
+    }
+    if (RM_SetFormat(&fh, RM_FORMAT_PAX) != RME_NOSCHEMA)
+        printf("RM_SetFormat accepted a PAX file without a schema\n");
+    RM_SetSchema(&fh, &schema);
+    RM_SetFormat(&fh, RM_FORMAT_PAX);
+    bad = 0;
+    if ((rows = load_lines(STUD_DATA, &fh, TRUE, &bad)) <= 0) {
+        RM_CloseFile(&fh);
+        PF_DestroyFile(STUD_PAX);
+        return;
+    }
+    rids = (RID *) malloc(rows * sizeof(RID));
+
+    /* delete every third record */
+    n = 0;
+    RM_ScanOpen(&fh, &scan);
+    while (n < rows && RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK)
+        rids[n++] = rid;
+    RM_ScanClose(&scan);
+    for (i = 0; i < n; i += 3)
+        if (RM_DeleteRecord(&fh, &rids[i]) != PFE_OK)
+            bad++;
+
+    /* survivors come back the same by scan and by RID */
+    n = 0;
+    live = (RID *) malloc(rows * sizeof(RID));
+    recs = (RM_Record *) malloc(rows * sizeof(RM_Record));
+    RM_ScanOpen(&fh, &scan);
+    while (n < rows && RM_ScanNext(&scan, &live[n], &recs[n]) == PFE_OK)
+        n++;
+    RM_ScanClose(&scan);
+    for (i = 0; i < n; i++) {
+        if (RM_GetRecord(&fh, &live[i], &copy) != PFE_OK) {
+            bad++;
+        } else {
+            if (copy.length != recs[i].length
+                || memcmp(copy.data, recs[i].data, copy.length) != 0)
+                bad++;
+            free(copy.data);
+        }
+        free(recs[i].data);
+    }
+
+    /* the deleted ones are gone, and PAX records cannot be updated */
+    for (i = 0; i < rows; i += 3)
+        if (RM_GetRecord(&fh, &rids[i], &copy) == PFE_OK) {
+            bad++;
+            free(copy.data);
+        }
+    if (RM_UpdateRecord(&fh, &live[0], &recs[0]) != RME_BADFORMAT)
+        bad++;
+
+    RM_ComputeFileStats(&fh, &pages, &payload, &util, &slots, &deleted,
+                        &usedUtil, &compactUtil);
+    printf("\nPAX pages: %d student rows in %d pages, %d deleted, %d left by scan\n",
+           rows, pages, deleted, n);
+    printf("PAX records not matching: %d\n", bad + (n != rows - (rows + 2) / 3));
+
+    free(recs);
+    free(live);
+    free(rids);
+    RM_CloseFile(&fh);
+    PF_DestroyFile(STUD_PAX);
+}
+
+/* pages of type "type" in the file */
+static int count_pages(fh, type)
+RM_FileHandle *fh;
+int type;
+{
+    char *pagebuf;
+    int page = -1, n = 0;
+
+    while (PF_GetNextPage(fh->fd, &page, &pagebuf) == PFE_OK) {
+        n += (pagebuf[0] == type);
+        PF_UnfixPage(fh->fd, page, FALSE);
+    }
+    return n;
+}
+
+/* Store a table as tuples with plain strings and with dictionary
+   strings; compare pages and an equality selection on string column
+   "attr", comparing bytes on one file and codes on the other. */
+static void dict_row(name, path, schemafn, attr, value)
+char *name;
+char *path;
+void (*schemafn)();
+int attr;
+char *value;
+{
+    RM_FileHandle fh;
+    RM_ScanHandle scan;
+    RM_Schema schema;
+    RM_Predicate pred;
+    RM_Record rec;
+    RID rid;
+    struct timeval t0, t1;
+    int dict, i, rows, bad, hits, values;
+    int pages, payload, slots, deleted;
+    double util, usedUtil, compactUtil;
+
+    for (dict = 0; dict < 2; dict++) {
+        (*schemafn)(&schema, dict);
+        PF_DestroyFile(DICT_FILE);
+        RM_CreateFile(DICT_FILE);
+        if (RM_OpenFile(DICT_FILE, &fh) != PFE_OK) {
+            printf("RM_OpenFile failed\n");
+            return;
+        }
+        RM_SetSchema(&fh, &schema);
+        bad = 0;
+        if ((rows = load_lines(path, &fh, TRUE, &bad)) < 0) {
+            printf("| %-8s | %s not found\n", name, path);
+            RM_CloseFile(&fh);
+            PF_DestroyFile(DICT_FILE);
+            return;
+        }
+
+        if (dict) {
+            RM_DictPredicate(&fh, attr, value, strlen(value), &pred);
+        } else {
+            memset((char *) &pred, 0, sizeof(pred));
+            pred.op = RM_PRED_EQ;
+            pred.schema = &fh.schema;
+            pred.field = attr;
+            pred.lo = value;
+            pred.loLen = strlen(value);
+        }
+        hits = 0;
+        gettimeofday(&t0, NULL);
+        for (i = 0; i < REGN_PASSES; i++) {
+            RM_ScanOpenFilter(&fh, &scan, &pred, (RM_FilterFcn) NULL, (char *) NULL);
+            while (RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK)
+                hits++;
+            RM_ScanClose(&scan);
+        }
+        gettimeofday(&t1, NULL);
+
+        RM_ComputeFileStats(&fh, &pages, &payload, &util, &slots, &deleted,
+                            &usedUtil, &compactUtil);
+        for (i = values = 0; i < schema.numAttrs; i++)
+            values += RM_DictSize(&fh, i);
+        printf("| %-8s | %-5s | %5d | %5d | %5d | %6d | %5d | %8.2f | %4d |\n",
+               name, dict ? "dict" : "plain", rows, pages,
+               count_pages(&fh, RM_PAGE_DICT), values, hits / REGN_PASSES,
+               elapsed_ms(&t0, &t1) / REGN_PASSES, bad);
+        RM_CloseFile(&fh);
+    }
+
+    /* the dictionaries come back from their pages */
+    RM_OpenFile(DICT_FILE, &fh);
+    if (RM_DictLookup(&fh, attr, value, strlen(value)) < 0)
+        printf("| %-8s | dictionary not reloaded\n", name);
+    RM_CloseFile(&fh);
+    PF_DestroyFile(DICT_FILE);
+}
+
+static void dict_test()
+{
+    printf("\nDictionary encoding of string columns (data pages from RM_ComputeFileStats):\n");
+    printf("--------------------------------------------------------------------------\n");
+    printf("| %-8s | %-5s | %5s | %5s | %5s | %6s | %5s | %8s | %4s |\n", "table", "strs",
+           "rows", "data", "dict", "values", "eq", "eq ms", "bad");
+    printf("--------------------------------------------------------------------------\n");
+    dict_row("student", STUD_DATA, student_schema, 12, "BTECH");
+    dict_row("studregn", REGN_DATA, studregn_schema, 2, REGN_COURSE);
+    printf("--------------------------------------------------------------------------\n");
+}
+
+/* Record i of the overflow test: "i;course_i;" and a description,
+   over a page long for every fourth record; returns its length. */
+static int make_long_record(buf, i)
+char *buf;
+int i;
+{
+    int len, desc, k;
+
+    len = sprintf(buf, "%d;course_%d;", i, i);
+    desc = (i % 4 == 0) ? 5000 + (i * 997) % 20000 : 50 + i % 200;
+    for (k = 0; k < desc; k++)
+        buf[len++] = 'a' + (i + k) % 26;
+    return len;
+}
+
+/* does "rec" hold record i? */
+static int long_record_ok(rec, i, buf)
+RM_Record *rec;
+int i;
+char *buf;
+{
+    int len = make_long_record(buf, i);
+    return rec->length == len && memcmp(rec->data, buf, len) == 0;
+}
+
+static void ovfl_row(phase, fh, n, fixes, t0, t1, bad)
+char *phase;
+RM_FileHandle *fh;
+int n;
+int fixes;
+struct timeval *t0, *t1;
+int bad;
+{
+    printf("| %-16s | %7d | %6d | %6d | %7d | %8.2f | %4d |\n", phase, n,
+           PF_GetNumPages(fh->fd), count_pages(fh, RM_PAGE_OVERFLOW), fixes,
+           elapsed_ms(t0, t1), bad);
+}
+
+/* parallel scan callback: count the records that come back whole */
+static int ovfl_check(worker, rid, rec, arg)
+int worker;
+RID *rid;
+RM_Record *rec;
+char *arg;
+{
+    static char buf[RM_MAX_WORKERS][32000];
+    int i = atoi(rec->data);
+
+    if (i < 0 || i >= OVFL_RECORDS || !long_record_ok(rec, i, buf[worker]))
+        return PFE_INVALIDPAGE;
+    return PFE_OK;
+}
+
+/* Records over a page long go to overflow pages behind a stub: check
+   them by RID, by scan and by parallel scan, compare a scan that skips
+   the overflow pages, grow and shrink them by update and check that
+   deleted chains are reused. */
+static void overflow_test()
+{
+    RM_FileHandle fh;
+    RM_ScanHandle scan;
+    RM_Predicate pred;
+    RM_ParScan ps;
+    RM_Record rec, *recs;
+    RID rid, rids[OVFL_RECORDS];
+    struct timeval t0, t1;
+    static char buf[32000];
+    char *arena, key[16];
+    int i, n, bad, half, used, pages;
+
+    PF_DestroyFile(OVFL_FILE);
+    RM_CreateFile(OVFL_FILE);
+    if (RM_OpenFile(OVFL_FILE, &fh) != PFE_OK) {
+        printf("RM_OpenFile failed\n");
+        return;
+    }
+    printf("\nOverflow records (every fourth one 5-25 KB):\n");
+    printf("---------------------------------------------------------------------------\n");
+    printf("| %-16s | %7s | %6s | %6s | %7s | %8s | %4s |\n", "phase", "records",
+           "pages", "ovfl", "fixes", "ms", "bad");
+    printf("---------------------------------------------------------------------------\n");
+
+    /* half one by one, half in bulk */
+    bad = 0;
+    half = OVFL_RECORDS / 2;
+    recs = (RM_Record *) malloc(half * sizeof(RM_Record));
+    arena = (char *) malloc(half * 25300);
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < half; i++) {
+        rec.data = buf;
+        rec.length = make_long_record(buf, i);
+        if (RM_InsertRecord(&fh, &rec, &rids[i]) != PFE_OK)
+            bad++;
+    }
+    for (i = 0, used = 0; i < half; i++) {
+        recs[i].data = arena + used;
+        recs[i].length = make_long_record(arena + used, half + i);
+        used += recs[i].length;
+    }
+    if (RM_InsertRecords(&fh, recs, half, rids + half) != PFE_OK)
+        bad++;
+    gettimeofday(&t1, NULL);
+    ovfl_row("insert", &fh, OVFL_RECORDS, PF_logicalReads, &t0, &t1, bad);
+
+    /* every record comes back whole by RID */
+    bad = 0;
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < OVFL_RECORDS; i++) {
+        if (RM_GetRecord(&fh, &rids[i], &rec) != PFE_OK) {
+            bad++;
+            continue;
+        }
+        bad += !long_record_ok(&rec, i, buf);
+        free(rec.data);
+    }
+    gettimeofday(&t1, NULL);
+    ovfl_row("get by RID", &fh, OVFL_RECORDS, PF_logicalReads, &t0, &t1, bad);
+
+    /* full scan, then a scan that leaves the overflow pages alone */
+    for (n = 0; n < 2; n++) {
+        bad = 0;
+        i = 0;
+        PFbufStatsInit();
+        gettimeofday(&t0, NULL);
+        RM_ScanOpen(&fh, &scan);
+        RM_ScanSkipOverflow(&scan, n == 1);
+        while (RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK) {
+            if (n == 0)
+                bad += !long_record_ok(&rec, atoi(rec.data), buf);
+            else if (strncmp(rec.data, buf, sprintf(buf, "%d;", atoi(rec.data))) != 0)
+                bad++;
+            i++;
+        }
+        RM_ScanClose(&scan);
+        gettimeofday(&t1, NULL);
+        ovfl_row(n == 0 ? "scan" : "scan, skip ovfl", &fh, i, PF_logicalReads,
+                 &t0, &t1, bad + (i != OVFL_RECORDS));
+    }
+
+    /* a selection on the first field decides on the prefix; the one
+       record it returns is fetched whole on demand */
+    memset((char *) &pred, 0, sizeof(pred));
+    pred.op = RM_PRED_EQ;
+    pred.delim = ';';
+    pred.field = 0;
+    pred.lo = key;
+    pred.loLen = sprintf(key, "%d", 8);
+    bad = 0;
+    i = 0;
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    RM_ScanOpenFilter(&fh, &scan, &pred, (RM_FilterFcn) NULL, (char *) NULL);
+    RM_ScanSkipOverflow(&scan, TRUE);
+    while (RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK) {
+        if (RM_ScanFetchOverflow(&scan, &rec) != PFE_OK || !long_record_ok(&rec, 8, buf))
+            bad++;
+        i++;
+    }
+    RM_ScanClose(&scan);
+    gettimeofday(&t1, NULL);
+    ovfl_row("select, skip", &fh, i, PF_logicalReads, &t0, &t1, bad + (i != 1));
+
+    memset((char *) &ps, 0, sizeof(ps));
+    ps.numThreads = 4;
+    ps.fcn = ovfl_check;
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    bad = (RM_ParallelScan(&fh, &ps) != PFE_OK);
+    gettimeofday(&t1, NULL);
+    ovfl_row("parallel scan", &fh, (int) ps.matched, PF_logicalReads, &t0, &t1,
+             bad + (ps.matched != OVFL_RECORDS));
+
+    /* swap the sizes: long records become short and short ones long */
+    bad = 0;
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < OVFL_RECORDS; i++) {
+        rec.data = buf;
+        rec.length = make_long_record(buf, i);
+        if (i % 4 == 0)
+            rec.length = sprintf(buf, "%d;course_%d;short", i, i);
+        else {
+            memset(buf + rec.length, 'x', 6000);
+            rec.length += 6000;
+        }
+        if (RM_UpdateRecord(&fh, &rids[i], &rec) != PFE_OK)
+            bad++;
+    }
+    for (i = 0; i < OVFL_RECORDS; i++) {
+        if (RM_GetRecord(&fh, &rids[i], &rec) != PFE_OK) {
+            bad++;
+            continue;
+        }
+        n = make_long_record(buf, i);
+        if (i % 4 == 0)
+            n = sprintf(buf, "%d;course_%d;short", i, i);
+        else {
+            memset(buf + n, 'x', 6000);
+            n += 6000;
+        }
+        if (rec.length != n || memcmp(rec.data, buf, n) != 0)
+            bad++;
+        free(rec.data);
+    }
+    gettimeofday(&t1, NULL);
+    ovfl_row("update, swap", &fh, OVFL_RECORDS, PF_logicalReads, &t0, &t1, bad);
+
+    /* deleting the long records frees their chains for new ones */
+    bad = 0;
+    pages = PF_GetNumPages(fh.fd);
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < OVFL_RECORDS; i++)
+        if (i % 4 != 0 && RM_DeleteRecord(&fh, &rids[i]) != PFE_OK)
+            bad++;
+    bad += (count_pages(&fh, RM_PAGE_OVERFLOW) != 0);
+    for (i = 0; i < OVFL_RECORDS; i++) {
+        if (i % 4 == 0)
+            continue;
+        rec.data = buf;
+        rec.length = make_long_record(buf, i);
+        memset(buf + rec.length, 'x', 6000);
+        rec.length += 6000;
+        if (RM_InsertRecord(&fh, &rec, &rids[i]) != PFE_OK)
+            bad++;
+    }
+    gettimeofday(&t1, NULL);
+    ovfl_row("delete, reinsert", &fh, OVFL_RECORDS, PF_logicalReads, &t0, &t1,
+             bad + (PF_GetNumPages(fh.fd) > pages));
+    printf("---------------------------------------------------------------------------\n");
+
+    free(arena);
+    free(recs);
+    RM_CloseFile(&fh);
+    PF_DestroyFile(OVFL_FILE);
+}
+
+/* sample callback: count the records matching the predicate */
+struct sample_hits {
+    RM_Predicate pred;
+    long hits;
+};
+
+static int sample_count(worker, rid, rec, h)
+int worker;
+RID *rid;
+RM_Record *rec;
+struct sample_hits *h;
+{
+    h->hits += RM_PredicateMatch(rec->data, rec->length, &h->pred);
+    return PFE_OK;
+}
+
+/* One sample of SAMPLE_FILE (reopened, so its pages are read cold):
+   estimated rows, average length and rows of year SAMPLE_YEAR against
+   the exact ones. */
+static void sample_row(label, fraction, count, rows, year)
+char *label;
+double fraction;
+int count;
+int rows;
+long year;
+{
+    RM_FileHandle fh;
+    RM_PageSample sp;
+    struct sample_hits h;
+    struct timeval t0, t1;
+    double estYear;
+    int error;
+
+    if (RM_OpenFile(SAMPLE_FILE, &fh) != PFE_OK)
+        return;
+    memset((char *) &sp, 0, sizeof(sp));
+    memset((char *) &h, 0, sizeof(h));
+    h.pred.op = RM_PRED_EQ;
+    h.pred.delim = ';';
+    h.pred.field = 1;
+    h.pred.lo = SAMPLE_YEAR;
+    h.pred.loLen = strlen(SAMPLE_YEAR);
+    sp.fraction = fraction;
+    sp.count = count;
+    sp.seed = SAMPLE_SEED;
+    sp.fcn = sample_count;
+    sp.fcnArg = (char *) &h;
+
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    error = RM_SamplePages(&fh, &sp);
+    gettimeofday(&t1, NULL);
+    estYear = (sp.sampledPages == 0) ? 0.0
+        : (double) h.hits * sp.candidatePages / sp.sampledPages;
+    if (error != PFE_OK)
+        printf("| %-8s | RM_SamplePages failed: %d\n", label, error);
+    else
+        printf("| %-8s | %5d | %7.0f | %6.2f | %6.2f | %7.0f | %6.2f | %5d | %7.3f |\n",
+               label, sp.sampledPages, sp.estRecords,
+               100.0 * (sp.estRecords - rows) / rows,
+               sp.records == 0 ? 0.0 : (double) sp.bytes / sp.records,
+               estYear, year == 0 ? 0.0 : 100.0 * (estYear - year) / year,
+               PF_physicalReads, elapsed_ms(&t0, &t1));
+    RM_CloseFile(&fh);
+}
+
+/* Estimate the rows of data/gradsum.txt, their average length and the
+   rows of one year from random page samples of growing size. */
+static void sample_test()
+{
+    RM_FileHandle fh;
+    RM_ScanHandle scan;
+    RM_Record rec;
+    RID rid;
+    struct timeval t0, t1;
+    int rows, pages, payload, slots, deleted;
+    double util, usedUtil, compactUtil;
+    long year = 0, bytes = 0;
+
+    PF_DestroyFile(SAMPLE_FILE);
+    RM_CreateFile(SAMPLE_FILE);
+    if (RM_OpenFile(SAMPLE_FILE, &fh) != PFE_OK) {
+        printf("RM_OpenFile failed\n");
+        return;
+    }
+    if ((rows = load_lines(SAMPLE_DATA, &fh, FALSE, (int *) NULL)) <= 0) {
+        printf("%s not found\n", SAMPLE_DATA);
+        RM_CloseFile(&fh);
+        PF_DestroyFile(SAMPLE_FILE);
+        return;
+    }
+    RM_ScanOpen(&fh, &scan);
+    while (RM_ScanNextRef(&scan, &rid, &rec) == PFE_OK) {
+        bytes += rec.length;
+        year += (rec.length > 12 && memcmp(strchr(rec.data, ';') + 1, SAMPLE_YEAR ";", 5) == 0);
+    }
+    RM_ScanClose(&scan);
+    RM_CloseFile(&fh);
+
+    RM_OpenFile(SAMPLE_FILE, &fh);
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    RM_ComputeFileStats(&fh, &pages, &payload, &util, &slots, &deleted,
+                        &usedUtil, &compactUtil);
+    gettimeofday(&t1, NULL);
+    RM_CloseFile(&fh);
+
+    printf("\nPage sampling of %s: %d rows, %d data pages, avg %.2f bytes, %ld rows of %s\n",
+           SAMPLE_DATA, rows, pages, (double) bytes / rows, year, SAMPLE_YEAR);
+    printf("RM_ComputeFileStats: %d physical reads, %.3f ms\n",
+           PF_physicalReads, elapsed_ms(&t0, &t1));
+    printf("------------------------------------------------------------------------------\n");
+    printf("| %-8s | %5s | %7s | %6s | %6s | %7s | %6s | %5s | %7s |\n", "sample",
+           "pages", "rows", "err %", "avglen", SAMPLE_YEAR, "err %", "reads", "ms");
+    printf("------------------------------------------------------------------------------\n");
+    sample_row("16 pages", 0.0, 16, rows, year);
+    sample_row("1%", 0.01, 0, rows, year);
+    sample_row("5%", 0.05, 0, rows, year);
+    sample_row("10%", 0.10, 0, rows, year);
+    sample_row("25%", 0.25, 0, rows, year);
+    sample_row("100%", 1.0, 0, rows, year);
+    printf("------------------------------------------------------------------------------\n");
+    PF_DestroyFile(SAMPLE_FILE);
+}
+
+/* year field (the second) of a gradsum line */
+static char *sort_year(line, len, flen)
+char *line;
+int len;
+int *flen;
+{
+    char *f, *end;
+
+    if ((f = memchr(line, ';', len)) == NULL) {
+        *flen = 0;
+        return line;
+    }
+    f++;
+    end = memchr(f, ';', (line + len) - f);
+    *flen = (end == NULL ? line + len : end) - f;
+    return f;
+}
+
+/* Sort records (line number, line) by the year field only */
+static int sort_cmp(a, alen, b, blen, arg)
+char *a;
+int alen;
+char *b;
+int blen;
+char *arg;
+{
+    char *fa, *fb;
+    int la, lb, c;
+
+    fa = sort_year(a + sizeof(int), alen - (int) sizeof(int), &la);
+    fb = sort_year(b + sizeof(int), blen - (int) sizeof(int), &lb);
+    c = memcmp(fa, fb, la < lb ? la : lb);
+    return (c != 0) ? c : la - lb;
+}
+
+/* One sort of the SORT_DATA lines by year in memBytes of memory: runs,
+   merge passes and PF I/O, and a check that the years come out in
+   order, lines of one year in file order, and every line once. */
+static void sort_row(memBytes)
+int memBytes;
+{
+    RM_SortHandle sort;
+    struct timeval t0, t1;
+    FILE *f;
+    char line[1024], rec[1024 + sizeof(int)];
+    char *p, *prev = NULL;
+    int n = 0, out = 0, bad = 0, len, prevLen = 0, lineNo, prevNo = -1, error;
+    long bytesIn = 0, bytesOut = 0;
+
+    if ((f = fopen(SORT_DATA, "r")) == NULL)
+        return;
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
+    error = RM_SortOpen(&sort, 0, memBytes, sort_cmp, (char *) NULL);
+    while (error == PFE_OK && fgets(line, sizeof(line), f) != NULL) {
+        len = strcspn(line, "\r\n");
+        memcpy(rec, (char *) &n, sizeof(int));
+        memcpy(rec + sizeof(int), line, len);
+        error = RM_SortPut(&sort, rec, len + (int) sizeof(int));
+        bytesIn += len;
+        n++;
+    }
+    fclose(f);
+    if (error == PFE_OK)
+        error = RM_SortDone(&sort);
+    prev = (char *) malloc(sizeof(rec));
+    while (error == PFE_OK && (error = RM_SortNext(&sort, &p, &len)) == PFE_OK) {
+        memcpy((char *) &lineNo, p, sizeof(int));
+        if (out > 0) {
+            int c = sort_cmp(prev, prevLen, p, len, (char *) NULL);
+            bad += c > 0 || (c == 0 && lineNo < prevNo);
+        }
+        memcpy(prev, p, len);
+        prevLen = len;
+        prevNo = lineNo;
+        bytesOut += len - sizeof(int);
+        out++;
+    }
+    gettimeofday(&t1, NULL);
+    free(prev);
+
+    if (error != PFE_EOF)
+        printf("| %7dK | sort failed: %d\n", memBytes / 1024, error);
+    else
+        printf("| %7dK | %5d | %6d | %9ld | %6d | %6d | %8.2f | %-8s |\n",
+               memBytes / 1024, sort.runsWritten, sort.mergePasses,
+               sort.pagesWritten, PF_physicalReads, PF_physicalWrites,
+               elapsed_ms(&t0, &t1),
+               (bad == 0 && out == n && bytesOut == bytesIn) ? "ok" : "WRONG");
+    RM_SortClose(&sort);
+}
+
+/* Sort data/gradsum.txt by year with RM_SortOpen() in memory budgets
+   from a few pages (several merge passes) to all of it (no runs). */
+static void sort_test()
+{
+    printf("\nExternal sort of %s by year (stable, variable-length records)\n", SORT_DATA);
+    printf("-------------------------------------------------------------------------------\n");
+    printf("| %8s | %5s | %6s | %9s | %6s | %6s | %8s | %-8s |\n", "memory",
+           "runs", "passes", "run pages", "reads", "writes", "ms", "order");
+    printf("-------------------------------------------------------------------------------\n");
+    sort_row(RM_SORT_MINMEM);
+    sort_row(64 * 1024);
+    sort_row(256 * 1024);
+    sort_row(1024 * 1024);
+    sort_row(8 * 1024 * 1024);
+    printf("-------------------------------------------------------------------------------\n");
+}
+
 int main()
 {
     RM_FileHandle fh;
@@ -41,6 +1458,11 @@ int main()
     int page;
     char *buf;
     char *pagebuf;
+    struct timeval t0, t1;
+    unsigned seed;
+    double insertMs;
+    int insertFixes;
+    double util = 0.0;
 
     int usedTotal = 0;
     int pagesCount = 0;
@@ -48,7 +1470,8 @@ int main()
     int deletedSlots = 0;
     int usedBytes;
 
-    srand((unsigned)time(NULL));
+    seed = (unsigned)time(NULL);
+    srand(seed);
 
     PF_Init(50);   /* initialize PF data structures */
     PFbufInit(50); /* allocate buffer pool */
@@ -63,6 +1486,8 @@ int main()
     }
 
     printf("Inserting %d records...\n", NUM_RECORDS);
+    PFbufStatsInit();
+    gettimeofday(&t0, NULL);
 
     buf = (char *)malloc(600);
     if (buf == NULL) { printf("malloc failed\n"); return 1; }
@@ -90,7 +1515,12 @@ int main()
             printf("Inserted %d\n", i+1);
     }
 
+    gettimeofday(&t1, NULL);
     free(buf);
+    insertMs = elapsed_ms(&t0, &t1);
+    insertFixes = PF_logicalReads;
+    printf("Insert time: %.2f ms, page fixes: %d (%.2f per record)\n",
+           insertMs, insertFixes, (double)insertFixes / NUM_RECORDS);
 
     /* Scan all pages and compute stats */
     printf("\nComputing slotted-page statistics...\n");
@@ -108,6 +1538,12 @@ int main()
             break;
         }
 
+        if (pagebuf[0] != RM_PAGE_DATA) {
+            /* RM header and free-space map pages */
+            PF_UnfixPage(fh.fd, page, FALSE);
+            continue;
+        }
+
         {
             int slots = 0;
             int deleted = 0;
@@ -134,7 +1570,7 @@ int main()
     }
 
     {
-        double util = 100.0 * (double)usedTotal / (double)(pagesCount * PF_PAGE_SIZE);
+        util = 100.0 * (double)usedTotal / (double)(pagesCount * PF_PAGE_SIZE);
 
         printf("Pages used: %d\n", pagesCount);
         printf("Total payload bytes: %d\n", usedTotal);
@@ -162,7 +1598,19 @@ int main()
         printf("----------------------------------------------\n");
     }
 
+    scan_compare(&fh);
+    bulk_compare(seed, insertMs, insertFixes, pagesCount, util);
+    churn_test(&fh);
+
     RM_CloseFile(&fh);
+    update_test();
+    pushdown_test();
+    tuple_test();
+    pax_test();
+    dict_test();
+    overflow_test();
+    sample_test();
+    sort_test();
 
     return 0;
 }
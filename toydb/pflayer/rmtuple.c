@@ -0,0 +1,426 @@
+/* rmtuple.c: table schemas and the binary tuple format of the RM layer.
+   See rm.h for the tuple layout. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rm.h"
+#include "pf.h"
+#include "pftypes.h"
+
+/*************** INTERNAL FUNCTIONS *****************/
+
+/* byte position of field i and its length */
+static int rm_FieldPos(schema, tuple, i, len)
+RM_Schema *schema;
+char *tuple;
+int i;
+int *len;
+{
+    unsigned short off[2];
+
+    memcpy((char *) off, tuple + schema->offsetPos + i * sizeof(unsigned short),
+           sizeof(off));
+    *len = off[1] - off[0];
+    return off[0];
+}
+
+/*************** SCHEMA ****************/
+
+int RM_SchemaInit(schema)
+RM_Schema *schema;
+{
+    memset((char *) schema, 0, sizeof(RM_Schema));
+    schema->offsetPos = 0;
+    schema->dataPos = sizeof(unsigned short);
+    return PFE_OK;
+}
+
+/* Append an attribute. "length" is the size of a char attribute, the
+   maximum size of a varchar (0 for no maximum) and ignored otherwise;
+   dictionary values are up to RM_DICT_MAXLEN bytes. */
+int RM_SchemaAddAttr(schema, name, type, length)
+RM_Schema *schema;
+char *name;
+int type;
+int length;
+{
+    RM_Attr *attr;
+    int n;
+
+    if (schema->numAttrs >= RM_MAX_ATTRS || strlen(name) >= RM_MAX_ATTRNAME)
+        return RME_BADSCHEMA;
+    if (type != RM_TYPE_INT && type != RM_TYPE_FLOAT && type != RM_TYPE_CHAR
+        && type != RM_TYPE_VARCHAR && type != RM_TYPE_DICT)
+        return RME_BADSCHEMA;
+    if (length < 0 || (type == RM_TYPE_CHAR && length == 0)
+        || length >= PF_PAGE_SIZE)
+        return RME_BADSCHEMA;
+
+    attr = &schema->attrs[schema->numAttrs++];
+    strcpy(attr->name, name);
+    attr->type = type;
+    if (type == RM_TYPE_INT || type == RM_TYPE_FLOAT)
+        attr->length = 4;
+    else if (type == RM_TYPE_DICT)
+        attr->length = 2;
+    else
+        attr->length = length;
+
+    /* header: null bitmap, then numAttrs+1 offsets */
+    n = schema->numAttrs;
+    schema->offsetPos = (n + 7) / 8;
+    schema->dataPos = schema->offsetPos + (n + 1) * sizeof(unsigned short);
+    return PFE_OK;
+}
+
+/*************** ENCODING ****************/
+
+/* Encode one value per attribute into "buf" of "bufsize" bytes and set
+   *len to the tuple size. Char values are NUL padded or truncated to
+   the attribute length; varchars longer than their maximum are
+   rejected. */
+int RM_TupleEncode(schema, vals, buf, bufsize, len)
+RM_Schema *schema;
+RM_Value vals[];
+char *buf;
+int bufsize;
+int *len;
+{
+    RM_Attr *attr;
+    unsigned short off;
+    int i, pos, n;
+
+    if (schema->dataPos > bufsize)
+        return RME_RECTOOBIG;
+    memset(buf, 0, schema->offsetPos);
+    pos = schema->dataPos;
+    for (i = 0; i < schema->numAttrs; i++) {
+        attr = &schema->attrs[i];
+        off = pos;
+        memcpy(buf + schema->offsetPos + i * sizeof(unsigned short),
+               (char *) &off, sizeof(off));
+        if (vals[i].isNull) {
+            buf[i / 8] |= 1 << (i % 8);
+            continue;
+        }
+        switch (attr->type) {
+        case RM_TYPE_INT:
+        case RM_TYPE_FLOAT:
+        case RM_TYPE_CHAR:
+            n = attr->length;
+            break;
+        case RM_TYPE_DICT:
+            n = 2;
+            if (vals[i].ival < 0 || vals[i].ival >= RM_DICT_CODES)
+                return RME_BADVALUE;
+            break;
+        default:
+            n = vals[i].slen;
+            if (attr->length > 0 && n > attr->length)
+                return RME_BADVALUE;
+        }
+        if (pos + n > bufsize)
+            return RME_RECTOOBIG;
+        switch (attr->type) {
+        case RM_TYPE_INT:
+            memcpy(buf + pos, (char *) &vals[i].ival, 4);
+            break;
+        case RM_TYPE_FLOAT:
+            memcpy(buf + pos, (char *) &vals[i].fval, 4);
+            break;
+        case RM_TYPE_CHAR:
+            memset(buf + pos, 0, n);
+            memcpy(buf + pos, vals[i].sval, vals[i].slen < n ? vals[i].slen : n);
+            break;
+        case RM_TYPE_DICT:
+            off = vals[i].ival;
+            memcpy(buf + pos, (char *) &off, 2);
+            break;
+        default:
+            memcpy(buf + pos, vals[i].sval, n);
+        }
+        pos += n;
+    }
+    off = pos;
+    memcpy(buf + schema->offsetPos + schema->numAttrs * sizeof(unsigned short),
+           (char *) &off, sizeof(off));
+    *len = pos;
+    return PFE_OK;
+}
+
+/* Split a delimited text record into one value per attribute. Empty
+   and missing fields become NULL; extra fields are ignored, and a
+   numeric field that does not parse completely is RME_BADVALUE.
+   Dictionary fields are left as strings. */
+static int rm_TextToValues(schema, text, textlen, delim, vals)
+RM_Schema *schema;
+char *text;
+int textlen;
+int delim;
+RM_Value vals[];
+{
+    char num[64];
+    char *p, *end, *f;
+    int i, flen;
+
+    p = text;
+    end = text + textlen;
+    for (i = 0; i < schema->numAttrs; i++) {
+        f = p;
+        while (p < end && *p != delim)
+            p++;
+        flen = p - f;
+        if (p < end)
+            p++;                /* skip the delimiter */
+
+        vals[i].isNull = (flen == 0);
+        if (flen == 0)
+            continue;
+        switch (schema->attrs[i].type) {
+        case RM_TYPE_INT:
+        case RM_TYPE_FLOAT:
+            if (flen >= (int) sizeof(num))
+                return RME_BADVALUE;
+            memcpy(num, f, flen);
+            num[flen] = '\0';
+            if (schema->attrs[i].type == RM_TYPE_INT)
+                vals[i].ival = (int) strtol(num, &f, 10);
+            else
+                vals[i].fval = (float) strtod(num, &f);
+            if (*f != '\0')
+                return RME_BADVALUE;    /* not a number */
+            break;
+        default:
+            vals[i].sval = f;
+            vals[i].slen = flen;
+        }
+    }
+    return PFE_OK;
+}
+
+/* TRUE if text field "f" of "len" bytes is a plain int: no sign tricks,
+   leading zeros or overflow, so that it prints back as the same text.
+   Used to infer int columns of the data/ tables. */
+int RM_TextIsInt(f, len)
+char *f;
+int len;
+{
+    int i = (len > 0 && f[0] == '-') ? 1 : 0;
+
+    if (len - i < 1 || len - i > 9 || (f[i] == '0' && len - i > 1))
+        return FALSE;
+    for (; i < len; i++)
+        if (f[i] < '0' || f[i] > '9')
+            return FALSE;
+    return TRUE;
+}
+
+/* Encode a delimited text record, such as a line of a data/ table, as
+   rm_TextToValues() splits it. A dictionary field must hold its code. */
+int RM_TupleFromText(schema, text, textlen, delim, buf, bufsize, len)
+RM_Schema *schema;
+char *text;
+int textlen;
+int delim;
+char *buf;
+int bufsize;
+int *len;
+{
+    RM_Value vals[RM_MAX_ATTRS];
+    char num[16];
+    char *end;
+    int i, error;
+
+    if ((error = rm_TextToValues(schema, text, textlen, delim, vals)) != PFE_OK)
+        return error;
+    for (i = 0; i < schema->numAttrs; i++) {
+        if (schema->attrs[i].type != RM_TYPE_DICT || vals[i].isNull)
+            continue;
+        if (vals[i].slen >= (int) sizeof(num))
+            return RME_BADVALUE;
+        memcpy(num, vals[i].sval, vals[i].slen);
+        num[vals[i].slen] = '\0';
+        vals[i].ival = (int) strtol(num, &end, 10);
+        if (*end != '\0')
+            return RME_BADVALUE;
+    }
+    return RM_TupleEncode(schema, vals, buf, bufsize, len);
+}
+
+/* Encode a delimited text record for file "fh": dictionary fields are
+   looked up in, or added to, the dictionaries of the file. */
+int RM_DictTupleFromText(fh, text, textlen, delim, buf, bufsize, len)
+RM_FileHandle *fh;
+char *text;
+int textlen;
+int delim;
+char *buf;
+int bufsize;
+int *len;
+{
+    RM_Schema *schema = &fh->schema;
+    RM_Value vals[RM_MAX_ATTRS];
+    int i, error;
+
+    if ((error = rm_TextToValues(schema, text, textlen, delim, vals)) != PFE_OK)
+        return error;
+    for (i = 0; i < schema->numAttrs; i++) {
+        if (schema->attrs[i].type != RM_TYPE_DICT || vals[i].isNull)
+            continue;
+        if ((error = RM_DictEncode(fh, i, vals[i].sval, vals[i].slen,
+                                   &vals[i].ival)) != PFE_OK)
+            return error;
+    }
+    return RM_TupleEncode(schema, vals, buf, bufsize, len);
+}
+
+/* Render a tuple as text; dictionary fields are decoded through "fh"
+   if it is not NULL and printed as codes otherwise. */
+static int rm_TupleToText(schema, fh, tuple, delim, buf, bufsize)
+RM_Schema *schema;
+RM_FileHandle *fh;
+char *tuple;
+int delim;
+char *buf;
+int bufsize;
+{
+    char num[64];
+    char *f;
+    int i, pos, flen, n;
+
+    pos = 0;
+    for (i = 0; i < schema->numAttrs; i++) {
+        if (i > 0) {
+            if (pos + 1 >= bufsize)
+                return RME_RECTOOBIG;
+            buf[pos++] = delim;
+        }
+        if (RM_TupleIsNull(schema, tuple, i))
+            continue;
+        switch (schema->attrs[i].type) {
+        case RM_TYPE_INT:
+            sprintf(num, "%d", RM_TupleGetInt(schema, tuple, i));
+            f = num;
+            flen = strlen(num);
+            break;
+        case RM_TYPE_FLOAT:
+            sprintf(num, "%.2f", RM_TupleGetFloat(schema, tuple, i));
+            f = num;
+            flen = strlen(num);
+            break;
+        case RM_TYPE_DICT:
+            n = RM_TupleGetCode(schema, tuple, i);
+            f = (fh == NULL) ? NULL : RM_DictValue(fh, i, n, &flen);
+            if (f == NULL) {
+                sprintf(num, "%d", n);
+                f = num;
+                flen = strlen(num);
+            }
+            break;
+        default:
+            f = RM_TupleField(schema, tuple, i, &flen);
+            if (schema->attrs[i].type == RM_TYPE_CHAR)
+                for (n = 0; n < flen; n++)
+                    if (f[n] == '\0') {
+                        flen = n;
+                        break;
+                    }
+        }
+        if (pos + flen >= bufsize)
+            return RME_RECTOOBIG;
+        memcpy(buf + pos, f, flen);
+        pos += flen;
+    }
+    buf[pos] = '\0';
+    return pos;
+}
+
+/* Render a tuple as delimited text (NULLs as empty fields) into "buf";
+   returns the text length, or RME_RECTOOBIG if "buf" is too small. */
+int RM_TupleToText(schema, tuple, delim, buf, bufsize)
+RM_Schema *schema;
+char *tuple;
+int delim;
+char *buf;
+int bufsize;
+{
+    return rm_TupleToText(schema, (RM_FileHandle *) NULL, tuple, delim, buf, bufsize);
+}
+
+/* RM_TupleToText() with the dictionary values of file "fh" */
+int RM_DictTupleToText(fh, tuple, delim, buf, bufsize)
+RM_FileHandle *fh;
+char *tuple;
+int delim;
+char *buf;
+int bufsize;
+{
+    return rm_TupleToText(&fh->schema, fh, tuple, delim, buf, bufsize);
+}
+
+/*************** FIELD ACCESS ****************/
+
+int RM_TupleIsNull(schema, tuple, i)
+RM_Schema *schema;
+char *tuple;
+int i;
+{
+    return (tuple[i / 8] >> (i % 8)) & 1;
+}
+
+/* pointer to field i inside the tuple and its length in *len */
+char *RM_TupleField(schema, tuple, i, len)
+RM_Schema *schema;
+char *tuple;
+int i;
+int *len;
+{
+    return tuple + rm_FieldPos(schema, tuple, i, len);
+}
+
+/* value of int field i; 0 if it is NULL */
+int RM_TupleGetInt(schema, tuple, i)
+RM_Schema *schema;
+char *tuple;
+int i;
+{
+    int v = 0, len, pos;
+
+    pos = rm_FieldPos(schema, tuple, i, &len);
+    if (len == 4)
+        memcpy((char *) &v, tuple + pos, 4);
+    return v;
+}
+
+/* value of float field i; 0 if it is NULL */
+float RM_TupleGetFloat(schema, tuple, i)
+RM_Schema *schema;
+char *tuple;
+int i;
+{
+    float v = 0.0;
+    int len, pos;
+
+    pos = rm_FieldPos(schema, tuple, i, &len);
+    if (len == 4)
+        memcpy((char *) &v, tuple + pos, 4);
+    return v;
+}
+
+/* code of dictionary field i; -1 if it is NULL */
+int RM_TupleGetCode(schema, tuple, i)
+RM_Schema *schema;
+char *tuple;
+int i;
+{
+    unsigned short code;
+    int len, pos;
+
+    pos = rm_FieldPos(schema, tuple, i, &len);
+    if (len != 2)
+        return -1;
+    memcpy((char *) &code, tuple + pos, 2);
+    return code;
+}